@@ -0,0 +1,200 @@
+/*
+ * board_ctl.c
+ *
+ * Reads and changes the board's settings at run time over the binary
+ * control protocol (src/ctrl_proto.h). Every request waits for its ack,
+ * lost requests are retried with the same tag.
+ *
+ * usage: board_ctl [-b board_ip] [-r ctrl_port] ping
+ *        board_ctl [-b board_ip] [-r ctrl_port] start|stop
+ *        board_ctl [-b board_ip] [-r ctrl_port] get [name ...]
+ *        board_ctl [-b board_ip] [-r ctrl_port] set name=value ...
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ctrl_client.h"
+
+#define DEFAULT_BOARD_IP	"192.168.1.11"
+
+static const struct {
+	const char *name;
+	uint16_t id;
+	uint8_t type;
+} params[] = {
+	{ "roi_x", CTRL_PARAM_ROI_X, CTRL_TYPE_U32 },
+	{ "roi_y", CTRL_PARAM_ROI_Y, CTRL_TYPE_U32 },
+	{ "roi_width", CTRL_PARAM_ROI_WIDTH, CTRL_TYPE_U32 },
+	{ "roi_height", CTRL_PARAM_ROI_HEIGHT, CTRL_TYPE_U32 },
+	{ "bin_x", CTRL_PARAM_BIN_X, CTRL_TYPE_U32 },
+	{ "bin_y", CTRL_PARAM_BIN_Y, CTRL_TYPE_U32 },
+	{ "sensor_width", CTRL_PARAM_SENSOR_WIDTH, CTRL_TYPE_U32 },
+	{ "frame_pixels", CTRL_PARAM_FRAME_PIXELS, CTRL_TYPE_U32 },
+	{ "sum_frames", CTRL_PARAM_SUM_FRAMES, CTRL_TYPE_U32 },
+	{ "sum_bits", CTRL_PARAM_SUM_BITS, CTRL_TYPE_U32 },
+	{ "cal", CTRL_PARAM_CAL_ENABLE, CTRL_TYPE_BOOL },
+	{ "sparse", CTRL_PARAM_SPARSE, CTRL_TYPE_I32 },
+	{ "batch_frames", CTRL_PARAM_BATCH_FRAMES, CTRL_TYPE_U32 },
+	{ "batch_flush_us", CTRL_PARAM_BATCH_FLUSH_US, CTRL_TYPE_U32 },
+	{ "rate_kbps", CTRL_PARAM_RATE_KBPS, CTRL_TYPE_U32 },
+	{ "burst_bytes", CTRL_PARAM_BURST_BYTES, CTRL_TYPE_U32 },
+	{ "mcast_group", CTRL_PARAM_MCAST_GROUP, CTRL_TYPE_IP4 },
+	{ "mcast_ttl", CTRL_PARAM_MCAST_TTL, CTRL_TYPE_U32 },
+	{ "consumers", CTRL_PARAM_CONSUMERS, CTRL_TYPE_U32 },
+	{ "report_ms", CTRL_PARAM_REPORT_MS, CTRL_TYPE_U32 },
+	{ "session_ms", CTRL_PARAM_SESSION_MS, CTRL_TYPE_U32 },
+	{ "telem_ms", CTRL_PARAM_TELEM_MS, CTRL_TYPE_U32 },
+};
+
+#define PARAM_COUNT (sizeof(params) / sizeof(params[0]))
+
+static int find_name(const char *name, size_t len)
+{
+	for (size_t i = 0; i < PARAM_COUNT; i++)
+		if (strlen(params[i].name) == len &&
+				!strncmp(params[i].name, name, len))
+			return i;
+	return -1;
+}
+
+static const char *id_name(uint16_t id)
+{
+	for (size_t i = 0; i < PARAM_COUNT; i++)
+		if (params[i].id == id)
+			return params[i].name;
+	return "?";
+}
+
+/* Value of a record, addresses are given dotted */
+static uint32_t parse_value(uint8_t type, const char *str)
+{
+	struct in_addr addr;
+
+	if (type == CTRL_TYPE_IP4)
+		return inet_pton(AF_INET, str, &addr) == 1 ?
+				ntohl(addr.s_addr) : 0;
+	return (uint32_t)strtol(str, NULL, 0);
+}
+
+static void print_status(const uint8_t *reply, int len)
+{
+	const char *name = ctrl_status_name(reply[0]);
+
+	if (len >= 3)
+		fprintf(stderr, "nack: %s (%s)\n", name,
+				id_name(frame_get16(reply + 1)));
+	else
+		fprintf(stderr, "nack: %s\n", name);
+}
+
+static void print_records(const uint8_t *rec, int len)
+{
+	uint32_t v;
+
+	for (; len >= CTRL_RECORD_SIZE; rec += CTRL_RECORD_SIZE,
+			len -= CTRL_RECORD_SIZE) {
+		v = frame_get32(rec + 3);
+		if (rec[2] == CTRL_TYPE_I32)
+			printf("%s=%d\n", id_name(frame_get16(rec)), (int32_t)v);
+		else if (rec[2] == CTRL_TYPE_IP4)
+			printf("%s=%u.%u.%u.%u\n", id_name(frame_get16(rec)),
+					v >> 24, (v >> 16) & 0xff,
+					(v >> 8) & 0xff, v & 0xff);
+		else
+			printf("%s=%u\n", id_name(frame_get16(rec)), v);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *board_ip = DEFAULT_BOARD_IP, *cmd, *eq;
+	int ctrl_port = CTRL_DEFAULT_PORT, sock, opt, len = 0, p;
+	uint8_t body[CTRL_BODY_MAX], reply[CTRL_HEADER_SIZE + CTRL_BODY_MAX];
+	struct sockaddr_in board;
+	uint8_t op;
+
+	while ((opt = getopt(argc, argv, "b:r:")) != -1) {
+		switch (opt) {
+		case 'b': board_ip = optarg; break;
+		case 'r': ctrl_port = atoi(optarg); break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc)
+		goto usage;
+	cmd = argv[optind++];
+
+	if (!strcmp(cmd, "ping")) {
+		op = CTRL_OP_PING;
+	} else if (!strcmp(cmd, "start")) {
+		op = CTRL_OP_START;
+	} else if (!strcmp(cmd, "stop")) {
+		op = CTRL_OP_STOP;
+	} else if (!strcmp(cmd, "get")) {
+		op = CTRL_OP_GET;
+		for (; optind < argc; optind++, len += 2) {
+			p = find_name(argv[optind], strlen(argv[optind]));
+			if (p < 0 || len + 2 > CTRL_BODY_MAX) {
+				fprintf(stderr, "unknown parameter %s\n",
+						argv[optind]);
+				return 1;
+			}
+			frame_put16(body + len, params[p].id);
+		}
+	} else if (!strcmp(cmd, "set")) {
+		op = CTRL_OP_SET;
+		for (; optind < argc; optind++, len += CTRL_RECORD_SIZE) {
+			eq = strchr(argv[optind], '=');
+			p = eq ? find_name(argv[optind], eq - argv[optind]) : -1;
+			if (p < 0 || len + CTRL_RECORD_SIZE > CTRL_BODY_MAX) {
+				fprintf(stderr, "expected name=value, not %s\n",
+						argv[optind]);
+				return 1;
+			}
+			ctrl_record_put(body + len, params[p].id, params[p].type,
+					parse_value(params[p].type, eq + 1));
+		}
+		if (!len)
+			goto usage;
+	} else {
+		goto usage;
+	}
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		perror("socket");
+		return 1;
+	}
+	memset(&board, 0, sizeof(board));
+	board.sin_family = AF_INET;
+	board.sin_port = htons(ctrl_port);
+	if (inet_pton(AF_INET, board_ip, &board.sin_addr) != 1) {
+		fprintf(stderr, "invalid board address %s\n", board_ip);
+		return 1;
+	}
+
+	len = ctrl_transact(sock, &board, op, body, len, reply);
+	close(sock);
+	if (len < 0)
+		return 1;
+	if (reply[0] != CTRL_OK) {
+		print_status(reply, len);
+		return 1;
+	}
+	if (op == CTRL_OP_GET)
+		print_records(reply + 1, len - 1);
+	else
+		printf("ok\n");
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-b board_ip] [-r ctrl_port] "
+			"ping|start|stop|get [name ...]|set name=value ...\n",
+			argv[0]);
+	return 1;
+}
@@ -0,0 +1,209 @@
+/*
+ * cal_upload.c
+ *
+ * Computes the dark offset and flat field gain tables of the board's frame
+ * correction (src/frame_calib.h) from recorded frames and uploads them over
+ * the control protocol (src/ctrl_proto.h). Every chunk is acknowledged, the
+ * correction is only switched on once all of them are. The recordings are
+ * raw 8 bit frames of the full sensor, as frame_dump -w writes them, every
+ * file is averaged over all the frames it holds. The gain of a pixel is the mean flat signal over its own, both
+ * taken above the dark level.
+ *
+ * usage: cal_upload -z pixels [-d dark_file] [-f flat_file] [-b board_ip]
+ *                   [-r ctrl_port]
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ctrl_client.h"
+#include "frame_calib.h"
+
+#define DEFAULT_BOARD_IP	"192.168.1.11"
+/* table bytes per request, a whole number of gains */
+#define CHUNK_BYTES		((CTRL_BODY_MAX - CTRL_CAL_HEADER) & ~1u)
+
+/* Average all frames of n pixels in path, returns -1 if it holds none */
+static int read_mean(const char *path, uint32_t n, double *mean)
+{
+	uint8_t *frame = malloc(n);
+	FILE *f = fopen(path, "rb");
+	uint64_t frames = 0;
+
+	if (!frame || !f) {
+		perror(path);
+		free(frame);
+		if (f)
+			fclose(f);
+		return -1;
+	}
+
+	memset(mean, 0, n * sizeof(*mean));
+	while (fread(frame, 1, n, f) == n) {
+		for (uint32_t i = 0; i < n; i++)
+			mean[i] += frame[i];
+		frames++;
+	}
+	fclose(f);
+	free(frame);
+
+	if (!frames) {
+		fprintf(stderr, "%s: no complete frame of %u pixels\n", path, n);
+		return -1;
+	}
+	for (uint32_t i = 0; i < n; i++)
+		mean[i] /= frames;
+	printf("%s: %llu frames\n", path, (unsigned long long)frames);
+	return 0;
+}
+
+/* Send a request, returns -1 unless the board acked it */
+static int request(int sock, const struct sockaddr_in *board, uint8_t op,
+		const uint8_t *body, uint16_t len, const char *what)
+{
+	uint8_t reply[CTRL_HEADER_SIZE + CTRL_BODY_MAX];
+	int n = ctrl_transact(sock, board, op, body, len, reply);
+
+	if (n < 0)
+		return -1;
+	if (reply[0] != CTRL_OK) {
+		fprintf(stderr, "%s: nack: %s\n", what,
+				ctrl_status_name(reply[0]));
+		return -1;
+	}
+	return 0;
+}
+
+static int set_correction(int sock, const struct sockaddr_in *board, int on)
+{
+	uint8_t rec[CTRL_RECORD_SIZE];
+
+	ctrl_record_put(rec, CTRL_PARAM_CAL_ENABLE, CTRL_TYPE_BOOL, on);
+	return request(sock, board, CTRL_OP_SET, rec, sizeof(rec),
+			on ? "correction on" : "correction off");
+}
+
+static int send_table(int sock, const struct sockaddr_in *board,
+		uint8_t table, const uint8_t *entries, uint32_t count,
+		uint32_t entry_bytes)
+{
+	uint8_t body[CTRL_CAL_HEADER + CHUNK_BYTES];
+	uint32_t per_chunk = CHUNK_BYTES / entry_bytes, n;
+
+	for (uint32_t off = 0; off < count; off += n) {
+		n = count - off < per_chunk ? count - off : per_chunk;
+		body[0] = table;
+		frame_put32(body + 1, off);
+		memcpy(body + CTRL_CAL_HEADER, entries + off * entry_bytes,
+				n * entry_bytes);
+		if (request(sock, board, CTRL_OP_CAL, body,
+				CTRL_CAL_HEADER + n * entry_bytes,
+				table == CTRL_CAL_DARK ? "dark" : "gain"))
+			return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *board_ip = DEFAULT_BOARD_IP;
+	const char *dark_path = NULL, *flat_path = NULL;
+	int ctrl_port = CTRL_DEFAULT_PORT;
+	uint32_t pixels = 0;
+	struct sockaddr_in board;
+	double *dark_mean, *flat_mean, signal, level = 0;
+	uint8_t *dark, *gain;
+	uint32_t g, used = 0;
+	int sock, opt;
+
+	while ((opt = getopt(argc, argv, "z:d:f:b:r:")) != -1) {
+		switch (opt) {
+		case 'z': pixels = atoi(optarg); break;
+		case 'd': dark_path = optarg; break;
+		case 'f': flat_path = optarg; break;
+		case 'b': board_ip = optarg; break;
+		case 'r': ctrl_port = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s -z pixels [-d dark_file] "
+					"[-f flat_file] [-b board_ip] "
+					"[-r ctrl_port]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!pixels) {
+		fprintf(stderr, "the sensor pixel count (-z) is required\n");
+		return 1;
+	}
+
+	dark_mean = calloc(pixels, sizeof(*dark_mean));
+	flat_mean = calloc(pixels, sizeof(*flat_mean));
+	dark = calloc(pixels, 1);
+	gain = calloc(pixels, 2);
+	if (!dark_mean || !flat_mean || !dark || !gain) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	/* without recordings the tables are neutral */
+	if (dark_path && read_mean(dark_path, pixels, dark_mean))
+		return 1;
+	if (flat_path && read_mean(flat_path, pixels, flat_mean))
+		return 1;
+
+	for (uint32_t i = 0; i < pixels; i++) {
+		dark[i] = (uint8_t)(dark_mean[i] + 0.5);
+		if (flat_path && flat_mean[i] > dark_mean[i]) {
+			level += flat_mean[i] - dark_mean[i];
+			used++;
+		}
+	}
+	if (used)
+		level /= used;
+
+	for (uint32_t i = 0; i < pixels; i++) {
+		signal = flat_mean[i] - dark_mean[i];
+		/* dead pixels keep unit gain */
+		g = FRAME_CALIB_GAIN_ONE;
+		if (flat_path && signal > 0) {
+			signal = level / signal * FRAME_CALIB_GAIN_ONE + 0.5;
+			g = signal > 0xffff ? 0xffff : (uint32_t)signal;
+		}
+		frame_put16(gain + 2 * i, g);
+	}
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	memset(&board, 0, sizeof(board));
+	board.sin_family = AF_INET;
+	board.sin_port = htons(ctrl_port);
+	if (inet_pton(AF_INET, board_ip, &board.sin_addr) != 1) {
+		fprintf(stderr, "invalid board address %s\n", board_ip);
+		return 1;
+	}
+
+	/* frames captured during the upload would mix old and new tables,
+	 * the correction stays off unless every chunk was acked */
+	if (set_correction(sock, &board, 0) ||
+			send_table(sock, &board, CTRL_CAL_DARK, dark, pixels, 1) ||
+			send_table(sock, &board, CTRL_CAL_GAIN, gain, pixels, 2) ||
+			set_correction(sock, &board, 1)) {
+		fprintf(stderr, "upload failed, the correction stays off\n");
+		return 1;
+	}
+	printf("uploaded %u dark offsets and gains, mean flat signal %.1f\n",
+			pixels, level);
+
+	close(sock);
+	free(dark_mean);
+	free(flat_mean);
+	free(dark);
+	free(gain);
+	return 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * codec_bench.c
+ *
+ * Throughput and compression benchmark of the frame codec the firmware
+ * uses (src/frame_codec.c). Synthetic sensor frames, a smooth profile that
+ * drifts slowly plus noise, are coded in place the way the board does it,
+ * then decoded and compared with the originals. With -b the pixels have
+ * fewer significant bits and the bit packing of src/frame_pack.c is
+ * measured as well, with -t the sparse coding of src/frame_sparse.c of
+ * the pixels above a threshold.
+ *
+ * usage: codec_bench [-z pixels] [-n frames] [-k key_interval] [-a noise]
+ *                    [-b bits] [-t threshold]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "frame_codec.h"
+#include "frame_pack.h"
+#include "frame_sparse.h"
+
+struct coded_frame {
+	uint32_t len;
+	uint16_t format;
+	uint16_t flags;
+};
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Sum of 4 uniform values, roughly gaussian around 0 with the given span */
+static int noise(int amplitude)
+{
+	int v = 0;
+
+	if (!amplitude)
+		return 0;
+	for (int i = 0; i < 4; i++)
+		v += rand() % (2 * amplitude + 1) - amplitude;
+	return v / 2;
+}
+
+static void make_frame(uint8_t *px, uint32_t n, uint32_t f, int amplitude,
+		uint32_t bits)
+{
+	int v;
+
+	for (uint32_t i = 0; i < n; i++) {
+		/* a ramp with a bump that moves by a pixel every 8 frames */
+		v = 40 + (int)(i * 120 / n);
+		if ((i + f / 8) % n < n / 8)
+			v += 60;
+		v += noise(amplitude);
+		px[i] = (v < 0 ? 0 : v > 255 ? 255 : v) >> (8 - bits);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t pixels = 1024, frames = 20000, key_interval = 32, bits = 8;
+	int amplitude = 2, opt;
+	struct frame_codec enc, dec;
+	struct frame_header h;
+	struct coded_frame *coded;
+	uint8_t *src, *buf, *dst, *out, *enc_work, *dec_work;
+	uint64_t payload = 0, keys = 0, raw = 0;
+	double t0, t_enc, t_dec, t_pack, t_unpack;
+	uint32_t packed;
+	int threshold = -1;
+
+	while ((opt = getopt(argc, argv, "z:n:k:a:b:t:")) != -1) {
+		switch (opt) {
+		case 'z': pixels = atoi(optarg); break;
+		case 'n': frames = atoi(optarg); break;
+		case 'k': key_interval = atoi(optarg); break;
+		case 'a': amplitude = atoi(optarg); break;
+		case 'b': bits = atoi(optarg); break;
+		case 't': threshold = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-z pixels] [-n frames] "
+					"[-k key_interval] [-a noise] [-b bits] "
+					"[-t threshold]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!pixels || !frames) {
+		fprintf(stderr, "pixels and frames must be > 0\n");
+		return 1;
+	}
+	if (bits < 1 || bits > 8) {
+		fprintf(stderr, "bits must be 1 to 8\n");
+		return 1;
+	}
+	if (threshold > 255) {
+		fprintf(stderr, "threshold must be 0 to 255\n");
+		return 1;
+	}
+
+	src = malloc((size_t)pixels * frames);
+	buf = malloc((size_t)pixels * frames + 8);
+	dst = malloc((size_t)pixels * frames);
+	out = malloc(pixels);
+	coded = calloc(frames, sizeof(*coded));
+	enc_work = aligned_alloc(16, CODEC_ALIGN16(FRAME_CODEC_WORK_SIZE(pixels)));
+	dec_work = aligned_alloc(16, CODEC_ALIGN16(FRAME_CODEC_WORK_SIZE(pixels)));
+	if (!src || !buf || !dst || !out || !coded || !enc_work || !dec_work) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	srand(1);
+	for (uint32_t f = 0; f < frames; f++)
+		make_frame(src + (size_t)f * pixels, pixels, f, amplitude, bits);
+	memcpy(buf, src, (size_t)pixels * frames);
+
+	frame_codec_init(&enc, enc_work, pixels, key_interval);
+	t0 = now_s();
+	for (uint32_t f = 0; f < frames; f++) {
+		coded[f].flags = 0;
+		coded[f].len = frame_codec_encode(&enc, buf + (size_t)f * pixels,
+				pixels, f, &coded[f].format, &coded[f].flags);
+	}
+	t_enc = now_s() - t0;
+
+	frame_codec_init(&dec, dec_work, pixels, 0);
+	memset(&h, 0, sizeof(h));
+	h.pixel_count = pixels;
+	t0 = now_s();
+	for (uint32_t f = 0; f < frames; f++) {
+		h.sequence = f;
+		h.format = coded[f].format;
+		h.flags = coded[f].flags;
+		h.payload_len = coded[f].len;
+		if (frame_codec_decode(&dec, &h, buf + (size_t)f * pixels, out) ||
+				memcmp(out, src + (size_t)f * pixels, pixels)) {
+			fprintf(stderr, "frame %u does not decode to the original\n",
+					f);
+			return 1;
+		}
+	}
+	t_dec = now_s() - t0;
+
+	for (uint32_t f = 0; f < frames; f++) {
+		payload += coded[f].len;
+		keys += !!(coded[f].flags & FRAME_FLAG_KEY);
+		raw += coded[f].format == FRAME_FMT_RAW8;
+	}
+
+	printf("%u frames of %u pixels, noise +-%d, key interval %u\n",
+			frames, pixels, amplitude, key_interval);
+	printf("ratio %.2f (%.1f bytes/frame), %llu key frames, "
+			"%llu sent raw\n",
+			(double)pixels * frames / payload, (double)payload / frames,
+			(unsigned long long)keys, (unsigned long long)raw);
+	printf("encode %8.1f MB/s  %7.0f ns/frame\n",
+			pixels * (double)frames / t_enc / 1e6, t_enc / frames * 1e9);
+	printf("decode %8.1f MB/s  %7.0f ns/frame\n",
+			pixels * (double)frames / t_dec / 1e6, t_dec / frames * 1e9);
+
+	if (bits < 8) {
+		/* the packed frames fit in the slots of the raw ones */
+		packed = FRAME_PACK_LEN(pixels, bits);
+		t0 = now_s();
+		for (uint32_t f = 0; f < frames; f++)
+			frame_pack(buf + (size_t)f * pixels,
+					src + (size_t)f * pixels, pixels, bits);
+		t_pack = now_s() - t0;
+
+		t0 = now_s();
+		for (uint32_t f = 0; f < frames; f++)
+			frame_unpack(dst + (size_t)f * pixels,
+					buf + (size_t)f * pixels, packed, pixels, bits);
+		t_unpack = now_s() - t0;
+		if (memcmp(dst, src, (size_t)pixels * frames)) {
+			fprintf(stderr, "unpacked frames differ from the originals\n");
+			return 1;
+		}
+
+		printf("%u bit pixels, packed ratio %.2f\n", bits,
+				(double)pixels / packed);
+		printf("pack   %8.1f MB/s  %7.0f ns/frame\n",
+				pixels * (double)frames / t_pack / 1e6,
+				t_pack / frames * 1e9);
+		printf("unpack %8.1f MB/s  %7.0f ns/frame\n",
+				pixels * (double)frames / t_unpack / 1e6,
+				t_unpack / frames * 1e9);
+	}
+	if (threshold >= 0) {
+		uint64_t above = 0, dense = 0;
+
+		/* frames the sparse coding does not shrink stay dense, as on
+		 * the board, they are left out of the ratio */
+		payload = 0;
+		t0 = now_s();
+		for (uint32_t f = 0; f < frames; f++) {
+			coded[f].len = frame_sparse_encode(buf + (size_t)f * pixels,
+					pixels - 1, src + (size_t)f * pixels, pixels,
+					threshold);
+			payload += coded[f].len ? coded[f].len : pixels;
+			dense += !coded[f].len;
+		}
+		t_enc = now_s() - t0;
+
+		t0 = now_s();
+		for (uint32_t f = 0; f < frames; f++) {
+			if (coded[f].len && frame_sparse_decode(
+					dst + (size_t)f * pixels, pixels,
+					buf + (size_t)f * pixels, coded[f].len)) {
+				fprintf(stderr, "sparse frame %u is corrupt\n", f);
+				return 1;
+			}
+		}
+		t_dec = now_s() - t0;
+
+		for (uint32_t f = 0; f < frames; f++) {
+			uint8_t *a = src + (size_t)f * pixels;
+			uint8_t *b = dst + (size_t)f * pixels;
+
+			for (uint32_t i = 0; coded[f].len && i < pixels; i++) {
+				if (b[i] != (a[i] > threshold ? a[i] : 0)) {
+					fprintf(stderr, "sparse frame %u differs "
+							"at pixel %u\n", f, i);
+					return 1;
+				}
+			}
+			for (uint32_t i = 0; i < pixels; i++)
+				above += a[i] > threshold;
+		}
+
+		printf("threshold %d, %.1f%% of the pixels above, sparse ratio "
+				"%.2f, %llu frames sent dense\n", threshold,
+				100.0 * above / ((double)pixels * frames),
+				(double)pixels * frames / payload,
+				(unsigned long long)dense);
+		printf("sparse %8.1f MB/s  %7.0f ns/frame\n",
+				pixels * (double)frames / t_enc / 1e6,
+				t_enc / frames * 1e9);
+		/* only the frames sent sparse are expanded */
+		if (dense < frames)
+			printf("expand %8.1f MB/s  %7.0f ns/frame\n",
+					pixels * (double)(frames - dense) /
+					t_dec / 1e6,
+					t_dec / (frames - dense) * 1e9);
+	}
+	printf("all frames decoded bit exact\n");
+
+	free(src);
+	free(buf);
+	free(dst);
+	free(out);
+	free(coded);
+	free(enc_work);
+	free(dec_work);
+	return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * ctrl_client.c
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "ctrl_client.h"
+
+#define REPLY_TIMEOUT_MS	300
+#define RETRIES			3
+
+static const char *status_name[] = {
+	"ok", "unsupported version", "unknown opcode", "bad length",
+	"unknown parameter", "wrong type", "out of range", "read only",
+	"busy",
+};
+
+static uint16_t next_tag;
+
+int ctrl_transact(int sock, const struct sockaddr_in *board, uint8_t op,
+		const uint8_t *body, uint16_t len, uint8_t *reply)
+{
+	uint8_t req[CTRL_HEADER_SIZE + CTRL_BODY_MAX];
+	struct ctrl_header h = { CTRL_PROTO_VERSION, op, 0, len }, r;
+	struct pollfd pfd = { .fd = sock, .events = POLLIN };
+	ssize_t n;
+
+	if (!next_tag)
+		next_tag = (uint16_t)(time(NULL) ^ getpid());
+	h.tag = next_tag++;
+	ctrl_header_put(req, &h);
+	memcpy(req + CTRL_HEADER_SIZE, body, len);
+
+	for (int attempt = 0; attempt < RETRIES; attempt++) {
+		if (sendto(sock, req, CTRL_HEADER_SIZE + len, 0,
+				(const struct sockaddr *)board,
+				sizeof(*board)) < 0) {
+			perror("sendto");
+			return -1;
+		}
+		while (poll(&pfd, 1, REPLY_TIMEOUT_MS) > 0) {
+			n = recv(sock, reply, CTRL_HEADER_SIZE + CTRL_BODY_MAX, 0);
+			/* late replies to an earlier attempt carry the same tag */
+			if (n < 0 || ctrl_header_get(reply, n, &r) ||
+					r.tag != h.tag ||
+					r.opcode != (op | CTRL_OP_REPLY) || !r.len)
+				continue;
+			memmove(reply, reply + CTRL_HEADER_SIZE, r.len);
+			return r.len;
+		}
+	}
+	fprintf(stderr, "no reply from the board\n");
+	return -1;
+}
+
+const char *ctrl_status_name(uint8_t status)
+{
+	return status < sizeof(status_name) / sizeof(status_name[0]) ?
+			status_name[status] : "?";
+}
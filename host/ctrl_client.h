@@ -0,0 +1,28 @@
+/*
+ * ctrl_client.h
+ *
+ * Request and reply of the binary control protocol (src/ctrl_proto.h) for
+ * the host tools. Every request waits for its reply, lost requests are
+ * retried with the same tag, each request gets a new one.
+ */
+
+#ifndef __CTRL_CLIENT_H_
+#define __CTRL_CLIENT_H_
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include "ctrl_proto.h"
+
+/* UDP_CTRL_PORT of the firmware */
+#define CTRL_DEFAULT_PORT	50001
+
+/* Send a request and wait for its reply. reply holds CTRL_HEADER_SIZE +
+ * CTRL_BODY_MAX bytes and gets the reply body. Returns the body length or
+ * -1 if no reply came. */
+int ctrl_transact(int sock, const struct sockaddr_in *board, uint8_t op,
+		const uint8_t *body, uint16_t len, uint8_t *reply);
+
+/* Name of a reply status */
+const char *ctrl_status_name(uint8_t status);
+
+#endif /* __CTRL_CLIENT_H_ */
@@ -0,0 +1,271 @@
+/*
+ * frame_dump.c
+ *
+ * Minimal receiver of the sensor stream. Sends "start" to the board, prints
+ * one line per received frame and a loss / latency summary on exit. Frames
+ * sent in fragments are reassembled, coded frames are decoded, the pixels
+ * of every frame go to a file with -w, the sums of integrated frames in
+ * host byte order.
+ *
+ * With -g the frames are received from a multicast group, "start" and
+ * "finish" then only sign this receiver on and off.
+ *
+ * usage: frame_dump [-b board_ip] [-p port] [-r board_port] [-n frames]
+ *                   [-w file] [-g group]
+ */
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "frame_parse.h"
+#include "frame_reasm.h"
+#include "frame_codec.h"
+
+#define DEFAULT_BOARD_IP	"192.168.1.11"
+#define DEFAULT_PORT		50000
+/* first ephemeral port lwIP hands out, used by the board's data pcb */
+#define DEFAULT_BOARD_PORT	49152
+/* largest frame the decoder keeps as reference */
+#define MAX_PIXELS		65536
+
+static volatile sig_atomic_t stop;
+
+struct dump_ctx {
+	struct frame_tracker tracker;
+	uint64_t recv_us;
+	struct frame_codec codec;
+	uint8_t pixels[MAX_PIXELS];
+	uint64_t pixel_bytes;
+	uint64_t payload_bytes;
+	uint64_t undecodable;
+	FILE *out;
+};
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Integrated frame of 16 or 32 bit sums */
+static int dump_sums(struct dump_ctx *ctx, const struct frame_header *h,
+		const uint8_t *payload)
+{
+	uint32_t bytes = h->format == FRAME_FMT_SUM16 ? 2 : 4;
+	uint16_t v16;
+	uint32_t v32;
+
+	if (h->payload_len < (uint64_t)h->pixel_count * bytes)
+		return -1;
+	if (!ctx->out)
+		return 0;
+
+	for (uint32_t i = 0; i < h->pixel_count; i++) {
+		if (bytes == 2) {
+			v16 = frame_get16(payload + 2 * i);
+			fwrite(&v16, 2, 1, ctx->out);
+		} else {
+			v32 = frame_get32(payload + 4 * i);
+			fwrite(&v32, 4, 1, ctx->out);
+		}
+	}
+	return 0;
+}
+
+static void on_frame(void *arg, const struct frame_header *h,
+		const uint8_t *payload)
+{
+	struct dump_ctx *ctx = arg;
+	int64_t latency;
+	int ok = 0;
+
+	latency = frame_tracker_update(&ctx->tracker, h, ctx->recv_us);
+	if (h->format == FRAME_FMT_SUM16 || h->format == FRAME_FMT_SUM32) {
+		ok = !dump_sums(ctx, h, payload);
+		/* nothing to decode, the sums are sent as they are */
+		if (ok)
+			ctx->pixel_bytes += h->payload_len;
+	} else if (h->pixel_count <= MAX_PIXELS) {
+		ok = !frame_codec_decode(&ctx->codec, h, payload, ctx->pixels);
+		if (ok)
+			ctx->pixel_bytes += h->pixel_count;
+		if (ok && ctx->out)
+			fwrite(ctx->pixels, 1, h->pixel_count, ctx->out);
+	}
+	if (ok) {
+		ctx->payload_bytes += h->payload_len;
+	} else {
+		ctx->undecodable++;
+	}
+
+	printf("seq %10u  t %14llu us  pixels %5u  bytes %5u  fmt %u%s  "
+			"flags 0x%04x  window %ux%u+%u+%u bin %ux%u  frames %u  "
+			"latency +%lld us\n",
+			h->sequence, (unsigned long long)h->timestamp_us,
+			h->pixel_count, h->payload_len, h->format,
+			ok ? "" : "!", h->flags, h->geometry.width,
+			h->geometry.width ? h->pixel_count / h->geometry.width : 0,
+			h->geometry.x, h->geometry.y, h->geometry.bin_x,
+			h->geometry.bin_y, h->frames, (long long)latency);
+	if (h->flags & FRAME_FLAG_LAST)
+		stop = 1;
+}
+
+static int send_command(int sock, const struct sockaddr_in *board,
+		const char *cmd)
+{
+	/* the board's command parser expects the terminating NUL */
+	return sendto(sock, cmd, strlen(cmd) + 1, 0,
+			(const struct sockaddr *)board, sizeof(*board));
+}
+
+int main(int argc, char **argv)
+{
+	const char *board_ip = DEFAULT_BOARD_IP;
+	int port = DEFAULT_PORT, board_port = DEFAULT_BOARD_PORT;
+	long max_frames = 0;
+	struct sockaddr_in local, board;
+	static struct dump_ctx ctx;
+	struct frame_reasm reasm;
+	static uint8_t codec_work[FRAME_CODEC_WORK_SIZE(MAX_PIXELS)]
+			__attribute__((aligned(16)));
+	const char *out_path = NULL, *group = NULL;
+	struct ip_mreq mreq;
+	struct timeval tv = { 0, 200000 };
+	uint8_t buf[65536];
+	uint64_t datagrams = 0, bad = 0;
+	ssize_t len;
+	int sock, cmd_sock, opt, on = 1;
+
+	while ((opt = getopt(argc, argv, "b:p:r:n:w:g:")) != -1) {
+		switch (opt) {
+		case 'b': board_ip = optarg; break;
+		case 'p': port = atoi(optarg); break;
+		case 'r': board_port = atoi(optarg); break;
+		case 'n': max_frames = atol(optarg); break;
+		case 'w': out_path = optarg; break;
+		case 'g': group = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-b board_ip] [-p port] "
+					"[-r board_port] [-n frames] [-w file] "
+					"[-g group]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	/* receivers of a multicast stream on one host share the port */
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(port);
+	if (bind(sock, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		perror("bind");
+		return 1;
+	}
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	if (group) {
+		memset(&mreq, 0, sizeof(mreq));
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (inet_pton(AF_INET, group, &mreq.imr_multiaddr) != 1 ||
+				setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+				&mreq, sizeof(mreq)) < 0) {
+			fprintf(stderr, "cannot join multicast group %s\n",
+					group);
+			return 1;
+		}
+	}
+
+	memset(&board, 0, sizeof(board));
+	board.sin_family = AF_INET;
+	board.sin_port = htons(board_port);
+	if (inet_pton(AF_INET, board_ip, &board.sin_addr) != 1) {
+		fprintf(stderr, "invalid board address %s\n", board_ip);
+		return 1;
+	}
+
+	if (out_path) {
+		ctx.out = fopen(out_path, "wb");
+		if (!ctx.out) {
+			perror(out_path);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, on_signal);
+	frame_tracker_init(&ctx.tracker);
+	frame_codec_init(&ctx.codec, codec_work, MAX_PIXELS, 0);
+	frame_reasm_init(&reasm, on_frame, &ctx);
+	/* receivers of a group tell the board apart by their address and
+	 * port, on one host they only differ in the port commands come from */
+	cmd_sock = group ? socket(AF_INET, SOCK_DGRAM, 0) : sock;
+	if (cmd_sock < 0) {
+		perror("socket");
+		return 1;
+	}
+	send_command(cmd_sock, &board, "start");
+
+	while (!stop) {
+		len = recv(sock, buf, sizeof(buf), 0);
+		if (len < 0)
+			continue;
+
+		ctx.recv_us = now_us();
+		datagrams++;
+		if (frame_parse_datagram(buf, len, frame_reasm_record,
+				&reasm) < 0)
+			bad++;
+		if (max_frames && ctx.tracker.frames >= (uint64_t)max_frames)
+			break;
+	}
+
+	send_command(cmd_sock, &board, "finish");
+	if (cmd_sock != sock)
+		close(cmd_sock);
+	close(sock);
+	frame_reasm_free(&reasm);
+
+	printf("%llu datagrams (%llu malformed), %llu frames, %llu lost, "
+			"%llu reordered, %llu duplicates, %llu overruns\n",
+			(unsigned long long)datagrams, (unsigned long long)bad,
+			(unsigned long long)ctx.tracker.frames,
+			(unsigned long long)ctx.tracker.lost,
+			(unsigned long long)ctx.tracker.reordered,
+			(unsigned long long)ctx.tracker.duplicates,
+			(unsigned long long)ctx.tracker.overruns);
+	printf("%llu frames reassembled, %llu incomplete, %llu duplicate "
+			"fragments, %llu bad fragments\n",
+			(unsigned long long)reasm.completed,
+			(unsigned long long)reasm.expired,
+			(unsigned long long)reasm.duplicates,
+			(unsigned long long)reasm.bad);
+	printf("%llu undecodable frames, %llu payload bytes for %llu pixels "
+			"(ratio %.2f)\n", (unsigned long long)ctx.undecodable,
+			(unsigned long long)ctx.payload_bytes,
+			(unsigned long long)ctx.pixel_bytes,
+			ctx.payload_bytes ?
+			(double)ctx.pixel_bytes / ctx.payload_bytes : 0.0);
+	if (ctx.out)
+		fclose(ctx.out);
+	return 0;
+}
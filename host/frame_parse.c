@@ -0,0 +1,79 @@
+/*
+ * frame_parse.c
+ *
+ * Host side parser of the sensor stream.
+ */
+
+#include "frame_parse.h"
+
+int frame_parse_datagram(const uint8_t *buf, size_t len, frame_record_fn fn,
+		void *arg)
+{
+	struct frame_header h;
+	int records = 0;
+	int offset;
+
+	while (len > 0) {
+		offset = frame_header_get(buf, len, &h);
+		if (offset < 0)
+			return -1;
+
+		if (fn)
+			fn(arg, &h, buf + offset);
+		records++;
+
+		buf += offset + h.payload_len;
+		len -= offset + h.payload_len;
+	}
+
+	return records;
+}
+
+void frame_tracker_init(struct frame_tracker *t)
+{
+	t->frames = 0;
+	t->lost = 0;
+	t->reordered = 0;
+	t->duplicates = 0;
+	t->overruns = 0;
+	t->next_seq = 0;
+	t->started = 0;
+	t->offset_us = INT64_MAX;
+	t->last_latency_us = 0;
+}
+
+int64_t frame_tracker_update(struct frame_tracker *t,
+		const struct frame_header *h, uint64_t recv_us)
+{
+	int32_t gap;
+	int64_t delta;
+
+	t->frames++;
+	if (h->flags & FRAME_FLAG_OVERRUN)
+		t->overruns++;
+
+	if (!t->started) {
+		t->started = 1;
+		t->next_seq = h->sequence + 1;
+	} else {
+		/* signed distance copes with the sequence wrapping around */
+		gap = (int32_t)(h->sequence - t->next_seq);
+		if (gap >= 0) {
+			t->lost += gap;
+			t->next_seq = h->sequence + 1;
+		} else if (t->lost > 0) {
+			/* a frame counted as lost arrived late */
+			t->lost--;
+			t->reordered++;
+		} else {
+			t->duplicates++;
+		}
+	}
+
+	delta = (int64_t)(recv_us - h->timestamp_us);
+	if (delta < t->offset_us)
+		t->offset_us = delta;
+	t->last_latency_us = delta - t->offset_us;
+
+	return t->last_latency_us;
+}
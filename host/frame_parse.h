@@ -0,0 +1,52 @@
+/*
+ * frame_parse.h
+ *
+ * Host side parser of the sensor stream (see src/frame_proto.h) and
+ * loss / reordering / latency tracking over the frame sequence numbers.
+ */
+
+#ifndef __FRAME_PARSE_H_
+#define __FRAME_PARSE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_proto.h"
+
+typedef void (*frame_record_fn)(void *arg, const struct frame_header *h,
+		const uint8_t *payload);
+
+/*
+ * Walk all frame records of one datagram and call fn for each of them.
+ * Returns the number of records, or -1 if the datagram is malformed (fn has
+ * then been called for the records in front of the bad one).
+ */
+int frame_parse_datagram(const uint8_t *buf, size_t len, frame_record_fn fn,
+		void *arg);
+
+struct frame_tracker {
+	uint64_t frames;
+	uint64_t lost;
+	uint64_t reordered;
+	uint64_t duplicates;
+	uint64_t overruns;
+	uint32_t next_seq;
+	int started;
+
+	/*
+	 * The board timestamps frames with its own clock, so only latency
+	 * relative to the fastest frame seen can be measured. offset_us is the
+	 * minimum of (receive time - capture time), which is the clock offset
+	 * plus the smallest transfer delay.
+	 */
+	int64_t offset_us;
+	int64_t last_latency_us;
+};
+
+void frame_tracker_init(struct frame_tracker *t);
+
+/* Account one frame received at recv_us (host clock, useconds). Returns
+ * the relative latency of the frame in useconds. */
+int64_t frame_tracker_update(struct frame_tracker *t,
+		const struct frame_header *h, uint64_t recv_us);
+
+#endif /* __FRAME_PARSE_H_ */
@@ -0,0 +1,125 @@
+/*
+ * frame_reasm.c
+ *
+ * The payload buffer of a slot grows with the highest fragment received,
+ * every fragment but the last has the same size, so a frame is rarely
+ * copied more than once. Slot buffers are kept for the next frames.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "frame_reasm.h"
+
+void frame_reasm_init(struct frame_reasm *r, frame_record_fn fn, void *arg)
+{
+	memset(r, 0, sizeof(*r));
+	r->fn = fn;
+	r->arg = arg;
+}
+
+void frame_reasm_free(struct frame_reasm *r)
+{
+	for (int i = 0; i < FRAME_REASM_SLOTS; i++) {
+		if (r->slots[i].used)
+			r->expired++;
+		free(r->slots[i].payload);
+		free(r->slots[i].seen);
+		r->slots[i].payload = NULL;
+		r->slots[i].seen = NULL;
+		r->slots[i].size = 0;
+		r->slots[i].used = 0;
+	}
+}
+
+/* Slot of the frame h belongs to, a new one if it is the first fragment */
+static struct frame_reasm_slot *reasm_slot(struct frame_reasm *r,
+		const struct frame_header *h)
+{
+	struct frame_reasm_slot *s, *oldest = NULL;
+	uint8_t *seen;
+
+	for (int i = 0; i < FRAME_REASM_SLOTS; i++) {
+		s = &r->slots[i];
+		if (s->used && s->header.sequence == h->sequence &&
+				s->header.frag_count == h->frag_count)
+			return s;
+		if (!oldest || !s->used ||
+				(oldest->used && s->stamp < oldest->stamp))
+			oldest = s;
+	}
+
+	s = oldest;
+	if (s->used)
+		r->expired++;
+
+	seen = realloc(s->seen, (h->frag_count + 7) / 8);
+	if (!seen)
+		return NULL;
+	memset(seen, 0, (h->frag_count + 7) / 8);
+	s->seen = seen;
+	s->header = *h;
+	s->received = 0;
+	s->len = 0;
+	s->used = 1;
+	return s;
+}
+
+void frame_reasm_record(void *arg, const struct frame_header *h,
+		const uint8_t *payload)
+{
+	struct frame_reasm *r = arg;
+	struct frame_reasm_slot *s;
+	struct frame_header frame;
+	uint64_t end = (uint64_t)h->frag_offset + h->payload_len;
+	uint8_t *buf;
+
+	if (h->frag_count == 1 && h->frag_offset == 0) {
+		r->fn(r->arg, h, payload);
+		return;
+	}
+	if (h->frag_index >= h->frag_count || end > UINT32_MAX) {
+		r->bad++;
+		return;
+	}
+
+	s = reasm_slot(r, h);
+	if (!s) {
+		r->bad++;
+		return;
+	}
+	s->stamp = ++r->clock;
+
+	if (s->seen[h->frag_index / 8] & (1 << (h->frag_index % 8))) {
+		r->duplicates++;
+		return;
+	}
+
+	if (end > s->size) {
+		buf = realloc(s->payload, end);
+		if (!buf) {
+			r->bad++;
+			return;
+		}
+		s->payload = buf;
+		s->size = end;
+	}
+	memcpy(s->payload + h->frag_offset, payload, h->payload_len);
+	s->seen[h->frag_index / 8] |= 1 << (h->frag_index % 8);
+	s->received++;
+	s->header.flags |= h->flags;
+	if (h->frag_index == h->frag_count - 1)
+		s->len = end;
+
+	if (s->received < h->frag_count)
+		return;
+
+	/* hand the frame on as if it had come whole */
+	frame = s->header;
+	frame.payload_len = s->len;
+	frame.frag_index = 0;
+	frame.frag_count = 1;
+	frame.frag_offset = 0;
+	s->used = 0;
+	r->completed++;
+	r->fn(r->arg, &frame, s->payload);
+}
@@ -0,0 +1,59 @@
+/*
+ * frame_reasm.h
+ *
+ * Host side reassembly of frames the board sent in fragments (see
+ * src/frame_proto.h). Sits between frame_parse_datagram() and the record
+ * callback of a tool: records of whole frames pass straight through, the
+ * fragments of a frame are collected by sequence number and the frame is
+ * handed on once all of them arrived, in any order.
+ */
+
+#ifndef __FRAME_REASM_H_
+#define __FRAME_REASM_H_
+
+#include "frame_parse.h"
+
+/* Frames collected at once, the least recently extended one is given up
+ * to make room for another */
+#define FRAME_REASM_SLOTS	8
+
+struct frame_reasm_slot {
+	int used;
+	/* header of the frame, its flags the union of all fragments' */
+	struct frame_header header;
+	uint8_t *payload;
+	uint32_t size;
+	/* one bit per fragment already received */
+	uint8_t *seen;
+	uint32_t received;
+	/* payload bytes of the frame, known once the last fragment arrived */
+	uint32_t len;
+	uint64_t stamp;
+};
+
+struct frame_reasm {
+	frame_record_fn fn;
+	void *arg;
+	struct frame_reasm_slot slots[FRAME_REASM_SLOTS];
+	uint64_t clock;
+	/* frames completed from fragments */
+	uint64_t completed;
+	/* frames given up with fragments missing */
+	uint64_t expired;
+	uint64_t duplicates;
+	/* fragments with inconsistent indices or offsets */
+	uint64_t bad;
+};
+
+/* Complete frames go to fn with arg, as records parsed from a datagram */
+void frame_reasm_init(struct frame_reasm *r, frame_record_fn fn, void *arg);
+
+/* Give up the frames still incomplete and release the buffers */
+void frame_reasm_free(struct frame_reasm *r);
+
+/* A frame_record_fn, pass it to frame_parse_datagram() with the reassembler
+ * as its argument */
+void frame_reasm_record(void *arg, const struct frame_header *h,
+		const uint8_t *payload);
+
+#endif /* __FRAME_REASM_H_ */
@@ -0,0 +1,108 @@
+/*
+ * histogram.c
+ *
+ * Log-linear histogram, see histogram.h.
+ */
+
+#include <string.h>
+#include "histogram.h"
+
+static unsigned int bucket_of(uint64_t v)
+{
+	unsigned int msb;
+
+	if (v < HIST_LINEAR)
+		return v;
+
+	msb = 63 - __builtin_clzll(v);
+	return HIST_LINEAR + (msb - HIST_LINEAR_BITS) * HIST_SUB +
+			((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+static uint64_t bucket_low(unsigned int b)
+{
+	unsigned int msb, sub;
+
+	if (b < HIST_LINEAR)
+		return b;
+
+	msb = (b - HIST_LINEAR) / HIST_SUB + HIST_LINEAR_BITS;
+	sub = (b - HIST_LINEAR) % HIST_SUB;
+	return ((uint64_t)1 << msb) | ((uint64_t)sub << (msb - HIST_SUB_BITS));
+}
+
+void hist_reset(struct histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+void hist_add(struct histogram *h, uint64_t v)
+{
+	h->count++;
+	h->sum += v;
+	if (v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->buckets[bucket_of(v)]++;
+}
+
+void hist_merge(struct histogram *dst, const struct histogram *src)
+{
+	if (!src->count)
+		return;
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	for (int i = 0; i < HIST_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+}
+
+uint64_t hist_percentile(const struct histogram *h, double p)
+{
+	uint64_t rank, seen = 0;
+
+	if (!h->count)
+		return 0;
+
+	rank = (uint64_t)(p / 100.0 * h->count);
+	if (rank >= h->count)
+		rank = h->count - 1;
+
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > rank)
+			return bucket_low(i) < h->min ? h->min : bucket_low(i);
+	}
+	return h->max;
+}
+
+double hist_mean(const struct histogram *h)
+{
+	return h->count ? (double)h->sum / h->count : 0.0;
+}
+
+void hist_print(FILE *f, const struct histogram *h, const char *unit)
+{
+	uint64_t peak = 0;
+	int bar;
+
+	for (int i = 0; i < HIST_BUCKETS; i++)
+		if (h->buckets[i] > peak)
+			peak = h->buckets[i];
+
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		if (!h->buckets[i])
+			continue;
+		bar = (int)(h->buckets[i] * 50 / peak);
+		fprintf(f, "  >= %10llu %s %12llu |%.*s\n",
+				(unsigned long long)bucket_low(i), unit,
+				(unsigned long long)h->buckets[i], bar,
+				"##################################################");
+	}
+}
@@ -0,0 +1,41 @@
+/*
+ * histogram.h
+ *
+ * Log-linear histogram of non-negative integer samples (useconds in the
+ * tools). Values below HIST_LINEAR land in their own bucket, above that
+ * every power of two is split into HIST_SUB buckets, so the relative error
+ * of a percentile stays below 1/HIST_SUB.
+ */
+
+#ifndef __HISTOGRAM_H_
+#define __HISTOGRAM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIST_LINEAR_BITS	4
+#define HIST_LINEAR		(1 << HIST_LINEAR_BITS)
+#define HIST_SUB_BITS		3
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		(HIST_LINEAR + (64 - HIST_LINEAR_BITS) * HIST_SUB)
+
+struct histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+void hist_reset(struct histogram *h);
+void hist_add(struct histogram *h, uint64_t v);
+void hist_merge(struct histogram *dst, const struct histogram *src);
+
+/* Lower bound of the bucket holding the p-th percentile, 0 <= p <= 100 */
+uint64_t hist_percentile(const struct histogram *h, double p);
+double hist_mean(const struct histogram *h);
+
+/* Print the non-empty buckets with a bar chart, one line each */
+void hist_print(FILE *f, const struct histogram *h, const char *unit);
+
+#endif /* __HISTOGRAM_H_ */
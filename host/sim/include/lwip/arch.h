@@ -0,0 +1,21 @@
+/*
+ * lwip/arch.h
+ *
+ * Basic types of the socket backed lwIP subset.
+ */
+
+#ifndef LWIP_ARCH_H
+#define LWIP_ARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8_t;
+typedef int8_t s8_t;
+typedef uint16_t u16_t;
+typedef int16_t s16_t;
+typedef uint32_t u32_t;
+typedef int32_t s32_t;
+typedef unsigned long long u64_t;
+
+#endif
@@ -0,0 +1,21 @@
+/*
+ * lwip/inet.h
+ *
+ * Address conversion as provided by lwIP.
+ */
+
+#ifndef LWIP_INET_H
+#define LWIP_INET_H
+
+#include <arpa/inet.h>
+#include "lwip/ip_addr.h"
+
+int ip4addr_aton(const char *cp, ip4_addr_t *addr);
+char *ip4addr_ntoa(const ip4_addr_t *addr);
+
+#undef inet_aton
+#undef inet_ntoa
+#define inet_aton(cp, addr)	ip4addr_aton((cp), (ip4_addr_t *)(addr))
+#define inet_ntoa(addr)		ip4addr_ntoa((const ip4_addr_t *)&(addr))
+
+#endif
@@ -0,0 +1,10 @@
+/*
+ * lwip/init.h
+ */
+
+#ifndef LWIP_INIT_H
+#define LWIP_INIT_H
+
+void lwip_init(void);
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * lwip/ip_addr.h
+ *
+ * IPv4 addresses in network byte order, as in lwIP.
+ */
+
+#ifndef LWIP_IP_ADDR_H
+#define LWIP_IP_ADDR_H
+
+#include <arpa/inet.h>
+#include "lwip/arch.h"
+
+typedef struct ip4_addr {
+	u32_t addr;
+} ip4_addr_t;
+
+typedef ip4_addr_t ip_addr_t;
+
+#define ip4_addr1(ipaddr)	(((const u8_t *)(&(ipaddr)->addr))[0])
+#define ip4_addr2(ipaddr)	(((const u8_t *)(&(ipaddr)->addr))[1])
+#define ip4_addr3(ipaddr)	(((const u8_t *)(&(ipaddr)->addr))[2])
+#define ip4_addr4(ipaddr)	(((const u8_t *)(&(ipaddr)->addr))[3])
+
+#define IP4_ADDR(ipaddr, a, b, c, d) \
+	((ipaddr)->addr = htonl(((u32_t)((a) & 0xff) << 24) | \
+			((u32_t)((b) & 0xff) << 16) | \
+			((u32_t)((c) & 0xff) << 8) | (u32_t)((d) & 0xff)))
+#define ip_addr_cmp(addr1, addr2)	((addr1)->addr == (addr2)->addr)
+
+#define ip_2_ip4(ipaddr)	(ipaddr)
+#define ip4_addr_ismulticast(ipaddr) \
+	((((const u8_t *)(&(ipaddr)->addr))[0] & 0xf0) == 0xe0)
+#define ip_addr_ismulticast(ipaddr)	ip4_addr_ismulticast(ipaddr)
+
+extern const ip_addr_t ip_addr_any;
+#define IP_ADDR_ANY		(&ip_addr_any)
+#define IP4_ADDR_ANY		(&ip_addr_any)
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ * lwip/netif.h
+ */
+
+#ifndef LWIP_NETIF_H
+#define LWIP_NETIF_H
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+#define NETIF_FLAG_UP		0x01U
+#define NETIF_FLAG_IGMP		0x20U
+
+struct netif {
+	ip_addr_t ip_addr;
+	ip_addr_t netmask;
+	ip_addr_t gw;
+	u8_t flags;
+};
+
+void netif_set_default(struct netif *netif);
+void netif_set_up(struct netif *netif);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * lwip/pbuf.h
+ *
+ * Subset of the lwIP packet buffer API. PBUF_RAM and PBUF_POOL pbufs are
+ * single heap blocks, PBUF_REF / custom pbufs point to caller memory. The
+ * reference counting and chain semantics match lwIP, so a custom pbuf's
+ * free function runs exactly when lwIP would call it.
+ */
+
+#ifndef LWIP_PBUF_H
+#define LWIP_PBUF_H
+
+#include "lwip/err.h"
+
+/* Room reserved in front of the payload for the protocol headers */
+#define PBUF_TRANSPORT_HLEN	8
+#define PBUF_IP_HLEN		20
+#define PBUF_LINK_HLEN		14
+
+/* Payload size of a PBUF_POOL pbuf, received datagrams use one each */
+#define PBUF_POOL_BUFSIZE	1536
+
+typedef enum {
+	PBUF_TRANSPORT = PBUF_LINK_HLEN + PBUF_IP_HLEN + PBUF_TRANSPORT_HLEN,
+	PBUF_IP = PBUF_LINK_HLEN + PBUF_IP_HLEN,
+	PBUF_LINK = PBUF_LINK_HLEN,
+	PBUF_RAW = 0
+} pbuf_layer;
+
+typedef enum {
+	PBUF_RAM,
+	PBUF_ROM,
+	PBUF_REF,
+	PBUF_POOL
+} pbuf_type;
+
+#define PBUF_FLAG_IS_CUSTOM	0x02U
+
+struct pbuf {
+	struct pbuf *next;
+	void *payload;
+	u16_t tot_len;
+	u16_t len;
+	u8_t type_internal;
+	u8_t flags;
+	u16_t ref;
+};
+
+typedef void (*pbuf_free_custom_fn)(struct pbuf *p);
+
+struct pbuf_custom {
+	struct pbuf pbuf;
+	pbuf_free_custom_fn custom_free_function;
+};
+
+struct pbuf *pbuf_alloc(pbuf_layer l, u16_t length, pbuf_type type);
+struct pbuf *pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type,
+		struct pbuf_custom *p, void *payload_mem, u16_t payload_mem_len);
+u8_t pbuf_free(struct pbuf *p);
+void pbuf_ref(struct pbuf *p);
+void pbuf_cat(struct pbuf *head, struct pbuf *tail);
+void pbuf_chain(struct pbuf *head, struct pbuf *tail);
+u8_t pbuf_clen(const struct pbuf *p);
+err_t pbuf_take(struct pbuf *buf, const void *dataptr, u16_t len);
+err_t pbuf_take_at(struct pbuf *buf, const void *dataptr, u16_t len,
+		u16_t offset);
+u16_t pbuf_copy_partial(const struct pbuf *buf, void *dataptr, u16_t len,
+		u16_t offset);
+u8_t pbuf_add_header(struct pbuf *p, size_t header_size_increment);
+u8_t pbuf_remove_header(struct pbuf *p, size_t header_size);
+
+#endif
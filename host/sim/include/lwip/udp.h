@@ -0,0 +1,45 @@
+/*
+ * lwip/udp.h
+ *
+ * lwIP raw UDP API on top of non-blocking BSD sockets. Received datagrams
+ * are delivered to the recv callback from xemacif_input(), as on the board.
+ */
+
+#ifndef LWIP_UDP_H
+#define LWIP_UDP_H
+
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+#include "lwip/netif.h"
+
+struct udp_pcb;
+
+typedef void (*udp_recv_fn)(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+		const ip_addr_t *addr, u16_t port);
+
+struct udp_pcb {
+	ip_addr_t local_ip;
+	ip_addr_t remote_ip;
+	u16_t local_port;
+	u16_t remote_port;
+	u8_t ttl;
+	u8_t mcast_ttl;
+	u8_t connected;
+	udp_recv_fn recv;
+	void *recv_arg;
+	int sock;
+	struct udp_pcb *next;
+};
+
+struct udp_pcb *udp_new(void);
+void udp_remove(struct udp_pcb *pcb);
+err_t udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port);
+err_t udp_connect(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port);
+void udp_disconnect(struct udp_pcb *pcb);
+void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg);
+err_t udp_send(struct udp_pcb *pcb, struct pbuf *p);
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p,
+		const ip_addr_t *dst_ip, u16_t dst_port);
+void udp_set_multicast_ttl(struct udp_pcb *pcb, u8_t ttl);
+
+#endif
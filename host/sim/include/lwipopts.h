@@ -0,0 +1,14 @@
+/*
+ * lwipopts.h
+ *
+ * Options of the socket backed lwIP subset used on Linux.
+ */
+
+#ifndef LWIPOPTS_H
+#define LWIPOPTS_H
+
+#define LWIP_SUPPORT_CUSTOM_PBUF	1
+#define LWIP_IGMP			1
+#define LWIP_MULTICAST_TX_OPTIONS	1
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ * netif/xadapter.h
+ *
+ * Linux stand-in for the Xilinx lwIP adapter. xemacif_input() polls the
+ * sockets of all UDP pcbs and runs their receive callbacks.
+ */
+
+#ifndef XADAPTER_H
+#define XADAPTER_H
+
+#include "xil_types.h"
+#include "lwip/netif.h"
+
+struct netif *xemac_add(struct netif *netif, ip_addr_t *ipaddr,
+		ip_addr_t *netmask, ip_addr_t *gw, unsigned char *mac_ethernet_address,
+		UINTPTR mac_baseaddr);
+int xemacif_input(struct netif *netif);
+
+#endif
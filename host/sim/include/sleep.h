@@ -0,0 +1,12 @@
+/*
+ * sleep.h
+ *
+ * Linux stand-in for the BSP sleep functions.
+ */
+
+#ifndef SLEEP_H
+#define SLEEP_H
+
+#include <unistd.h>
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * xil_cache.h
+ *
+ * Linux stand-in, caches are coherent so maintenance is a no-op.
+ */
+
+#ifndef XIL_CACHE_H
+#define XIL_CACHE_H
+
+#include "xil_types.h"
+
+#define Xil_DCacheFlushRange(addr, len)		((void)(addr), (void)(len))
+#define Xil_DCacheInvalidateRange(addr, len)	((void)(addr), (void)(len))
+#define Xil_DCacheDisable()			((void)0)
+#define Xil_ICacheDisable()			((void)0)
+
+#endif
@@ -0,0 +1,16 @@
+/*
+ * xil_printf.h
+ *
+ * Linux stand-in, the console goes to stdout.
+ */
+
+#ifndef XIL_PRINTF_H
+#define XIL_PRINTF_H
+
+#include <stdio.h>
+#include "xil_types.h"
+
+#define xil_printf	printf
+#define print(s)	fputs((s), stdout)
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * xil_types.h
+ *
+ * Linux stand-in for the standalone BSP type definitions.
+ */
+
+#ifndef XIL_TYPES_H
+#define XIL_TYPES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+typedef uintptr_t UINTPTR;
+
+#define XST_SUCCESS	0
+#define XST_FAILURE	1
+
+#endif
@@ -0,0 +1,5 @@
+/*
+ * xlwipconfig.h
+ *
+ * Linux stand-in, nothing to configure.
+ */
@@ -0,0 +1,14 @@
+/*
+ * xparameters.h
+ *
+ * Linux stand-in, only what the hardware independent code refers to.
+ */
+
+#ifndef XPARAMETERS_H
+#define XPARAMETERS_H
+
+#include "xil_types.h"
+
+#define XPAR_XEMACPS_0_BASEADDR	0
+
+#endif
@@ -0,0 +1,545 @@
+/*
+ * lwip_sock.c
+ *
+ * The subset of the lwIP raw API used by the firmware, implemented on top
+ * of non-blocking BSD sockets so the firmware's network code runs unchanged
+ * on Linux. udp_send() reports ERR_MEM when the socket buffer is full, the
+ * way the board reports a full EMAC TX ring. SIM_TX_BUSY=<percent> in the
+ * environment refuses that share of the sends with ERR_MEM as well, to
+ * exercise the firmware's handling of a stalled TX path. Sockets raise
+ * SIGIO when a datagram arrives, which posts EVENT_NET like the EMAC
+ * interrupt does.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "lwip/init.h"
+#include "lwip/inet.h"
+#include "lwip/udp.h"
+#include "netif/xadapter.h"
+#include "event_loop.h"
+
+/* lwIP hands out local ports from the IANA dynamic range in order, the
+ * host tools rely on the board's data pcb getting the first one */
+#define UDP_LOCAL_PORT_RANGE_START	0xc000
+#define UDP_LOCAL_PORT_RANGE_END	0xffff
+
+/* Datagrams handed to the recv callbacks per xemacif_input() call */
+#define INPUT_BUDGET			32
+
+/* Max pbufs in a chain sent with one sendmsg() */
+#define SEND_IOV_MAX			64
+
+const ip_addr_t ip_addr_any = { 0 };
+
+static struct udp_pcb *udp_pcbs;
+/* pcb xemacif_input() reads and the one after it, udp_remove() from a recv
+ * callback moves them on */
+static struct udp_pcb *input_pcb, *input_next;
+static u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
+static int udp_tx_busy;
+
+/* A datagram arrived, what the EMAC interrupt posts on the board */
+static void sock_io_handler(int sig)
+{
+	(void)sig;
+	event_post(EVENT_NET);
+}
+
+void lwip_init(void)
+{
+	const char *busy = getenv("SIM_TX_BUSY");
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sock_io_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGIO, &sa, NULL);
+
+	udp_tx_busy = busy ? atoi(busy) : 0;
+}
+
+/* ------------------------------------------------------------ pbufs --- */
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+	struct pbuf *p;
+	size_t offset = layer;
+
+	switch (type) {
+	case PBUF_RAM:
+	case PBUF_POOL:
+		p = malloc(sizeof(*p) + offset + length);
+		if (!p)
+			return NULL;
+		p->payload = (u8_t *)(p + 1) + offset;
+		break;
+	case PBUF_ROM:
+	case PBUF_REF:
+		p = malloc(sizeof(*p));
+		if (!p)
+			return NULL;
+		p->payload = NULL;
+		break;
+	default:
+		return NULL;
+	}
+
+	p->next = NULL;
+	p->tot_len = length;
+	p->len = length;
+	p->type_internal = type;
+	p->flags = 0;
+	p->ref = 1;
+	return p;
+}
+
+struct pbuf *pbuf_alloced_custom(pbuf_layer layer, u16_t length,
+		pbuf_type type, struct pbuf_custom *p, void *payload_mem,
+		u16_t payload_mem_len)
+{
+	size_t offset = layer;
+
+	if (offset + length > payload_mem_len)
+		return NULL;
+
+	p->pbuf.next = NULL;
+	p->pbuf.payload = payload_mem ? (u8_t *)payload_mem + offset : NULL;
+	p->pbuf.tot_len = length;
+	p->pbuf.len = length;
+	p->pbuf.type_internal = type;
+	p->pbuf.flags = PBUF_FLAG_IS_CUSTOM;
+	p->pbuf.ref = 1;
+	return &p->pbuf;
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+	struct pbuf *next;
+	u8_t count = 0;
+
+	while (p) {
+		if (--p->ref > 0)
+			break;
+
+		next = p->next;
+		if (p->flags & PBUF_FLAG_IS_CUSTOM)
+			((struct pbuf_custom *)p)->custom_free_function(p);
+		else
+			free(p);
+		count++;
+		p = next;
+	}
+
+	return count;
+}
+
+void pbuf_ref(struct pbuf *p)
+{
+	if (p)
+		p->ref++;
+}
+
+void pbuf_cat(struct pbuf *head, struct pbuf *tail)
+{
+	struct pbuf *p;
+
+	for (p = head; p->next; p = p->next)
+		p->tot_len += tail->tot_len;
+	p->tot_len += tail->tot_len;
+	p->next = tail;
+}
+
+void pbuf_chain(struct pbuf *head, struct pbuf *tail)
+{
+	pbuf_cat(head, tail);
+	pbuf_ref(tail);
+}
+
+u8_t pbuf_clen(const struct pbuf *p)
+{
+	u8_t len = 0;
+
+	for (; p; p = p->next)
+		len++;
+	return len;
+}
+
+err_t pbuf_take_at(struct pbuf *buf, const void *dataptr, u16_t len,
+		u16_t offset)
+{
+	const u8_t *src = dataptr;
+	struct pbuf *p;
+	u16_t n;
+
+	if (!buf || (u32_t)offset + len > buf->tot_len)
+		return ERR_ARG;
+
+	for (p = buf; p && len; p = p->next) {
+		if (offset >= p->len) {
+			offset -= p->len;
+			continue;
+		}
+		n = p->len - offset;
+		if (n > len)
+			n = len;
+		memcpy((u8_t *)p->payload + offset, src, n);
+		src += n;
+		len -= n;
+		offset = 0;
+	}
+
+	return ERR_OK;
+}
+
+err_t pbuf_take(struct pbuf *buf, const void *dataptr, u16_t len)
+{
+	return pbuf_take_at(buf, dataptr, len, 0);
+}
+
+u16_t pbuf_copy_partial(const struct pbuf *buf, void *dataptr, u16_t len,
+		u16_t offset)
+{
+	const struct pbuf *p;
+	u8_t *dst = dataptr;
+	u16_t copied = 0, n;
+
+	for (p = buf; p && len; p = p->next) {
+		if (offset >= p->len) {
+			offset -= p->len;
+			continue;
+		}
+		n = p->len - offset;
+		if (n > len)
+			n = len;
+		memcpy(dst + copied, (const u8_t *)p->payload + offset, n);
+		copied += n;
+		len -= n;
+		offset = 0;
+	}
+
+	return copied;
+}
+
+/* Only heap pbufs have headroom here, which is all the firmware uses */
+u8_t pbuf_add_header(struct pbuf *p, size_t header_size_increment)
+{
+	u8_t *payload;
+
+	if (p->type_internal != PBUF_RAM && p->type_internal != PBUF_POOL)
+		return 1;
+
+	payload = (u8_t *)p->payload - header_size_increment;
+	if (payload < (u8_t *)(p + 1))
+		return 1;
+
+	p->payload = payload;
+	p->len += header_size_increment;
+	p->tot_len += header_size_increment;
+	return 0;
+}
+
+u8_t pbuf_remove_header(struct pbuf *p, size_t header_size)
+{
+	if (header_size > p->len)
+		return 1;
+
+	p->payload = (u8_t *)p->payload + header_size;
+	p->len -= header_size;
+	p->tot_len -= header_size;
+	return 0;
+}
+
+/* -------------------------------------------------------- addresses --- */
+
+int ip4addr_aton(const char *cp, ip4_addr_t *addr)
+{
+	struct in_addr in;
+
+	if (inet_pton(AF_INET, cp, &in) != 1)
+		return 0;
+	if (addr)
+		addr->addr = in.s_addr;
+	return 1;
+}
+
+char *ip4addr_ntoa(const ip4_addr_t *addr)
+{
+	static char str[INET_ADDRSTRLEN];
+	struct in_addr in = { addr->addr };
+
+	return (char *)inet_ntop(AF_INET, &in, str, sizeof(str));
+}
+
+/* ------------------------------------------------------------- netif --- */
+
+struct netif *xemac_add(struct netif *netif, ip_addr_t *ipaddr,
+		ip_addr_t *netmask, ip_addr_t *gw, unsigned char *mac_ethernet_address,
+		UINTPTR mac_baseaddr)
+{
+	(void)mac_ethernet_address;
+	(void)mac_baseaddr;
+
+	memset(netif, 0, sizeof(*netif));
+	if (ipaddr)
+		netif->ip_addr = *ipaddr;
+	if (netmask)
+		netif->netmask = *netmask;
+	if (gw)
+		netif->gw = *gw;
+	return netif;
+}
+
+void netif_set_default(struct netif *netif)
+{
+	(void)netif;
+}
+
+void netif_set_up(struct netif *netif)
+{
+	netif->flags |= NETIF_FLAG_UP;
+}
+
+int xemacif_input(struct netif *netif)
+{
+	struct udp_pcb *pcb;
+	struct sockaddr_in from;
+	socklen_t from_len;
+	struct pbuf *p;
+	ip_addr_t addr;
+	ssize_t len;
+	int count = 0;
+
+	(void)netif;
+
+	for (input_pcb = udp_pcbs; input_pcb && count < INPUT_BUDGET;
+			input_pcb = input_next) {
+		input_next = input_pcb->next;
+
+		/* drain the socket, the callback may remove the pcb */
+		while (input_pcb && input_pcb->recv && count < INPUT_BUDGET) {
+			pcb = input_pcb;
+
+			/* a pool pbuf, like the board's RX path hands to lwIP */
+			p = pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE, PBUF_POOL);
+			if (!p)
+				break;
+
+			from_len = sizeof(from);
+			len = recvfrom(pcb->sock, p->payload, PBUF_POOL_BUFSIZE,
+					0, (struct sockaddr *)&from, &from_len);
+			if (len < 0) {
+				pbuf_free(p);
+				break;
+			}
+
+			p->len = p->tot_len = len;
+			addr.addr = from.sin_addr.s_addr;
+			pcb->recv(pcb->recv_arg, pcb, p, &addr,
+					ntohs(from.sin_port));
+			count++;
+		}
+	}
+	input_pcb = NULL;
+
+	return count;
+}
+
+/* --------------------------------------------------------------- udp --- */
+
+struct udp_pcb *udp_new(void)
+{
+	struct udp_pcb *pcb;
+
+	pcb = calloc(1, sizeof(*pcb));
+	if (!pcb)
+		return NULL;
+
+	pcb->sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (pcb->sock < 0) {
+		free(pcb);
+		return NULL;
+	}
+	/* SIGIO on every datagram received */
+	fcntl(pcb->sock, F_SETOWN, getpid());
+	fcntl(pcb->sock, F_SETFL, fcntl(pcb->sock, F_GETFL) | O_NONBLOCK |
+			O_ASYNC);
+
+	pcb->ttl = 255;
+	pcb->mcast_ttl = 1;
+	pcb->next = udp_pcbs;
+	udp_pcbs = pcb;
+	return pcb;
+}
+
+void udp_remove(struct udp_pcb *pcb)
+{
+	struct udp_pcb **pp;
+
+	for (pp = &udp_pcbs; *pp; pp = &(*pp)->next) {
+		if (*pp == pcb) {
+			*pp = pcb->next;
+			break;
+		}
+	}
+	if (pcb == input_pcb)
+		input_pcb = NULL;
+	if (pcb == input_next)
+		input_next = pcb->next;
+
+	close(pcb->sock);
+	free(pcb);
+}
+
+err_t udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
+{
+	struct sockaddr_in local;
+	socklen_t len = sizeof(local);
+	int on = 1;
+
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = ipaddr ? ipaddr->addr : INADDR_ANY;
+
+	setsockopt(pcb->sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if (port) {
+		local.sin_port = htons(port);
+		if (bind(pcb->sock, (struct sockaddr *)&local, sizeof(local)) < 0)
+			return ERR_USE;
+	} else {
+		/* next free port of the dynamic range, as lwIP does */
+		for (;;) {
+			local.sin_port = htons(udp_port);
+			if (udp_port++ == UDP_LOCAL_PORT_RANGE_END)
+				udp_port = UDP_LOCAL_PORT_RANGE_START;
+			if (!bind(pcb->sock, (struct sockaddr *)&local,
+					sizeof(local)))
+				break;
+			if (errno != EADDRINUSE)
+				return ERR_USE;
+		}
+	}
+
+	getsockname(pcb->sock, (struct sockaddr *)&local, &len);
+	pcb->local_ip.addr = local.sin_addr.s_addr;
+	pcb->local_port = ntohs(local.sin_port);
+	return ERR_OK;
+}
+
+err_t udp_connect(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
+{
+	struct sockaddr_in remote;
+	err_t err;
+
+	if (!pcb->local_port) {
+		err = udp_bind(pcb, &pcb->local_ip, 0);
+		if (err != ERR_OK)
+			return err;
+	}
+
+	memset(&remote, 0, sizeof(remote));
+	remote.sin_family = AF_INET;
+	remote.sin_addr.s_addr = ipaddr->addr;
+	remote.sin_port = htons(port);
+	if (connect(pcb->sock, (struct sockaddr *)&remote, sizeof(remote)) < 0)
+		return ERR_RTE;
+
+	pcb->remote_ip = *ipaddr;
+	pcb->remote_port = port;
+	pcb->connected = 1;
+	return ERR_OK;
+}
+
+void udp_disconnect(struct udp_pcb *pcb)
+{
+	struct sockaddr unspec = { .sa_family = AF_UNSPEC };
+
+	connect(pcb->sock, &unspec, sizeof(unspec));
+	pcb->remote_ip.addr = 0;
+	pcb->remote_port = 0;
+	pcb->connected = 0;
+}
+
+void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg)
+{
+	pcb->recv = recv;
+	pcb->recv_arg = recv_arg;
+}
+
+static err_t udp_send_msg(struct udp_pcb *pcb, struct pbuf *p,
+		const struct sockaddr_in *dst)
+{
+	struct iovec iov[SEND_IOV_MAX];
+	struct msghdr msg;
+	int n = 0;
+
+	if (!pcb->local_port && udp_bind(pcb, &pcb->local_ip, 0) != ERR_OK)
+		return ERR_USE;
+
+	if (udp_tx_busy && rand() % 100 < udp_tx_busy)
+		return ERR_MEM;
+
+	for (; p && n < SEND_IOV_MAX; p = p->next) {
+		if (!p->len)
+			continue;
+		iov[n].iov_base = p->payload;
+		iov[n].iov_len = p->len;
+		n++;
+	}
+	if (p)
+		return ERR_VAL;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = (void *)dst;
+	msg.msg_namelen = dst ? sizeof(*dst) : 0;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = n;
+
+	if (sendmsg(pcb->sock, &msg, 0) < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+			return ERR_MEM;
+		if (errno == ECONNREFUSED)
+			/* ICMP port unreachable from an earlier datagram */
+			return ERR_OK;
+		return ERR_RTE;
+	}
+
+	return ERR_OK;
+}
+
+err_t udp_send(struct udp_pcb *pcb, struct pbuf *p)
+{
+	if (!pcb->connected)
+		return ERR_RTE;
+
+	return udp_send_msg(pcb, p, NULL);
+}
+
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p,
+		const ip_addr_t *dst_ip, u16_t dst_port)
+{
+	struct sockaddr_in dst;
+
+	memset(&dst, 0, sizeof(dst));
+	dst.sin_family = AF_INET;
+	dst.sin_addr.s_addr = dst_ip->addr;
+	dst.sin_port = htons(dst_port);
+
+	return udp_send_msg(pcb, p, &dst);
+}
+
+void udp_set_multicast_ttl(struct udp_pcb *pcb, u8_t ttl)
+{
+	int v = ttl;
+
+	setsockopt(pcb->sock, IPPROTO_IP, IP_MULTICAST_TTL, &v, sizeof(v));
+	pcb->mcast_ttl = ttl;
+}
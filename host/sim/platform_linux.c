@@ -0,0 +1,331 @@
+/*
+ * platform_linux.c
+ *
+ * Linux implementation of platform.h, runs the firmware's frame ring and
+ * UDP send path as a normal process. A POSIX interval timer plays the part
+ * of the EOC / EOS GPIO interrupts: its signal handler feeds the pixels that
+ * are due at the configured rate through acq_pixel(), the same code the
+ * board runs from the EOC interrupt. The same timer posts the main loop's
+ * tick, and the loop sleeps in sigsuspend() where the board executes WFI.
+ *
+ * Configuration is read from the environment:
+ *   SIM_PIXEL_RATE    pixels per second (default 1000000)
+ *   SIM_FRAME_PIXELS  pixels per frame, EOS after the last one (BUFFER_SIZE)
+ *   SIM_DURATION      seconds to run after the first start, 0 runs forever
+ *   SIM_AUTOSTART     start capturing without waiting for "start"
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "xil_types.h"
+#include "platform.h"
+#include "frame_ring.h"
+#include "acquisition.h"
+#include "xil_printf.h"
+#include "event_loop.h"
+
+/* Interval of the simulated interrupt, in useconds */
+#define SIM_TICK_US		100
+
+/* Most pixels generated per tick, bounds the handler after a stall */
+#define SIM_TICK_MAX_PIXELS	(1 << 20)
+
+/* Rounds of platform_mem_bench() */
+#define MEM_BENCH_RUNS		64
+
+
+static double sim_pixel_rate = 1e6;
+static u32 sim_frame_pixels = BUFFER_SIZE;
+static u64 sim_duration_us;
+static int sim_autostart;
+
+static u64 sim_start_us;
+static u64 sim_end_us;
+static volatile u64 sim_pixels_due;
+static u64 sim_pixels;
+static u32 sim_frame;
+static timer_t sim_timer;
+static u32 sim_ticks;
+static volatile u32 sim_bench_entry;
+
+struct platform_irq_stats platform_irq_stats;
+
+static double env_double(const char *name, double def)
+{
+	const char *val = getenv(name);
+
+	return val && *val ? strtod(val, NULL) : def;
+}
+
+/* Gradient across the frame drifting by one step every 16 frames, plus
+ * -1..2 of noise, about as correlated as the real sensor's frames */
+static u8 sim_pixel_value(u32 index)
+{
+	return (u8)(index / 4 + sim_frame / 16) +
+			(u8)((u32)(sim_pixels * 2654435761u) >> 30) - 1;
+}
+
+/* The simulated EOC / EOS interrupts */
+static void sim_timer_handler(int sig)
+{
+	u64 due, n;
+	int index;
+
+	(void)sig;
+
+	if (++sim_ticks == EVENT_TICK_MS * 1000 / SIM_TICK_US) {
+		sim_ticks = 0;
+		event_post(EVENT_TICK);
+	}
+	if (!is_measurement_time)
+		return;
+
+	due = (u64)((get_time_us() - sim_start_us) * sim_pixel_rate / 1000000.0);
+	if (due <= sim_pixels_due)
+		return;
+	n = due - sim_pixels_due;
+	if (n > SIM_TICK_MAX_PIXELS)
+		n = SIM_TICK_MAX_PIXELS;
+	sim_pixels_due = due;
+
+	while (n--) {
+		platform_irq_stats.eoc++;
+		index = acq_pixel(sim_pixel_value(sim_pixels % sim_frame_pixels));
+		sim_pixels++;
+		if ((u32)index + 1 == sim_frame_pixels) {
+			platform_irq_stats.eos++;
+			acq_end_of_frame();
+			sim_frame++;
+		}
+	}
+}
+
+static void sim_report(void)
+{
+	xil_printf("sim: %llu pixels, %u frames captured, %u dropped, "
+			"%u pixels overrun, queue high water %u\r\n",
+			(unsigned long long)sim_pixels,
+			frame_ring_stats.frames_captured,
+			frame_ring_stats.frames_dropped,
+			frame_ring_stats.pixels_overrun,
+			frame_ring_stats.queue_high_water);
+}
+
+static void sim_bench_handler(int sig)
+{
+	(void)sig;
+	sim_bench_entry = get_cycles();
+}
+
+/* Mean nanoseconds from raising a signal to its handler running */
+static u32 sim_bench_irq(void)
+{
+	u32 start, sum = 0;
+
+	for (int i = 0; i < MEM_BENCH_RUNS; i++) {
+		sim_bench_entry = 0;
+		start = get_cycles();
+		raise(SIGUSR2);
+		while (!sim_bench_entry)
+			;
+		sum += sim_bench_entry - start;
+	}
+	return sum / MEM_BENCH_RUNS;
+}
+
+/* The host has one memory layout and no cache maintenance to measure, the
+ * cold interrupt is the warm one, as a process cannot clean its caches */
+int platform_mem_bench(struct platform_mem_bench *r)
+{
+	u8 *frame = frame_ring_discard();
+	u32 size = acq_frame_pixels(), start, sum = 0;
+	struct sigaction sa, old;
+
+	if (is_measurement_time || !frame)
+		return -1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sim_bench_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR2, &sa, &old);
+	r->irq_warm = r->irq_cold = sim_bench_irq();
+	sigaction(SIGUSR2, &old, NULL);
+
+	r->frame_maint = 0;
+	r->frame_read = 0;
+	for (int i = 0; i < MEM_BENCH_RUNS; i++) {
+		memset(frame, i, size);
+		start = get_cycles();
+		for (u32 j = 0; j + 4 <= size; j += 4)
+			sum += *(volatile u32 *)(frame + j);
+		r->frame_read += get_cycles() - start;
+	}
+	r->frame_read /= MEM_BENCH_RUNS;
+	(void)sum;
+	return 0;
+}
+
+void init_platform()
+{
+	/* behave like the UART console when redirected to a file */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	sim_pixel_rate = env_double("SIM_PIXEL_RATE", sim_pixel_rate);
+	sim_frame_pixels = env_double("SIM_FRAME_PIXELS", sim_frame_pixels);
+	sim_duration_us = env_double("SIM_DURATION", 0) * 1000000.0;
+	sim_autostart = env_double("SIM_AUTOSTART", 0) != 0;
+
+	if (sim_pixel_rate <= 0 || !sim_frame_pixels) {
+		xil_printf("sim: invalid SIM_PIXEL_RATE / SIM_FRAME_PIXELS\r\n");
+		exit(1);
+	}
+
+	frame_ring_init();
+	acq_init();
+	atexit(sim_report);
+	xil_printf("sim: %.0f pixels/s, %u pixels/frame\r\n", sim_pixel_rate,
+			sim_frame_pixels);
+
+	platform_setup_timer();
+}
+
+void cleanup_platform()
+{
+	timer_delete(sim_timer);
+}
+
+void platform_setup_timer()
+{
+	struct sigevent sev;
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sim_timer_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGALRM, &sa, NULL);
+
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = SIGALRM;
+	if (timer_create(CLOCK_MONOTONIC, &sev, &sim_timer)) {
+		perror("sim: timer_create");
+		exit(1);
+	}
+}
+
+void platform_enable_interrupts()
+{
+	struct itimerspec its = {
+		.it_interval = { 0, SIM_TICK_US * 1000 },
+		.it_value = { 0, SIM_TICK_US * 1000 },
+	};
+
+	timer_settime(sim_timer, 0, &its, NULL);
+
+	if (sim_autostart)
+		start_stop_measurements(1);
+}
+
+void platform_setup_dma()
+{
+}
+
+void read_data_from_d_out()
+{
+}
+
+void start_stop_measurements(int start)
+{
+	sigset_t set, old;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigprocmask(SIG_BLOCK, &set, &old);
+
+	if (start) {
+		acq_reset();
+		/* pixels are due from now on, nothing accumulated while stopped */
+		sim_start_us = get_time_us();
+		sim_pixels_due = 0;
+		if (!sim_end_us && sim_duration_us)
+			sim_end_us = sim_start_us + sim_duration_us;
+		is_measurement_time = 1;
+	} else {
+		is_measurement_time = 0;
+	}
+
+	sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+void platform_acq_poll()
+{
+	if (sim_end_us && get_time_us() >= sim_end_us) {
+		is_measurement_time = 0;
+		/* let the send path drain what is still queued */
+		if (!frame_ring_pending())
+			exit(0);
+	}
+}
+
+/* No DMA, the simulated interrupts write through acq_pixel() */
+int platform_acq_quiesce()
+{
+	return 0;
+}
+
+u64 get_time_ms()
+{
+	return get_time_us() / 1000;
+}
+
+u64 get_time_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* The SIM_TICK_US interrupt ends every sleep, the main loop sees the time
+ * pass without a timer of its own */
+void platform_wake_at(u64 time_us)
+{
+}
+
+/* Nanoseconds stand in for CPU cycles */
+u32 get_cycles()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u32)((u64)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+u32 get_cycles_per_us()
+{
+	return 1000;
+}
+
+/* sigsuspend() is WFI, the signals of the simulated interrupts and of the
+ * sockets (lwip_sock.c) end it */
+u32 platform_sleep()
+{
+	sigset_t set, old;
+	u32 start, slept = 0;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigaddset(&set, SIGIO);
+	sigprocmask(SIG_BLOCK, &set, &old);
+	if (!event_pending()) {
+		start = get_cycles();
+		sigsuspend(&old);
+		slept = get_cycles() - start;
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return slept;
+}
@@ -0,0 +1,611 @@
+/*
+ * stream_bench.c
+ *
+ * Throughput, loss, jitter and latency benchmark of the sensor stream.
+ *
+ * rx   - bind the data port, send "start" to the board, receive the stream
+ *        and report throughput, frame loss, datagram inter-arrival and
+ *        frame latency histograms periodically and at the end. Frames sent
+ *        in fragments count once reassembled. "finish" is sent on exit.
+ * emu  - emulate the board: wait for "start" on the board port and stream
+ *        frames in the board's wire format at a fixed rate until "finish".
+ * loop - run emu in a thread and rx against it over loopback, so the tool
+ *        can benchmark itself without hardware.
+ *
+ * Latency is measured relative to the fastest frame because the board
+ * timestamps with its own clock. In loop mode both ends share the host
+ * clock, so the reported minimum offset is the absolute minimum latency.
+ */
+
+#define _GNU_SOURCE	/* recvmmsg */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "frame_parse.h"
+#include "frame_reasm.h"
+#include "histogram.h"
+
+#define DEFAULT_BOARD_IP	"192.168.1.11"
+/* UDP_CONN_PORT of the firmware */
+#define DEFAULT_PORT		50000
+/* first ephemeral port lwIP hands out, used by the board's data pcb */
+#define DEFAULT_BOARD_PORT	49152
+
+#define RX_BATCH		64
+#define MAX_DATAGRAM		65536
+
+enum bench_mode {
+	MODE_RX,
+	MODE_EMU,
+	MODE_LOOP
+};
+
+struct bench_opts {
+	enum bench_mode mode;
+	const char *board_ip;
+	/* multicast group the board streams to, NULL for unicast */
+	const char *group;
+	int port;
+	int board_port;
+	double interval;
+	double duration;
+	int rcvbuf;
+	/* emulator */
+	double fps;
+	int pixels;
+	int batch;
+};
+
+struct rx_stats {
+	uint64_t bytes;
+	uint64_t datagrams;
+	uint64_t frames;
+	uint64_t lost;
+	uint64_t bad;
+	struct histogram arrival;
+	struct histogram latency;
+};
+
+struct rx_ctx {
+	struct frame_tracker tracker;
+	struct frame_reasm reasm;
+	struct rx_stats cur;
+	struct rx_stats total;
+	uint64_t recv_us;
+	uint64_t last_recv_us;
+	int last_seen;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/* Board and host timestamps use the wall clock, which the kernel also uses
+ * for SO_TIMESTAMPNS receive timestamps. */
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static double mono_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_socket(int port, int rcvbuf)
+{
+	struct sockaddr_in local;
+	int sock, on = 1;
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (rcvbuf)
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(port);
+	if (bind(sock, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		perror("bind");
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+/* Receive the datagrams sent to group as well, other receivers on this
+ * host share the port thanks to SO_REUSEADDR */
+static int join_group(int sock, const char *group)
+{
+	struct ip_mreq mreq;
+
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (inet_pton(AF_INET, group, &mreq.imr_multiaddr) != 1) {
+		fprintf(stderr, "invalid multicast group %s\n", group);
+		return -1;
+	}
+	if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+			sizeof(mreq)) < 0) {
+		perror("IP_ADD_MEMBERSHIP");
+		return -1;
+	}
+	return 0;
+}
+
+static void set_timeout(int sock, long usec)
+{
+	struct timeval tv = { usec / 1000000, usec % 1000000 };
+
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static int send_command(int sock, const struct sockaddr_in *board,
+		const char *cmd)
+{
+	/* the board's command parser expects the terminating NUL */
+	return sendto(sock, cmd, strlen(cmd) + 1, 0,
+			(const struct sockaddr *)board, sizeof(*board));
+}
+
+/* ---------------------------------------------------------------- rx --- */
+
+static void stats_reset(struct rx_stats *s)
+{
+	s->bytes = 0;
+	s->datagrams = 0;
+	s->frames = 0;
+	s->lost = 0;
+	s->bad = 0;
+	hist_reset(&s->arrival);
+	hist_reset(&s->latency);
+}
+
+static void stats_merge(struct rx_stats *dst, const struct rx_stats *src)
+{
+	dst->bytes += src->bytes;
+	dst->datagrams += src->datagrams;
+	dst->frames += src->frames;
+	dst->lost += src->lost;
+	dst->bad += src->bad;
+	hist_merge(&dst->arrival, &src->arrival);
+	hist_merge(&dst->latency, &src->latency);
+}
+
+static void on_frame(void *arg, const struct frame_header *h,
+		const uint8_t *payload)
+{
+	struct rx_ctx *ctx = arg;
+	uint64_t lost = ctx->tracker.lost;
+	int64_t latency;
+
+	(void)payload;
+	latency = frame_tracker_update(&ctx->tracker, h, ctx->recv_us);
+	ctx->cur.frames++;
+	/* a late frame decrements the tracker's loss count again */
+	ctx->cur.lost += ctx->tracker.lost - lost;
+	hist_add(&ctx->cur.latency, latency);
+	if (h->flags & FRAME_FLAG_LAST)
+		stop = 1;
+}
+
+static void on_datagram(struct rx_ctx *ctx, const uint8_t *buf, size_t len,
+		uint64_t recv_us)
+{
+	ctx->recv_us = recv_us;
+	if (ctx->last_seen && recv_us >= ctx->last_recv_us)
+		hist_add(&ctx->cur.arrival, recv_us - ctx->last_recv_us);
+	ctx->last_recv_us = recv_us;
+	ctx->last_seen = 1;
+
+	ctx->cur.datagrams++;
+	ctx->cur.bytes += len;
+	if (frame_parse_datagram(buf, len, frame_reasm_record, &ctx->reasm) < 0)
+		ctx->cur.bad++;
+}
+
+static void print_line(const char *label, double t0, double t1,
+		const struct rx_stats *s)
+{
+	double dt = t1 - t0;
+	uint64_t sent = s->frames + s->lost;
+
+	if (dt <= 0)
+		dt = 1e-9;
+
+	printf("%-6s %6.1f-%6.1f s %9.2f Mbit/s %9.0f dgram/s %9.0f frame/s "
+			"lost %llu (%.3f%%)  gap p50/p99/max %llu/%llu/%llu us  "
+			"lat p50/p99/max %llu/%llu/%llu us\n",
+			label, t0, t1, s->bytes * 8 / dt / 1e6,
+			s->datagrams / dt, s->frames / dt,
+			(unsigned long long)s->lost,
+			sent ? 100.0 * s->lost / sent : 0.0,
+			(unsigned long long)hist_percentile(&s->arrival, 50),
+			(unsigned long long)hist_percentile(&s->arrival, 99),
+			(unsigned long long)s->arrival.max,
+			(unsigned long long)hist_percentile(&s->latency, 50),
+			(unsigned long long)hist_percentile(&s->latency, 99),
+			(unsigned long long)s->latency.max);
+	fflush(stdout);
+}
+
+static void print_final(const struct rx_ctx *ctx, double duration)
+{
+	const struct rx_stats *s = &ctx->total;
+	double dpf = s->frames ? (double)s->datagrams / s->frames : 1.0;
+
+	print_line("total", 0, duration, s);
+	printf("\n%llu datagrams (%llu malformed), %llu bytes, %llu frames\n",
+			(unsigned long long)s->datagrams,
+			(unsigned long long)s->bad,
+			(unsigned long long)s->bytes,
+			(unsigned long long)s->frames);
+	printf("frames lost %llu, reordered %llu, duplicates %llu, "
+			"overruns %llu, datagrams lost ~%.0f\n",
+			(unsigned long long)ctx->tracker.lost,
+			(unsigned long long)ctx->tracker.reordered,
+			(unsigned long long)ctx->tracker.duplicates,
+			(unsigned long long)ctx->tracker.overruns,
+			ctx->tracker.lost * dpf);
+	if (ctx->reasm.completed || ctx->reasm.expired)
+		printf("frames reassembled %llu, incomplete %llu, "
+				"duplicate fragments %llu\n",
+				(unsigned long long)ctx->reasm.completed,
+				(unsigned long long)ctx->reasm.expired,
+				(unsigned long long)ctx->reasm.duplicates);
+	if (ctx->tracker.frames)
+		printf("min offset receive - capture: %lld us\n",
+				(long long)ctx->tracker.offset_us);
+
+	printf("\ninter-arrival [us] min %llu avg %.1f p50 %llu p90 %llu "
+			"p99 %llu p99.9 %llu max %llu\n",
+			(unsigned long long)(s->arrival.count ? s->arrival.min : 0),
+			hist_mean(&s->arrival),
+			(unsigned long long)hist_percentile(&s->arrival, 50),
+			(unsigned long long)hist_percentile(&s->arrival, 90),
+			(unsigned long long)hist_percentile(&s->arrival, 99),
+			(unsigned long long)hist_percentile(&s->arrival, 99.9),
+			(unsigned long long)s->arrival.max);
+	hist_print(stdout, &s->arrival, "us");
+
+	printf("\nlatency [us, relative] min %llu avg %.1f p50 %llu p90 %llu "
+			"p99 %llu p99.9 %llu max %llu\n",
+			(unsigned long long)(s->latency.count ? s->latency.min : 0),
+			hist_mean(&s->latency),
+			(unsigned long long)hist_percentile(&s->latency, 50),
+			(unsigned long long)hist_percentile(&s->latency, 90),
+			(unsigned long long)hist_percentile(&s->latency, 99),
+			(unsigned long long)hist_percentile(&s->latency, 99.9),
+			(unsigned long long)s->latency.max);
+	hist_print(stdout, &s->latency, "us");
+}
+
+static uint64_t msg_timestamp(struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+	struct timespec ts;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+				cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+		}
+	}
+	return now_us();
+}
+
+static int run_rx(const struct bench_opts *o)
+{
+	static uint8_t bufs[RX_BATCH][MAX_DATAGRAM];
+	static char ctrl[RX_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+	struct mmsghdr msgs[RX_BATCH];
+	struct iovec iovs[RX_BATCH];
+	struct sockaddr_in board;
+	struct rx_ctx *ctx;
+	double start, last, t;
+	int sock, cmd_sock, n, on = 1;
+
+	sock = open_socket(o->port, o->rcvbuf);
+	if (sock < 0)
+		return 1;
+	if (o->group && join_group(sock, o->group))
+		return 1;
+	/* receivers of a group are told apart by the port their commands
+	 * come from, several of them may share this host and data port */
+	cmd_sock = o->group ? socket(AF_INET, SOCK_DGRAM, 0) : sock;
+	if (cmd_sock < 0) {
+		perror("socket");
+		return 1;
+	}
+	set_timeout(sock, 100000);
+	setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+
+	memset(&board, 0, sizeof(board));
+	board.sin_family = AF_INET;
+	board.sin_port = htons(o->board_port);
+	if (inet_pton(AF_INET, o->board_ip, &board.sin_addr) != 1) {
+		fprintf(stderr, "invalid board address %s\n", o->board_ip);
+		return 1;
+	}
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return 1;
+	frame_tracker_init(&ctx->tracker);
+	frame_reasm_init(&ctx->reasm, on_frame, ctx);
+	stats_reset(&ctx->cur);
+	stats_reset(&ctx->total);
+
+	send_command(cmd_sock, &board, "start");
+	start = last = mono_sec();
+
+	while (!stop) {
+		for (int i = 0; i < RX_BATCH; i++) {
+			iovs[i].iov_base = bufs[i];
+			iovs[i].iov_len = MAX_DATAGRAM;
+			memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_control = ctrl[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+		}
+
+		n = recvmmsg(sock, msgs, RX_BATCH, MSG_WAITFORONE, NULL);
+		for (int i = 0; i < n; i++)
+			on_datagram(ctx, bufs[i], msgs[i].msg_len,
+					msg_timestamp(&msgs[i].msg_hdr));
+		if (n < 0 && errno != EAGAIN && errno != EINTR) {
+			perror("recvmmsg");
+			break;
+		}
+
+		t = mono_sec();
+		if (t - last >= o->interval) {
+			print_line("", last - start, t - start, &ctx->cur);
+			stats_merge(&ctx->total, &ctx->cur);
+			stats_reset(&ctx->cur);
+			last = t;
+		}
+		if (o->duration > 0 && t - start >= o->duration)
+			break;
+	}
+
+	send_command(cmd_sock, &board, "finish");
+	stats_merge(&ctx->total, &ctx->cur);
+	frame_reasm_free(&ctx->reasm);
+	print_final(ctx, mono_sec() - start);
+
+	free(ctx);
+	if (cmd_sock != sock)
+		close(cmd_sock);
+	close(sock);
+	return 0;
+}
+
+/* --------------------------------------------------------------- emu --- */
+
+static int command_is(const uint8_t *buf, ssize_t len, const char *cmd)
+{
+	size_t n = strlen(cmd);
+
+	return len >= (ssize_t)n && !memcmp(buf, cmd, n);
+}
+
+static void timespec_add_ns(struct timespec *ts, uint64_t ns)
+{
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= 1000000000) {
+		ts->tv_nsec -= 1000000000;
+		ts->tv_sec++;
+	}
+}
+
+static int run_emu(const struct bench_opts *o)
+{
+	uint8_t cmd[256];
+	uint8_t *dgram;
+	struct sockaddr_in peer;
+	socklen_t peer_len;
+	struct frame_header h;
+	struct timespec next;
+	uint64_t period_ns;
+	uint32_t sequence = 0;
+	size_t record = FRAME_HEADER_SIZE + o->pixels;
+	int sock, streaming = 0;
+	ssize_t len;
+
+	sock = open_socket(o->board_port, 0);
+	if (sock < 0)
+		return 1;
+	set_timeout(sock, 100000);
+
+	dgram = calloc(o->batch, record);
+	if (!dgram)
+		return 1;
+
+	period_ns = (uint64_t)(1e9 / o->fps);
+	memset(&h, 0, sizeof(h));
+	h.format = FRAME_FMT_RAW8;
+	h.pixel_count = o->pixels;
+	h.payload_len = o->pixels;
+	h.geometry.width = o->pixels;
+	h.geometry.bin_x = 1;
+	h.geometry.bin_y = 1;
+	h.frames = 1;
+	h.frag_count = 1;
+
+	fprintf(stderr, "emulated board on port %d: %d pixels, %.0f frames/s, "
+			"%d frames per datagram\n", o->board_port, o->pixels,
+			o->fps, o->batch);
+
+	while (!stop) {
+		peer_len = sizeof(peer);
+		len = recvfrom(sock, cmd, sizeof(cmd), streaming ? MSG_DONTWAIT : 0,
+				(struct sockaddr *)&peer, &peer_len);
+		if (len > 0 && command_is(cmd, len, "start")) {
+			/* the board sends to UDP_CONN_PORT of the server, which
+			 * is where the command came from */
+			streaming = 1;
+			sequence = 0;
+			set_timeout(sock, 0);
+			clock_gettime(CLOCK_MONOTONIC, &next);
+			fprintf(stderr, "start\n");
+		} else if (len > 0 && command_is(cmd, len, "finish")) {
+			streaming = 0;
+			set_timeout(sock, 100000);
+			fprintf(stderr, "finish\n");
+		}
+		if (!streaming)
+			continue;
+
+		/* one datagram carries o->batch frames, captured one period apart */
+		for (int i = 0; i < o->batch; i++) {
+			timespec_add_ns(&next, period_ns);
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+			h.sequence = sequence++;
+			h.timestamp_us = now_us();
+			frame_header_put(dgram + i * record, &h);
+			memset(dgram + i * record + FRAME_HEADER_SIZE,
+					h.sequence & 0xff, o->pixels);
+		}
+
+		sendto(sock, dgram, o->batch * record, 0,
+				(struct sockaddr *)&peer, sizeof(peer));
+	}
+
+	free(dgram);
+	close(sock);
+	return 0;
+}
+
+static void *emu_thread(void *arg)
+{
+	run_emu(arg);
+	return NULL;
+}
+
+/* -------------------------------------------------------------- main --- */
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-m rx|emu|loop] [options]\n"
+		"  -b ip      board address (default " DEFAULT_BOARD_IP ")\n"
+		"  -p port    data port on this host (default %d)\n"
+		"  -r port    command port of the board (default %d)\n"
+		"  -g group   receive a multicast stream of that group\n"
+		"  -i sec     interim report interval (default 1)\n"
+		"  -t sec     run time, 0 runs until Ctrl-C (loop default 5)\n"
+		"  -B bytes   socket receive buffer size\n"
+		"emulated board:\n"
+		"  -f fps     frame rate (default 10000)\n"
+		"  -z pixels  pixels per frame (default 1024)\n"
+		"  -k frames  frames per datagram (default 1)\n",
+		prog, DEFAULT_PORT, DEFAULT_BOARD_PORT);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_opts o = {
+		.mode = MODE_RX,
+		.board_ip = DEFAULT_BOARD_IP,
+		.port = DEFAULT_PORT,
+		.board_port = DEFAULT_BOARD_PORT,
+		.interval = 1.0,
+		.duration = -1,
+		.rcvbuf = 0,
+		.fps = 10000,
+		.pixels = 1024,
+		.batch = 1,
+	};
+	pthread_t emu;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "m:b:p:r:g:i:t:B:f:z:k:h")) != -1) {
+		switch (opt) {
+		case 'm':
+			if (!strcmp(optarg, "rx"))
+				o.mode = MODE_RX;
+			else if (!strcmp(optarg, "emu"))
+				o.mode = MODE_EMU;
+			else if (!strcmp(optarg, "loop"))
+				o.mode = MODE_LOOP;
+			else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'b': o.board_ip = optarg; break;
+		case 'p': o.port = atoi(optarg); break;
+		case 'r': o.board_port = atoi(optarg); break;
+		case 'g': o.group = optarg; break;
+		case 'i': o.interval = atof(optarg); break;
+		case 't': o.duration = atof(optarg); break;
+		case 'B': o.rcvbuf = atoi(optarg); break;
+		case 'f': o.fps = atof(optarg); break;
+		case 'z': o.pixels = atoi(optarg); break;
+		case 'k': o.batch = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (o.fps <= 0 || o.pixels < 0 || o.batch < 1 ||
+			o.batch * (FRAME_HEADER_SIZE + o.pixels) > 65507) {
+		fprintf(stderr, "invalid emulator frame settings\n");
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	switch (o.mode) {
+	case MODE_EMU:
+		return run_emu(&o);
+	case MODE_LOOP:
+		o.board_ip = "127.0.0.1";
+		if (o.duration < 0)
+			o.duration = 5;
+		if (pthread_create(&emu, NULL, emu_thread, &o)) {
+			perror("pthread_create");
+			return 1;
+		}
+		/* give the emulator time to bind its port */
+		usleep(100000);
+		ret = run_rx(&o);
+		stop = 1;
+		pthread_join(emu, NULL);
+		return ret;
+	default:
+		if (o.duration < 0)
+			o.duration = 0;
+		return run_rx(&o);
+	}
+}
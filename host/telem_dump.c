@@ -0,0 +1,167 @@
+/*
+ * telem_dump.c
+ *
+ * Receives the board's telemetry datagrams (src/telem_proto.h) and prints
+ * every counter with its rate since the previous datagram, gauges as they
+ * are. The idle time is shown as the share of the CPU it was. Rates are
+ * taken over the board's own clock, so they do not depend on when the
+ * datagrams arrive.
+ *
+ * usage: telem_dump [-p port] [-g group] [-n datagrams]
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "telem_proto.h"
+
+/* UDP_TELEM_PORT of the firmware */
+#define DEFAULT_PORT	50002
+
+static const char *counter_name[TELEM_COUNT] = {
+	[TELEM_TX_BYTES] = "tx_bytes",
+	[TELEM_TX_DATAGRAMS] = "tx_datagrams",
+	[TELEM_TX_FRAMES] = "tx_frames",
+	[TELEM_TX_PARKED] = "tx_parked",
+	[TELEM_TX_RETRIES] = "tx_retries",
+	[TELEM_TX_DROPPED_DATAGRAMS] = "tx_dropped_datagrams",
+	[TELEM_TX_DROPPED_FRAMES] = "tx_dropped_frames",
+	[TELEM_TX_SEND_ERRORS] = "tx_send_errors",
+	[TELEM_TX_DEFERRED] = "tx_deferred",
+	[TELEM_FRAMES_CAPTURED] = "frames_captured",
+	[TELEM_FRAMES_DROPPED] = "frames_dropped",
+	[TELEM_PIXELS_OVERRUN] = "pixels_overrun",
+	[TELEM_DMA_RING_DRY] = "dma_ring_dry",
+	[TELEM_IRQ_EOC] = "irq_eoc",
+	[TELEM_IRQ_EOS] = "irq_eos",
+	[TELEM_IRQ_DMA] = "irq_dma",
+	[TELEM_RING_DEPTH] = "ring_depth",
+	[TELEM_RING_HIGH_WATER] = "ring_high_water",
+	[TELEM_TX_QUEUE_DEPTH] = "tx_queue_depth",
+	[TELEM_IDLE_US] = "idle_us",
+	[TELEM_WAKEUPS] = "wakeups",
+};
+
+/* Rate with a K/M/G prefix, like the board's UART report */
+static void print_rate(double rate)
+{
+	static const char label[] = " KMG";
+	int conv = 0;
+
+	while (rate >= 1000.0 && conv < 3) {
+		rate /= 1000.0;
+		conv++;
+	}
+	printf("%8.2f %c/s", rate, label[conv]);
+}
+
+int main(int argc, char **argv)
+{
+	const char *group = NULL;
+	int port = DEFAULT_PORT, sock, opt, n;
+	long limit = 0, received = 0;
+	uint64_t counters[TELEM_COUNT], last[TELEM_COUNT];
+	uint64_t time_us, last_us = 0, lost = 0;
+	uint32_t sequence, last_seq = 0;
+	struct sockaddr_in local;
+	struct ip_mreq mreq;
+	uint8_t buf[2048];
+	ssize_t len;
+	int have_last = 0, reset;
+	double dt;
+
+	while ((opt = getopt(argc, argv, "p:g:n:")) != -1) {
+		switch (opt) {
+		case 'p': port = atoi(optarg); break;
+		case 'g': group = optarg; break;
+		case 'n': limit = atol(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-p port] [-g group] "
+					"[-n datagrams]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(port);
+	if (bind(sock, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	if (group) {
+		memset(&mreq, 0, sizeof(mreq));
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (inet_pton(AF_INET, group, &mreq.imr_multiaddr) != 1 ||
+				setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+				&mreq, sizeof(mreq)) < 0) {
+			fprintf(stderr, "cannot join multicast group %s\n",
+					group);
+			return 1;
+		}
+	}
+
+	while (!limit || received < limit) {
+		len = recv(sock, buf, sizeof(buf), 0);
+		if (len < 0) {
+			perror("recv");
+			return 1;
+		}
+		n = telem_get(buf, len, &sequence, &time_us, counters);
+		if (n < 0) {
+			fprintf(stderr, "ignoring %zd byte datagram\n", len);
+			continue;
+		}
+		received++;
+
+		/* a counter going back or the clock standing still means the
+		 * board started over, rates need two datagrams of one run */
+		reset = !have_last || time_us <= last_us;
+		for (int i = 0; i < TELEM_COUNT && !reset; i++)
+			if (!TELEM_IS_GAUGE(i) && counters[i] < last[i])
+				reset = 1;
+		if (!reset && sequence - last_seq > 1)
+			lost += sequence - last_seq - 1;
+		dt = reset ? 0 : (time_us - last_us) / 1e6;
+
+		printf("seq %u, board time %.3f s, %llu datagrams lost%s\n",
+				sequence, time_us / 1e6,
+				(unsigned long long)lost,
+				reset && have_last ? ", board reset" : "");
+		for (int i = 0; i < TELEM_COUNT; i++) {
+			printf("  %-22s %14llu", counter_name[i],
+					(unsigned long long)counters[i]);
+			if (i == TELEM_IDLE_US && dt > 0) {
+				printf("  %8.1f %% idle",
+						(counters[i] - last[i]) / dt / 1e4);
+			} else if (!TELEM_IS_GAUGE(i) && dt > 0) {
+				printf("  ");
+				print_rate((counters[i] - last[i]) / dt);
+			}
+			printf("\n");
+		}
+		if (n > TELEM_COUNT)
+			printf("  (%d newer counters not shown)\n",
+					n - TELEM_COUNT);
+		fflush(stdout);
+
+		memcpy(last, counters, sizeof(last));
+		last_us = time_us;
+		last_seq = sequence;
+		have_last = 1;
+	}
+
+	close(sock);
+	return 0;
+}
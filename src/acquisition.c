@@ -0,0 +1,436 @@
+/*
+ * acquisition.c
+ *
+ * Per-pixel frame capture into the frame ring, called from interrupt
+ * context only. Pixels outside the readout window are skipped as they
+ * arrive and a frame is committed as soon as the last row of the window is
+ * in, without waiting for EOS. Binning runs in place over the stored window
+ * once the frame is complete. In integration mode completed frames are
+ * added to the sums and only every K-th buffer is committed, carrying the
+ * sums. The buffers of the other frames are reused for the next frame.
+ * Dark and gain correction comes first, on the stored window pixels.
+ */
+
+#include <string.h>
+#include "acquisition.h"
+#include "frame_ring.h"
+#include "frame_accum.h"
+#include "frame_calib.h"
+#include "frame_arena.h"
+#include "latency_probe.h"
+#include "mem_place.h"
+
+/* Binned means multiply by 2^24 / n rounded up instead of dividing, exact
+ * for up to 64 pixels of 8 bits and without overflowing 32 bits */
+#define ACQ_RECIP_SHIFT 24
+
+int is_measurement_time = 0;
+
+/* sensor columns and most pixels of a frame, set by acq_configure() */
+static u32 acq_width = ACQ_SENSOR_WIDTH;
+static u32 acq_pixels = 0;
+
+static int counter_pixels HOT_DATA = 0;
+static struct frame_slot *acq_frame HOT_DATA = NULL;
+/* buffer of a frame that went into the sums, the next frame reuses it */
+static struct frame_slot *acq_held HOT_DATA = NULL;
+
+/* geometry of the frame being captured */
+static struct acq_geometry acq_geo = { 0, 0, ACQ_SENSOR_WIDTH, 0, 1, 1 };
+/* first row past the window */
+static u32 acq_row_end = ~0u;
+static u32 acq_recip = 1u << ACQ_RECIP_SHIFT;
+
+/* geometry set from the main loop, picked up at the next frame start */
+static struct acq_geometry acq_next;
+static volatile u32 acq_next_valid = 0;
+
+/* sensor position of the next pixel, window pixels stored so far */
+static u32 acq_col HOT_DATA, acq_row HOT_DATA, acq_stored HOT_DATA;
+
+/* column sums of one band of binned rows, acq_width of them */
+static u16 *acq_bin_sum;
+
+/* frame integration, and the setting picked up at the next frame */
+static struct frame_accum acq_accum;
+static volatile u32 acq_next_integration = 0;
+
+/* dark offsets and 4.12 gains per sensor pixel, acq_pixels of them */
+static u8 *acq_dark;
+static u16 *acq_gain;
+static volatile u32 acq_cal_on = 0;
+
+static ISR_CODE void acq_update_settings(void)
+{
+	u32 n;
+
+	if (acq_next_integration) {
+		/* frames in the upper bits, bytes per sum in the low 3 */
+		n = acq_next_integration;
+		acq_next_integration = 0;
+		frame_accum_setup(&acq_accum, n >> 3, n & 7);
+	}
+
+	if (!acq_next_valid)
+		return;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	acq_geo = acq_next;
+	acq_next_valid = 0;
+
+	acq_row_end = acq_geo.height ? acq_geo.y + acq_geo.height : ~0u;
+	n = acq_geo.bin_x * acq_geo.bin_y;
+	acq_recip = ((1u << ACQ_RECIP_SHIFT) + n - 1) / n;
+}
+
+/* Bin a window of width x rows pixels in place, returns the pixel count.
+ * Rows of an incomplete band at the bottom are dropped. */
+static u32 acq_bin(u8 *data, u32 width, u32 rows)
+{
+	u32 bin_x = acq_geo.bin_x, bin_y = acq_geo.bin_y;
+	u32 out_width = width / bin_x, out_rows = rows / bin_y;
+	const u8 *in;
+	u8 *out = data;
+	u32 oy, sy, ox, sx;
+
+	for (oy = 0; oy < out_rows; oy++) {
+		memset(acq_bin_sum, 0, out_width * sizeof(acq_bin_sum[0]));
+		/* the band is read completely before its row is written, and
+		 * the output row lies in front of it */
+		for (sy = 0; sy < bin_y; sy++) {
+			in = data + (oy * bin_y + sy) * width;
+			for (ox = 0; ox < out_width; ox++)
+				for (sx = 0; sx < bin_x; sx++)
+					acq_bin_sum[ox] += *in++;
+		}
+		for (ox = 0; ox < out_width; ox++)
+			*out++ = (acq_bin_sum[ox] * acq_recip +
+					(1u << (ACQ_RECIP_SHIFT - 1))) >> ACQ_RECIP_SHIFT;
+	}
+
+	return out_width * out_rows;
+}
+
+/* Correct len window pixels, row by row unless the window spans the full
+ * sensor width and the rows follow each other in the tables too */
+static void acq_correct(u8 *data, u32 len)
+{
+	u32 width = acq_geo.width, off, cal, n;
+
+	PROBE_START(cal_start);
+	if (width == acq_width)
+		width = len;
+
+	cal = acq_geo.y * acq_width + acq_geo.x;
+	for (off = 0; off < len && cal < acq_pixels; off += width) {
+		n = len - off < width ? len - off : width;
+		if (n > acq_pixels - cal)
+			n = acq_pixels - cal;
+		frame_calib_apply(data + off, acq_dark + cal, acq_gain + cal, n);
+		cal += acq_width;
+	}
+	PROBE_END(PROBE_CORRECTION, cal_start);
+}
+
+/* Bin the len window pixels of slot and commit it. Returns 0 if the frame
+ * only went into the integration sums and slot was not committed. */
+static ISR_CODE int acq_finish(struct frame_slot *slot, u32 len)
+{
+	u32 width = acq_geo.width;
+	u32 pixels;
+
+	if (acq_cal_on)
+		acq_correct(slot->data, len);
+
+	if (acq_geo.bin_x > 1 || acq_geo.bin_y > 1) {
+		len = acq_bin(slot->data, width, len / width);
+		width /= acq_geo.bin_x;
+	}
+	pixels = len;
+
+	if (acq_accum.frames > 1) {
+		if (!frame_accum_add(&acq_accum, slot->data, pixels))
+			return 0;
+		if (frame_accum_store(&acq_accum, slot->data))
+			slot->flags |= FRAME_FLAG_SATURATED;
+		slot->format = acq_accum.bytes == 2 ?
+				FRAME_FMT_SUM16 : FRAME_FMT_SUM32;
+		slot->frames = acq_accum.frames;
+		len = pixels * acq_accum.bytes;
+	}
+
+	slot->geometry.x = acq_geo.x;
+	slot->geometry.y = acq_geo.y;
+	slot->geometry.width = width;
+	slot->geometry.bin_x = acq_geo.bin_x;
+	slot->geometry.bin_y = acq_geo.bin_y;
+	frame_ring_commit(slot, pixels, len);
+	return 1;
+}
+
+ISR_CODE int acq_pixel(u8 pixel)
+{
+	if (counter_pixels == 0) {
+		/* first pixel of a frame, claim a free buffer */
+		acq_update_settings();
+		acq_col = 0;
+		acq_row = 0;
+		acq_stored = 0;
+		acq_frame = acq_held ? acq_held : frame_ring_begin();
+		acq_held = NULL;
+	}
+
+	if (acq_frame && acq_row >= acq_geo.y &&
+			acq_col - acq_geo.x < acq_geo.width) {
+		if (acq_stored < acq_pixels) {
+			acq_frame->data[acq_stored++] = pixel;
+		} else {
+			frame_ring_stats.pixels_overrun++;
+			acq_frame->flags |= FRAME_FLAG_OVERRUN;
+		}
+	}
+
+	if (++acq_col == acq_width) {
+		acq_col = 0;
+		if (++acq_row == acq_row_end && acq_frame) {
+			/* the rest of the frame is outside the window */
+			if (!acq_finish(acq_frame, acq_stored))
+				acq_held = acq_frame;
+			acq_frame = NULL;
+		}
+	}
+
+	return counter_pixels++;
+}
+
+ISR_CODE void acq_end_of_frame(void)
+{
+	if (acq_frame) {
+		if (!acq_finish(acq_frame, acq_stored))
+			acq_held = acq_frame;
+		acq_frame = NULL;
+	}
+	counter_pixels = 0;
+}
+
+void acq_reset(void)
+{
+	/* an integrated frame never spans a restart */
+	acq_accum.count = 0;
+	if (acq_frame || acq_held) {
+		frame_ring_abort();
+		acq_frame = NULL;
+		acq_held = NULL;
+	}
+	counter_pixels = 0;
+}
+
+ISR_CODE int acq_commit_frame(struct frame_slot *slot, u32 len)
+{
+	u32 row, start, n;
+	u8 *out = slot->data;
+
+	acq_update_settings();
+
+	if (acq_geo.x || acq_geo.y || acq_geo.height ||
+			acq_geo.width != acq_width) {
+		/* move the window rows to the front of the buffer */
+		for (row = acq_geo.y; row < acq_row_end; row++) {
+			start = row * acq_width + acq_geo.x;
+			if (start >= len)
+				break;
+			n = len - start < acq_geo.width ? len - start : acq_geo.width;
+			memmove(out, slot->data + start, n);
+			out += n;
+		}
+		len = out - slot->data;
+	}
+
+	return acq_finish(slot, len);
+}
+
+int acq_check_geometry(struct acq_geometry *g, u32 width, u32 pixels)
+{
+	/* a line sensor has one row, frame_pixels == sensor_width */
+	u32 rows = width ? pixels / width : 0;
+
+	if (g->bin_x < 1 || g->bin_x > ACQ_BIN_MAX ||
+			g->bin_y < 1 || g->bin_y > ACQ_BIN_MAX)
+		return -1;
+	if (g->x >= width || g->width > width - g->x)
+		return -1;
+	if (g->y >= rows || g->height > rows - g->y)
+		return -1;
+
+	if (!g->width)
+		g->width = width - g->x;
+	if (g->width < g->bin_x ||
+			(g->height ? g->height : rows - g->y) < g->bin_y)
+		return -1;
+	g->width -= g->width % g->bin_x;
+	g->height -= g->height % g->bin_y;
+	return 0;
+}
+
+int acq_set_geometry(struct acq_geometry *g)
+{
+	if (acq_check_geometry(g, acq_width, acq_pixels))
+		return -1;
+
+	/* the interrupt must not pick up a half written geometry */
+	acq_next_valid = 0;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	acq_next = *g;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	acq_next_valid = 1;
+
+	return 0;
+}
+
+void acq_get_geometry(struct acq_geometry *g)
+{
+	*g = acq_next_valid ? acq_next : acq_geo;
+}
+
+int acq_set_integration(u32 frames, u32 bits)
+{
+	if (frames > ACQ_INTEGRATE_MAX || (bits != 16 && bits != 32))
+		return -1;
+
+	/* a single word, the interrupt reads it whole */
+	acq_next_integration = (frames ? frames : 1) << 3 | bits / 8;
+	return 0;
+}
+
+void acq_get_integration(u32 *frames, u32 *bits)
+{
+	u32 n = acq_next_integration;
+
+	if (n) {
+		/* not picked up by the next frame yet */
+		*frames = n >> 3;
+		*bits = (n & 7) * 8;
+	} else {
+		*frames = acq_accum.frames;
+		*bits = acq_accum.bytes * 8;
+	}
+}
+
+int acq_cal_load_dark(u32 offset, const u8 *dark, u32 count)
+{
+	if (offset > acq_pixels || count > acq_pixels - offset)
+		return -1;
+
+	memcpy(acq_dark + offset, dark, count);
+	return 0;
+}
+
+int acq_cal_load_gain(u32 offset, const u8 *gain, u32 count)
+{
+	if (offset > acq_pixels || count > acq_pixels - offset)
+		return -1;
+
+	for (u32 i = 0; i < count; i++)
+		acq_gain[offset + i] = frame_get16(gain + 2 * i);
+	return 0;
+}
+
+void acq_cal_reset(void)
+{
+	memset(acq_dark, 0, acq_pixels);
+	for (u32 i = 0; i < acq_pixels; i++)
+		acq_gain[i] = FRAME_CALIB_GAIN_ONE;
+}
+
+void acq_cal_enable(int enable)
+{
+	acq_cal_on = enable;
+}
+
+int acq_cal_enabled(void)
+{
+	return acq_cal_on;
+}
+
+void acq_cal_bench(u32 *neon_cycles, u32 *scalar_cycles)
+{
+	/* the loaded tables on a synthetic frame */
+	static u8 pixels[BUFFER_SIZE] __attribute__((aligned(16)));
+	u32 n = BUFFER_SIZE < acq_pixels ? BUFFER_SIZE : acq_pixels;
+	u32 start, cycles, i;
+
+	*neon_cycles = ~0u;
+	*scalar_cycles = ~0u;
+	for (int run = 0; run < ACQ_CAL_BENCH_RUNS; run++) {
+		for (i = 0; i < n; i++)
+			pixels[i] = (u8)(i * 37 + run);
+		start = get_cycles();
+		frame_calib_apply(pixels, acq_dark, acq_gain, n);
+		cycles = get_cycles() - start;
+		if (cycles < *neon_cycles)
+			*neon_cycles = cycles;
+
+		for (i = 0; i < n; i++)
+			pixels[i] = (u8)(i * 37 + run);
+		start = get_cycles();
+		frame_calib_apply_scalar(pixels, acq_dark, acq_gain, n);
+		cycles = get_cycles() - start;
+		if (cycles < *scalar_cycles)
+			*scalar_cycles = cycles;
+	}
+}
+
+void acq_init(void)
+{
+	acq_pixels = 0;
+	acq_width = ACQ_SENSOR_WIDTH;
+}
+
+int acq_configure(u32 width, u32 pixels)
+{
+	u32 frames = acq_accum.frames, bytes = acq_accum.bytes;
+	void *sums;
+
+	if (!width || width > 0xffff || width > pixels)
+		return -1;
+
+	sums = frame_arena_alloc(4 * pixels);
+	acq_bin_sum = frame_arena_alloc(width * sizeof(acq_bin_sum[0]));
+	acq_dark = frame_arena_alloc(pixels);
+	acq_gain = frame_arena_alloc(pixels * sizeof(acq_gain[0]));
+	if (!sums || !acq_bin_sum || !acq_dark || !acq_gain) {
+		acq_pixels = 0;
+		return -1;
+	}
+
+	acq_width = width;
+	acq_pixels = pixels;
+
+	/* the integration setting survives, the sums start over */
+	frame_accum_init(&acq_accum, sums, pixels);
+	if (frames)
+		frame_accum_setup(&acq_accum, frames, bytes);
+
+	/* the whole new sensor, the old window and tables may not fit it */
+	acq_next_valid = 0;
+	acq_geo.x = 0;
+	acq_geo.y = 0;
+	acq_geo.width = width;
+	acq_geo.height = 0;
+	acq_geo.bin_x = 1;
+	acq_geo.bin_y = 1;
+	acq_row_end = ~0u;
+	acq_recip = 1u << ACQ_RECIP_SHIFT;
+	acq_cal_reset();
+	return 0;
+}
+
+u32 acq_sensor_width(void)
+{
+	return acq_width;
+}
+
+u32 acq_frame_pixels(void)
+{
+	return acq_pixels;
+}
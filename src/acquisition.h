@@ -0,0 +1,119 @@
+/*
+ * acquisition.h
+ *
+ * Hardware independent part of the per-pixel capture path. The platform's
+ * EOC / EOS interrupt handlers (or the Linux simulator) feed pixels and end
+ * of frame events in, completed frames are committed to the frame ring.
+ */
+
+#ifndef __ACQUISITION_H_
+#define __ACQUISITION_H_
+
+#include "xil_types.h"
+#include "platform.h"
+
+/* Default columns of the sensor, frames are read out row by row. The
+ * default is a line sensor, one row of BUFFER_SIZE pixels per frame. */
+#ifndef ACQ_SENSOR_WIDTH
+#define ACQ_SENSOR_WIDTH BUFFER_SIZE
+#endif
+
+/* Largest binning factor in either direction */
+#define ACQ_BIN_MAX 8
+
+/* Most frames summed into one integrated frame */
+#define ACQ_INTEGRATE_MAX 65535
+
+/* Runs of the correction benchmark, the fastest one is reported */
+#define ACQ_CAL_BENCH_RUNS 64
+
+/*
+ * Readout window in sensor pixels and the binning applied to it. A width of
+ * 0 reaches the last column, a height of 0 the last row of the frame.
+ * Binned pixels are the rounded mean of bin_x * bin_y sensor pixels.
+ */
+struct acq_geometry {
+	u16 x;
+	u16 y;
+	u16 width;
+	u16 height;
+	u8 bin_x;
+	u8 bin_y;
+};
+
+struct frame_slot;
+
+extern int is_measurement_time;
+
+void acq_init(void);
+
+/*
+ * Size the capture for a sensor of width columns and frames of up to pixels
+ * pixels, carving the work buffers from the frame arena (frame_arena.h).
+ * The readout window goes back to the whole sensor and the calibration
+ * tables to neutral. Only while acquisition is stopped, returns -1 if the
+ * size is invalid or the arena is exhausted.
+ */
+int acq_configure(u32 width, u32 pixels);
+u32 acq_sensor_width(void);
+/* Most pixels of a frame, the length of a DMA transfer */
+u32 acq_frame_pixels(void);
+
+/* Store the next pixel of the current frame, returns its index in the frame */
+int acq_pixel(u8 pixel);
+
+/* End of sequence, commit the current frame */
+void acq_end_of_frame(void);
+
+/* Drop a partially captured frame, the next pixel starts a new one */
+void acq_reset(void);
+
+/*
+ * Crop and bin a complete sensor frame of len pixels in place, then commit
+ * it. For the DMA modes, which capture whole frames without acq_pixel().
+ * Returns 0 if the frame only went into the integration sums, slot is then
+ * still reserved and may take the next frame.
+ */
+int acq_commit_frame(struct frame_slot *slot, u32 len);
+
+/*
+ * Select the readout window, taking effect with the next frame. The width
+ * and height are rounded down to multiples of the binning and written back
+ * to g. Returns -1 if the window is not on the sensor, of acq_frame_pixels()
+ * / acq_sensor_width() rows, or the binning is out of range or larger than
+ * the window. Called from the main loop.
+ */
+int acq_set_geometry(struct acq_geometry *g);
+/* The checks and rounding of acq_set_geometry() for a sensor of width
+ * columns and pixels pixels, without selecting the window */
+int acq_check_geometry(struct acq_geometry *g, u32 width, u32 pixels);
+void acq_get_geometry(struct acq_geometry *g);
+
+/*
+ * Send the sum of every frames frames, in sums of bits (16 or 32) per
+ * pixel, instead of the single frames. 0 or 1 frames switches integration
+ * off. Takes effect with the next frame, returns -1 for an invalid setting.
+ */
+int acq_set_integration(u32 frames, u32 bits);
+void acq_get_integration(u32 *frames, u32 *bits);
+
+/*
+ * Dark frame and flat field correction (frame_calib.h), applied to every
+ * frame before binning and integration. The tables are indexed by sensor
+ * pixel, row * acq_sensor_width() + column, and cover acq_frame_pixels()
+ * pixels. Loading stores count entries from sensor pixel offset on, gains
+ * as big endian 4.12 fixed point, and returns -1 if they do not fit.
+ * Correction should be off while the tables are loaded, otherwise frames
+ * in between are corrected with a mix of both.
+ */
+int acq_cal_load_dark(u32 offset, const u8 *dark, u32 count);
+int acq_cal_load_gain(u32 offset, const u8 *gain, u32 count);
+/* No offset, unit gain */
+void acq_cal_reset(void);
+void acq_cal_enable(int enable);
+int acq_cal_enabled(void);
+/* Fastest of ACQ_CAL_BENCH_RUNS corrections of a frame, at most
+ * BUFFER_SIZE pixels, in cycles, with the NEON kernel and the scalar one */
+void acq_cal_bench(u32 *neon_cycles, u32 *scalar_cycles);
+
+#endif /* __ACQUISITION_H_ */
@@ -0,0 +1,678 @@
+/*
+ * control.c
+ *
+ * Binary requests are decoded straight from the received pbuf, the reply
+ * is built on the stack and sent back to the requester. Text commands are
+ * copied into a bounded, NUL terminated buffer first.
+ *
+ * Everything here runs from the lwIP receive callback in the main loop, the
+ * same context that reads the transport settings, so they need no locking.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "control.h"
+#include "ctrl_proto.h"
+#include "udp_perf_client.h"
+#include "acquisition.h"
+#include "latency_probe.h"
+#include "tx_pacer.h"
+#include "log_ring.h"
+#include "mem_place.h"
+
+/* Readout window as last requested, before rounding to the binning, so a
+ * later change of the binning does not shrink the window */
+static struct acq_geometry ctrl_request = { 0, 0, 0, 0, 1, 1 };
+
+struct ctrl_param {
+	u16 id;
+	u8 type;
+	u8 writable;
+};
+
+static const struct ctrl_param ctrl_params[] = {
+	{ CTRL_PARAM_ROI_X, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_ROI_Y, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_ROI_WIDTH, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_ROI_HEIGHT, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_BIN_X, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_BIN_Y, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_SENSOR_WIDTH, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_FRAME_PIXELS, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_SUM_FRAMES, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_SUM_BITS, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_CAL_ENABLE, CTRL_TYPE_BOOL, 1 },
+	{ CTRL_PARAM_SPARSE, CTRL_TYPE_I32, 1 },
+	{ CTRL_PARAM_BATCH_FRAMES, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_BATCH_FLUSH_US, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_RATE_KBPS, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_BURST_BYTES, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_MCAST_GROUP, CTRL_TYPE_IP4, 1 },
+	{ CTRL_PARAM_MCAST_TTL, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_CONSUMERS, CTRL_TYPE_U32, 0 },
+	{ CTRL_PARAM_REPORT_MS, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_SESSION_MS, CTRL_TYPE_U32, 1 },
+	{ CTRL_PARAM_TELEM_MS, CTRL_TYPE_U32, 1 },
+};
+
+#define CTRL_PARAM_COUNT (sizeof(ctrl_params) / sizeof(ctrl_params[0]))
+
+/* Settings a SET changes together once all its records passed */
+struct ctrl_staged {
+	struct acq_geometry geometry;
+	struct udp_tx_config config;
+	int cal_enable;
+	u32 width;
+	u32 pixels;
+	u32 sum_frames;
+	u32 sum_bits;
+	u32 rate;
+	u32 burst;
+	u32 group;
+	u32 ttl;
+	u8 geometry_set;
+	u8 size_set;
+	u8 integration_set;
+	u8 pacer_set;
+	u8 mcast_set;
+};
+
+static const struct ctrl_param *ctrl_find(u16 id)
+{
+	for (u32 i = 0; i < CTRL_PARAM_COUNT; i++)
+		if (ctrl_params[i].id == id)
+			return &ctrl_params[i];
+	return NULL;
+}
+
+static int ctrl_set_geometry(const struct acq_geometry *request,
+		struct acq_geometry *active)
+{
+	*active = *request;
+	if (acq_set_geometry(active))
+		return -1;
+	ctrl_request = *request;
+	return 0;
+}
+
+/* Group as the value of a CTRL_TYPE_IP4 record, 0 without one */
+static u32 ctrl_group(u32 *ttl)
+{
+	ip_addr_t g;
+
+	if (!udp_stream_multicast(&g, ttl))
+		return 0;
+	return (u32)ip4_addr1(&g) << 24 | (u32)ip4_addr2(&g) << 16 |
+			(u32)ip4_addr3(&g) << 8 | ip4_addr4(&g);
+}
+
+static int ctrl_set_group(u32 group, u32 ttl)
+{
+	ip_addr_t g;
+
+	if (!group)
+		return udp_stream_set_multicast(NULL, 0);
+	IP4_ADDR(&g, group >> 24, (group >> 16) & 0xff, (group >> 8) & 0xff,
+			group & 0xff);
+	return udp_stream_set_multicast(&g, ttl);
+}
+
+/* Returns a CTRL status */
+static int ctrl_set_frame_size(u32 width, u32 pixels)
+{
+	static const struct acq_geometry full = { 0, 0, 0, 0, 1, 1 };
+
+	if (!udp_stream_idle())
+		return CTRL_E_BUSY;
+	if (udp_stream_set_frame_size(width, pixels))
+		return CTRL_E_RANGE;
+	/* the window went back to the whole new sensor */
+	ctrl_request = full;
+	return CTRL_OK;
+}
+
+static u32 ctrl_get(u16 id)
+{
+	struct acq_geometry g;
+	u32 frames, bits, ttl;
+
+	acq_get_geometry(&g);
+	acq_get_integration(&frames, &bits);
+
+	switch (id) {
+	case CTRL_PARAM_ROI_X:		return g.x;
+	case CTRL_PARAM_ROI_Y:		return g.y;
+	case CTRL_PARAM_ROI_WIDTH:	return g.width;
+	case CTRL_PARAM_ROI_HEIGHT:	return g.height;
+	case CTRL_PARAM_BIN_X:		return g.bin_x;
+	case CTRL_PARAM_BIN_Y:		return g.bin_y;
+	case CTRL_PARAM_SENSOR_WIDTH:	return acq_sensor_width();
+	case CTRL_PARAM_FRAME_PIXELS:	return acq_frame_pixels();
+	case CTRL_PARAM_SUM_FRAMES:	return frames;
+	case CTRL_PARAM_SUM_BITS:	return bits;
+	case CTRL_PARAM_CAL_ENABLE:	return acq_cal_enabled();
+	case CTRL_PARAM_SPARSE:		return udp_tx_config.sparse_threshold;
+	case CTRL_PARAM_BATCH_FRAMES:	return udp_tx_config.batch_frames;
+	case CTRL_PARAM_BATCH_FLUSH_US:	return udp_tx_config.batch_flush_us;
+	case CTRL_PARAM_RATE_KBPS:	return tx_pacer_rate();
+	case CTRL_PARAM_BURST_BYTES:	return tx_pacer_burst();
+	case CTRL_PARAM_MCAST_GROUP:	return ctrl_group(&ttl);
+	case CTRL_PARAM_MCAST_TTL:	ctrl_group(&ttl); return ttl;
+	case CTRL_PARAM_CONSUMERS:	return udp_stream_consumers();
+	case CTRL_PARAM_REPORT_MS:	return udp_tx_config.report_ms;
+	case CTRL_PARAM_SESSION_MS:	return udp_tx_config.session_ms;
+	case CTRL_PARAM_TELEM_MS:	return udp_tx_config.telem_ms;
+	}
+	return 0;
+}
+
+/* Check and stage one record. Returns a CTRL status. */
+static int ctrl_set(struct ctrl_staged *s, u16 id, u32 v)
+{
+	int threshold = (int)v;
+
+	switch (id) {
+	case CTRL_PARAM_ROI_X:
+	case CTRL_PARAM_ROI_Y:
+	case CTRL_PARAM_ROI_WIDTH:
+	case CTRL_PARAM_ROI_HEIGHT:
+		if (v > 0xffff)
+			return CTRL_E_RANGE;
+		if (id == CTRL_PARAM_ROI_X)
+			s->geometry.x = v;
+		else if (id == CTRL_PARAM_ROI_Y)
+			s->geometry.y = v;
+		else if (id == CTRL_PARAM_ROI_WIDTH)
+			s->geometry.width = v;
+		else
+			s->geometry.height = v;
+		s->geometry_set = 1;
+		break;
+	case CTRL_PARAM_BIN_X:
+	case CTRL_PARAM_BIN_Y:
+		if (v < 1 || v > ACQ_BIN_MAX)
+			return CTRL_E_RANGE;
+		if (id == CTRL_PARAM_BIN_X)
+			s->geometry.bin_x = v;
+		else
+			s->geometry.bin_y = v;
+		s->geometry_set = 1;
+		break;
+	case CTRL_PARAM_SENSOR_WIDTH:
+		if (v < 1 || v > 0xffff)
+			return CTRL_E_RANGE;
+		s->width = v;
+		s->size_set = 1;
+		break;
+	case CTRL_PARAM_FRAME_PIXELS:
+		if (v < 1)
+			return CTRL_E_RANGE;
+		s->pixels = v;
+		s->size_set = 1;
+		break;
+	case CTRL_PARAM_SUM_FRAMES:
+		if (v > ACQ_INTEGRATE_MAX)
+			return CTRL_E_RANGE;
+		s->sum_frames = v;
+		s->integration_set = 1;
+		break;
+	case CTRL_PARAM_SUM_BITS:
+		if (v != 16 && v != 32)
+			return CTRL_E_RANGE;
+		s->sum_bits = v;
+		s->integration_set = 1;
+		break;
+	case CTRL_PARAM_CAL_ENABLE:
+		if (v > 1)
+			return CTRL_E_RANGE;
+		s->cal_enable = v;
+		break;
+	case CTRL_PARAM_SPARSE:
+		if (threshold < -1 || threshold > 255)
+			return CTRL_E_RANGE;
+		s->config.sparse_threshold = threshold;
+		break;
+	case CTRL_PARAM_BATCH_FRAMES:
+		if (v < 1 || v > UDP_BATCH_FRAMES)
+			return CTRL_E_RANGE;
+		s->config.batch_frames = v;
+		break;
+	case CTRL_PARAM_BATCH_FLUSH_US:
+		s->config.batch_flush_us = v;
+		break;
+	case CTRL_PARAM_RATE_KBPS:
+		s->rate = v;
+		s->pacer_set = 1;
+		break;
+	case CTRL_PARAM_BURST_BYTES:
+		s->burst = v;
+		s->pacer_set = 1;
+		break;
+	case CTRL_PARAM_MCAST_GROUP:
+		if (v && (v >> 28) != 0xe)
+			return CTRL_E_RANGE;
+		s->group = v;
+		s->mcast_set = 1;
+		break;
+	case CTRL_PARAM_MCAST_TTL:
+		if (v < 1 || v > 255)
+			return CTRL_E_RANGE;
+		s->ttl = v;
+		s->mcast_set = 1;
+		break;
+	case CTRL_PARAM_REPORT_MS:
+		s->config.report_ms = v;
+		break;
+	case CTRL_PARAM_SESSION_MS:
+		s->config.session_ms = v;
+		break;
+	case CTRL_PARAM_TELEM_MS:
+		s->config.telem_ms = v;
+		break;
+	default:
+		return CTRL_E_READONLY;
+	}
+	return CTRL_OK;
+}
+
+/* Apply the records of a SET, reply holds the status and the failing id */
+static u32 ctrl_op_set(const u8 *body, u32 len, u8 *reply)
+{
+	const struct ctrl_param *param;
+	struct ctrl_staged s;
+	struct acq_geometry active, request = ctrl_request;
+	u32 width = acq_sensor_width(), pixels = acq_frame_pixels();
+	int status = CTRL_OK, resized = 0, placed = 0;
+	u16 id = 0;
+
+	if (len % CTRL_RECORD_SIZE) {
+		reply[0] = CTRL_E_LENGTH;
+		return 1;
+	}
+
+	memset(&s, 0, sizeof(s));
+	s.geometry = ctrl_request;
+	s.config = udp_tx_config;
+	s.cal_enable = acq_cal_enabled();
+	s.width = acq_sensor_width();
+	s.pixels = acq_frame_pixels();
+	acq_get_integration(&s.sum_frames, &s.sum_bits);
+	s.rate = tx_pacer_rate();
+	s.burst = tx_pacer_burst();
+	s.group = ctrl_group(&s.ttl);
+
+	for (; len && status == CTRL_OK; body += CTRL_RECORD_SIZE,
+			len -= CTRL_RECORD_SIZE) {
+		id = frame_get16(body);
+		param = ctrl_find(id);
+		if (!param)
+			status = CTRL_E_PARAM;
+		else if (param->type != body[2])
+			status = CTRL_E_TYPE;
+		else if (!param->writable)
+			status = CTRL_E_READONLY;
+		else
+			status = ctrl_set(&s, id, frame_get32(body + 3));
+	}
+
+	/* nothing is applied unless every record passed. The window is checked
+	 * against the staged frame size and a resize is refused while
+	 * streaming before anything changes. The group goes last, when lwIP
+	 * or a closed stream refuses it the frame size and the window are
+	 * undone, the calibration tables stay reset. */
+	active = s.geometry;
+	if (status == CTRL_OK && s.geometry_set &&
+			acq_check_geometry(&active, s.width, s.pixels)) {
+		status = CTRL_E_RANGE;
+		id = CTRL_PARAM_ROI_X;
+	}
+	if (status == CTRL_OK && s.size_set) {
+		status = ctrl_set_frame_size(s.width, s.pixels);
+		id = CTRL_PARAM_FRAME_PIXELS;
+		resized = status == CTRL_OK;
+	}
+	if (status == CTRL_OK && s.geometry_set) {
+		if (ctrl_set_geometry(&s.geometry, &active)) {
+			status = CTRL_E_RANGE;
+			id = CTRL_PARAM_ROI_X;
+		}
+		placed = status == CTRL_OK;
+	}
+	if (status == CTRL_OK && s.mcast_set &&
+			ctrl_set_group(s.group, s.ttl)) {
+		status = CTRL_E_BUSY;
+		id = CTRL_PARAM_MCAST_GROUP;
+	}
+	if (status != CTRL_OK && resized)
+		ctrl_set_frame_size(width, pixels);
+	if (status != CTRL_OK && (resized || placed))
+		ctrl_set_geometry(&request, &active);
+	if (status == CTRL_OK) {
+		if (s.integration_set)
+			acq_set_integration(s.sum_frames, s.sum_bits);
+		if (s.pacer_set)
+			tx_pacer_set(s.rate, s.burst);
+		acq_cal_enable(s.cal_enable);
+		udp_tx_config = s.config;
+	}
+
+	reply[0] = status;
+	if (status == CTRL_OK)
+		return 1;
+	frame_put16(reply + 1, id);
+	return 3;
+}
+
+/* Load calibration table entries, returns a CTRL status */
+static int ctrl_op_cal(const u8 *body, u32 len)
+{
+	u32 count = len - CTRL_CAL_HEADER;
+
+	if (len <= CTRL_CAL_HEADER ||
+			(body[0] == CTRL_CAL_GAIN && count % 2))
+		return CTRL_E_LENGTH;
+	if (body[0] == CTRL_CAL_DARK)
+		return acq_cal_load_dark(frame_get32(body + 1),
+				body + CTRL_CAL_HEADER, count) ?
+				CTRL_E_RANGE : CTRL_OK;
+	if (body[0] == CTRL_CAL_GAIN)
+		return acq_cal_load_gain(frame_get32(body + 1),
+				body + CTRL_CAL_HEADER, count / 2) ?
+				CTRL_E_RANGE : CTRL_OK;
+	return CTRL_E_RANGE;
+}
+
+/* Read the parameters asked for, all of them without ids */
+static u32 ctrl_op_get(const u8 *body, u32 len, u8 *reply)
+{
+	const struct ctrl_param *param;
+	u32 count = len ? len / 2 : CTRL_PARAM_COUNT, out = 1;
+
+	if (len % 2 || 1 + count * CTRL_RECORD_SIZE > CTRL_BODY_MAX) {
+		reply[0] = CTRL_E_LENGTH;
+		return 1;
+	}
+
+	for (u32 i = 0; i < count; i++) {
+		param = len ? ctrl_find(frame_get16(body + 2 * i)) :
+				&ctrl_params[i];
+		if (!param) {
+			reply[0] = CTRL_E_PARAM;
+			frame_put16(reply + 1, frame_get16(body + 2 * i));
+			return 3;
+		}
+		ctrl_record_put(reply + out, param->id, param->type,
+				ctrl_get(param->id));
+		out += CTRL_RECORD_SIZE;
+	}
+
+	reply[0] = CTRL_OK;
+	return out;
+}
+
+static void ctrl_binary(struct udp_pcb *pcb, const u8 *payload, u32 len,
+		const ip_addr_t *addr, u16_t port)
+{
+	u8 reply[CTRL_HEADER_SIZE + CTRL_BODY_MAX];
+	u8 *body = reply + CTRL_HEADER_SIZE;
+	struct ctrl_header h;
+	struct pbuf *p;
+	u32 out = 1;
+
+	if (ctrl_header_get(payload, len, &h)) {
+		/* too short to answer, or the tag may be garbage */
+		return;
+	}
+
+	body[0] = CTRL_OK;
+	if (h.version != CTRL_PROTO_VERSION) {
+		body[0] = CTRL_E_VERSION;
+	} else switch (h.opcode) {
+	case CTRL_OP_PING:
+		break;
+	case CTRL_OP_START:
+	case CTRL_OP_STOP:
+		if (h.len)
+			body[0] = CTRL_E_LENGTH;
+		else if (udp_stream_request(addr, port,
+				h.opcode == CTRL_OP_START))
+			body[0] = CTRL_E_BUSY;
+		break;
+	case CTRL_OP_SET:
+		out = ctrl_op_set(payload + CTRL_HEADER_SIZE, h.len, body);
+		break;
+	case CTRL_OP_GET:
+		out = ctrl_op_get(payload + CTRL_HEADER_SIZE, h.len, body);
+		break;
+	case CTRL_OP_CAL:
+		body[0] = ctrl_op_cal(payload + CTRL_HEADER_SIZE, h.len);
+		break;
+	default:
+		body[0] = CTRL_E_OPCODE;
+		break;
+	}
+
+	h.version = CTRL_PROTO_VERSION;
+	h.opcode |= CTRL_OP_REPLY;
+	h.len = out;
+	ctrl_header_put(reply, &h);
+
+	p = pbuf_alloc(PBUF_TRANSPORT, CTRL_HEADER_SIZE + out, PBUF_RAM);
+	if (!p) {
+		LOG(LOG_CTRL_PBUF);
+		return;
+	}
+	pbuf_take(p, reply, CTRL_HEADER_SIZE + out);
+	udp_sendto(pcb, p, addr, port);
+	pbuf_free(p);
+}
+
+/* Text commands, "start", "finish" and the settings, see README.txt.
+ * Table entries follow the terminating NUL of the command, in payload. */
+static void ctrl_text(char *string, const u8 *payload, u32 len,
+		const ip_addr_t *addr, u16_t port)
+{
+	if(!(strcmp(string, "start")))
+	{
+		if (udp_stream_request(addr, port, 1))
+			LOG(LOG_CMD_TOO_MANY);
+		else
+			LOG(LOG_CMD_START);
+	}
+	/*else if(!(strcmp(string, "tx")))
+	{
+		send_udp = 0;
+		//xil_printf("Ack received \r\n");
+	}*/
+	else if(!(strcmp(string, "finish")))
+	{
+		udp_stream_request(addr, port, 0);
+		if (udp_stream_consumers())
+			LOG(LOG_CMD_LEFT, udp_stream_consumers());
+		else
+			LOG(LOG_CMD_STOP);
+	}
+	else if(!(strncmp(string, "mcast ", 6)))
+	{
+		/* "mcast <group> [ttl]" streams to a multicast group, "mcast
+		 * off" to the server again */
+		ip_addr_t group;
+		char *ttl = strchr(string + 6, ' ');
+		u32 hops;
+
+		if (ttl)
+			*ttl++ = '\0';
+		if (!strcmp(string + 6, "off")) {
+			LOG(udp_stream_set_multicast(NULL, 0) ?
+					LOG_CMD_MCAST_INVALID : LOG_CMD_MCAST_OFF);
+		} else if (!inet_aton(string + 6, &group) ||
+				udp_stream_set_multicast(&group, ttl ?
+				strtoul(ttl, NULL, 10) : UDP_MCAST_TTL)) {
+			LOG(LOG_CMD_MCAST_INVALID);
+		} else {
+			udp_stream_multicast(&group, &hops);
+			LOG(LOG_CMD_MCAST, ip4_addr1(&group), ip4_addr2(&group),
+					ip4_addr3(&group), ip4_addr4(&group), hops);
+		}
+	}
+	else if(!(strncmp(string, "rate ", 5)))
+	{
+		/* "rate <kbit/s> [burst bytes]", a rate of 0 stops pacing */
+		char *end;
+		u32 rate = strtoul(string + 5, &end, 10);
+		u32 burst = strtoul(end, NULL, 10);
+
+		tx_pacer_set(rate, burst ? burst : tx_pacer_burst());
+		LOG(LOG_CMD_RATE, tx_pacer_rate(), tx_pacer_burst());
+	}
+	else if(!(strncmp(string, "roi", 3)) || !(strncmp(string, "bin ", 4)))
+	{
+		/* "roi [x y width height]" selects the readout window, without
+		 * arguments the whole sensor, "bin <columns> <rows>" the binning */
+		struct acq_geometry g = ctrl_request, active;
+		char *p = string + 3;
+
+		if (string[0] == 'r') {
+			g.x = strtoul(p, &p, 10);
+			g.y = strtoul(p, &p, 10);
+			g.width = strtoul(p, &p, 10);
+			g.height = strtoul(p, NULL, 10);
+		} else {
+			g.bin_x = strtoul(string + 4, &p, 10);
+			g.bin_y = strtoul(p, NULL, 10);
+		}
+
+		if (ctrl_set_geometry(&g, &active)) {
+			LOG(LOG_CMD_ROI_INVALID);
+		} else {
+			LOG(LOG_CMD_ROI, active.x, active.y, active.width,
+					active.height, active.bin_x, active.bin_y);
+		}
+	}
+	else if(!(strncmp(string, "frame ", 6)))
+	{
+		/* "frame <pixels> [width]", the frame size of a sensor of width
+		 * columns, a line sensor of pixels columns without it */
+		char *end;
+		u32 pixels = strtoul(string + 6, &end, 10);
+		u32 width = strtoul(end, NULL, 10);
+
+		if (ctrl_set_frame_size(width ? width : pixels, pixels) != CTRL_OK)
+			LOG(LOG_CMD_FRAME_INVALID);
+		else
+			LOG(LOG_CMD_FRAME, acq_frame_pixels(),
+					acq_sensor_width());
+	}
+	else if(!(strncmp(string, "sum ", 4)))
+	{
+		/* "sum <frames> [16|32]", send the sum of every frames frames in
+		 * sums of 16 (default) or 32 bits, "sum 1" sends single frames */
+		char *end;
+		u32 frames = strtoul(string + 4, &end, 10);
+		u32 bits = strtoul(end, NULL, 10);
+
+		if (acq_set_integration(frames, bits ? bits : 16))
+			LOG(LOG_CMD_SUM_INVALID);
+		else
+			LOG(LOG_CMD_SUM, frames > 1 ? frames : 1,
+					bits ? bits : 16);
+	}
+	else if(!(strncmp(string, "dark ", 5)) || !(strncmp(string, "gain ", 5)))
+	{
+		/* "dark <offset>" / "gain <offset>", the table entries follow the
+		 * terminating NUL: 8 bit offsets or big endian 4.12 gains */
+		u32 offset = strtoul(string + 5, NULL, 10);
+		const u8 *nul = memchr(payload, 0, len);
+		u32 count = nul ? len - (nul + 1 - payload) : 0;
+		int err;
+
+		if (!nul || (string[0] == 'g' && count % 2))
+			err = -1;
+		else if (string[0] == 'd')
+			err = acq_cal_load_dark(offset, nul + 1, count);
+		else
+			err = acq_cal_load_gain(offset, nul + 1, count / 2);
+		if (err)
+			LOG(LOG_CMD_CAL_TABLE_INVALID);
+	}
+	else if(!(strncmp(string, "cal ", 4)))
+	{
+		/* "cal on|off|reset|bench" */
+		if (!strcmp(string + 4, "on") || !strcmp(string + 4, "off")) {
+			acq_cal_enable(string[5] == 'n');
+			LOG(acq_cal_enabled() ? LOG_CMD_CAL_ON :
+					LOG_CMD_CAL_OFF);
+		} else if (!strcmp(string + 4, "reset")) {
+			acq_cal_reset();
+			LOG(LOG_CMD_CAL_RESET);
+		} else if (!strcmp(string + 4, "bench")) {
+			u32 neon, scalar;
+
+			acq_cal_bench(&neon, &scalar);
+			LOG(LOG_CMD_CAL_BENCH,
+					BUFFER_SIZE < acq_frame_pixels() ?
+					BUFFER_SIZE : acq_frame_pixels(), neon,
+					neon * 1000 / get_cycles_per_us(), scalar);
+		} else {
+			LOG(LOG_CMD_UNKNOWN);
+		}
+	}
+	else if(!(strncmp(string, "sparse ", 7)))
+	{
+		/* "sparse <threshold>|off", send only the pixels above threshold */
+		char *end;
+		int threshold = strtol(string + 7, &end, 10);
+
+		if (!strcmp(string + 7, "off")) {
+			udp_tx_config.sparse_threshold = -1;
+			LOG(LOG_CMD_SPARSE_OFF);
+		} else if (end == string + 7 || threshold < 0 || threshold > 255) {
+			LOG(LOG_CMD_SPARSE_INVALID);
+		} else {
+			udp_tx_config.sparse_threshold = threshold;
+			LOG(LOG_CMD_SPARSE, threshold);
+		}
+	}
+	else if(!(strcmp(string, "mem bench")))
+	{
+		/* "mem bench", what the placement of mem_place.h costs */
+		struct platform_mem_bench bench;
+
+		LOG(LOG_CMD_MEM_LAYOUT, FRAME_MEM, ISR_MEM, HOT_MEM,
+				OCM_NONCACHEABLE);
+		if (platform_mem_bench(&bench))
+			LOG(LOG_CMD_MEM_BUSY);
+		else
+			LOG(LOG_CMD_MEM_BENCH, bench.irq_warm, bench.irq_cold,
+					acq_frame_pixels(), bench.frame_maint,
+					bench.frame_read);
+	}
+	else if(!(strcmp(string, "probes")))
+	{
+		probe_dump();
+	}
+	else
+	{
+		LOG(LOG_CMD_UNKNOWN);
+	}
+}
+
+void ctrl_input(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
+		u16_t port)
+{
+	const u8 *payload = p->payload;
+	char string[CTRL_TEXT_MAX + 1];
+	u32 len = p->len;
+
+	if (len >= 2 && payload[0] == CTRL_MAGIC0 &&
+			payload[1] == CTRL_MAGIC1) {
+		ctrl_binary(pcb, payload, len, addr, port);
+		return;
+	}
+
+	/* the command ends at its NUL, or at the end of the datagram */
+	len = len < CTRL_TEXT_MAX ? len : CTRL_TEXT_MAX;
+	memcpy(string, payload, len);
+	string[len] = '\0';
+	ctrl_text(string, payload, p->len, addr, port);
+}
@@ -0,0 +1,22 @@
+/*
+ * control.h
+ *
+ * The command port. Datagrams from the server, or from every receiver of a
+ * multicast stream, reach it on the data PCB, either as binary requests
+ * (ctrl_proto.h), answered with an ack or nack, or as NUL terminated text
+ * commands, answered on the UART.
+ */
+
+#ifndef __CONTROL_H_
+#define __CONTROL_H_
+
+#include "lwip/udp.h"
+
+/* Longest text command, longer ones are cut there */
+#define CTRL_TEXT_MAX 64
+
+/* Handle one command datagram, p stays owned by the caller */
+void ctrl_input(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
+		u16_t port);
+
+#endif /* __CONTROL_H_ */
@@ -0,0 +1,164 @@
+/*
+ * ctrl_proto.h
+ *
+ * Binary control protocol of the command port. A request and its reply
+ * start with the same header, all fields in network byte order:
+ *
+ *  offset size field
+ *       0    2 magic 'M' 'C'
+ *       2    1 version
+ *       3    1 opcode (CTRL_OP_*), CTRL_OP_REPLY set in replies
+ *       4    2 tag, chosen by the host and echoed in the reply
+ *       6    2 body length in bytes
+ *
+ * The body of CTRL_OP_SET is a list of parameter records, the body of
+ * CTRL_OP_GET a list of 16 bit parameter ids, none for all parameters.
+ * A parameter record is
+ *
+ *       0    2 parameter id (CTRL_PARAM_*)
+ *       2    1 type (CTRL_TYPE_*), must match the type of the parameter
+ *       3    4 value, two's complement for CTRL_TYPE_I32
+ *
+ * The body of CTRL_OP_CAL loads entries of a calibration table
+ * (acquisition.h), sending the same body again loads the same entries:
+ *
+ *       0    1 table (CTRL_CAL_*)
+ *       1    4 first sensor pixel
+ *       5      entries up to the end of the body, 8 bit dark offsets or
+ *              big endian 16 bit 4.12 gains
+ *
+ * START and STOP act for the requester only while the stream goes to a
+ * multicast group, it runs as long as any receiver has it started.
+ *
+ * Every request is answered with a reply whose body starts with a status
+ * byte (CTRL_OK or CTRL_E_*). A SET applies all its records or none, the
+ * id of the failing record follows the status. A GET that succeeds returns
+ * the records of the parameters asked for.
+ *
+ * Text commands never start with the magic, so both share the port. This
+ * header is shared with the host tools and only depends on stdint.h.
+ */
+
+#ifndef __CTRL_PROTO_H_
+#define __CTRL_PROTO_H_
+
+#include <stdint.h>
+#include "frame_proto.h"
+
+#define CTRL_MAGIC0		'M'
+#define CTRL_MAGIC1		'C'
+#define CTRL_PROTO_VERSION	1
+#define CTRL_HEADER_SIZE	8
+#define CTRL_RECORD_SIZE	7
+/* Largest body of a request or reply */
+#define CTRL_BODY_MAX		512
+
+/* Opcodes */
+#define CTRL_OP_PING		0x01	/* empty ack, tells the board is alive */
+#define CTRL_OP_START		0x02	/* start streaming */
+#define CTRL_OP_STOP		0x03	/* stop streaming */
+#define CTRL_OP_SET		0x04
+#define CTRL_OP_GET		0x05
+#define CTRL_OP_CAL		0x06	/* load calibration table entries */
+#define CTRL_OP_REPLY		0x80
+
+/* Reply status */
+#define CTRL_OK			0
+#define CTRL_E_VERSION		1	/* unsupported protocol version */
+#define CTRL_E_OPCODE		2	/* unknown opcode */
+#define CTRL_E_LENGTH		3	/* body length does not fit the opcode */
+#define CTRL_E_PARAM		4	/* unknown parameter id */
+#define CTRL_E_TYPE		5	/* record type is not the parameter's */
+#define CTRL_E_RANGE		6	/* value out of range */
+#define CTRL_E_READONLY		7	/* the parameter cannot be set */
+#define CTRL_E_BUSY		8	/* not while frames are captured or sent */
+
+/* Calibration tables of CTRL_OP_CAL */
+#define CTRL_CAL_DARK		0
+#define CTRL_CAL_GAIN		1
+#define CTRL_CAL_HEADER		5
+
+/* Parameter types */
+#define CTRL_TYPE_U32		1
+#define CTRL_TYPE_I32		2
+#define CTRL_TYPE_BOOL		3
+#define CTRL_TYPE_IP4		4	/* IPv4 address, first byte highest */
+
+/*
+ * Parameters. The records of a SET are applied together once all of them
+ * passed, a SET with a failing record changes nothing. Beyond the range of
+ * each value, the readout window is checked against the frame size the SET
+ * leaves and refused with the id of CTRL_PARAM_ROI_X. A new frame size is
+ * refused with CTRL_E_BUSY while streaming, a new multicast group while
+ * streaming to another destination. A new frame size resets the window to
+ * the whole sensor and the calibration tables.
+ */
+/* frame size: readout window in sensor pixels (acquisition.h) */
+#define CTRL_PARAM_ROI_X		0x0001	/* u32 */
+#define CTRL_PARAM_ROI_Y		0x0002	/* u32 */
+#define CTRL_PARAM_ROI_WIDTH		0x0003	/* u32, 0 to the last column */
+#define CTRL_PARAM_ROI_HEIGHT		0x0004	/* u32, 0 to the last row */
+#define CTRL_PARAM_BIN_X		0x0005	/* u32 */
+#define CTRL_PARAM_BIN_Y		0x0006	/* u32 */
+#define CTRL_PARAM_SENSOR_WIDTH		0x0007	/* u32 columns */
+#define CTRL_PARAM_FRAME_PIXELS		0x0008	/* u32, sensor pixels */
+/* stream mode */
+#define CTRL_PARAM_SUM_FRAMES		0x0010	/* u32, 1 sends single frames */
+#define CTRL_PARAM_SUM_BITS		0x0011	/* u32, 16 or 32 */
+#define CTRL_PARAM_CAL_ENABLE		0x0012	/* bool */
+#define CTRL_PARAM_SPARSE		0x0013	/* i32 threshold, -1 off */
+/* batching and pacing */
+#define CTRL_PARAM_BATCH_FRAMES		0x0020	/* u32 */
+#define CTRL_PARAM_BATCH_FLUSH_US	0x0021	/* u32 */
+#define CTRL_PARAM_RATE_KBPS		0x0022	/* u32, 0 unpaced */
+#define CTRL_PARAM_BURST_BYTES		0x0023	/* u32 */
+/* multicast, the group and ttl of a SET are applied together */
+#define CTRL_PARAM_MCAST_GROUP		0x0024	/* ip4, 0 streams to the server */
+#define CTRL_PARAM_MCAST_TTL		0x0025	/* u32, 1 to 255 */
+#define CTRL_PARAM_CONSUMERS		0x0026	/* u32, read only */
+/* reporting */
+#define CTRL_PARAM_REPORT_MS		0x0030	/* u32, 0 no interim reports */
+#define CTRL_PARAM_SESSION_MS		0x0031	/* u32, 0 unlimited */
+#define CTRL_PARAM_TELEM_MS		0x0032	/* u32, 0 no telemetry */
+
+struct ctrl_header {
+	uint8_t version;
+	uint8_t opcode;
+	uint16_t tag;
+	uint16_t len;
+};
+
+static inline void ctrl_header_put(uint8_t *buf, const struct ctrl_header *h)
+{
+	buf[0] = CTRL_MAGIC0;
+	buf[1] = CTRL_MAGIC1;
+	buf[2] = h->version;
+	buf[3] = h->opcode;
+	frame_put16(buf + 4, h->tag);
+	frame_put16(buf + 6, h->len);
+}
+
+/* Returns -1 if buf does not start with a control header, or if len does
+ * not hold the body it announces */
+static inline int ctrl_header_get(const uint8_t *buf, uint32_t len,
+		struct ctrl_header *h)
+{
+	if (len < CTRL_HEADER_SIZE || buf[0] != CTRL_MAGIC0 ||
+			buf[1] != CTRL_MAGIC1)
+		return -1;
+	h->version = buf[2];
+	h->opcode = buf[3];
+	h->tag = frame_get16(buf + 4);
+	h->len = frame_get16(buf + 6);
+	return h->len > len - CTRL_HEADER_SIZE ? -1 : 0;
+}
+
+static inline void ctrl_record_put(uint8_t *buf, uint16_t id, uint8_t type,
+		uint32_t value)
+{
+	frame_put16(buf, id);
+	buf[2] = type;
+	frame_put32(buf + 3, value);
+}
+
+#endif /* __CTRL_PROTO_H_ */
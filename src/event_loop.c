@@ -0,0 +1,23 @@
+/*
+ * event_loop.c
+ *
+ * The event flags live with the other state the handlers share (HOT_MEM),
+ * the idle accounting is only updated by the main loop.
+ */
+
+#include "event_loop.h"
+#include "platform.h"
+#include "mem_place.h"
+
+volatile u32 event_flags HOT_DATA;
+struct event_stats event_stats;
+
+void event_wait(void)
+{
+	u32 slept = platform_sleep();
+
+	if (slept) {
+		event_stats.idle_cycles += slept;
+		event_stats.wakeups++;
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * event_loop.h
+ *
+ * Events the interrupt handlers post to the main loop. The main loop takes
+ * them all at once, handles them in priority order, frames before network
+ * input before console and timer housekeeping, and sleeps in
+ * platform_sleep() while nothing is pending instead of polling the EMAC.
+ * The time it sleeps is the idle time of the CPU, counted in event_stats.
+ *
+ * Events only say that something may need attention, the frame ring, the
+ * EMAC queue and the log ring remain what the main loop works from.
+ */
+
+#ifndef __EVENT_LOOP_H_
+#define __EVENT_LOOP_H_
+
+#include "xil_types.h"
+
+/* In the order the main loop handles them */
+#define EVENT_FRAME	(1 << 0)	/* a ring slot was committed or skipped */
+#define EVENT_TX	(1 << 1)	/* the send path deadline passed */
+#define EVENT_NET	(1 << 2)	/* the EMAC interrupted */
+#define EVENT_LOG	(1 << 3)	/* a message was posted to the log ring */
+#define EVENT_TICK	(1 << 4)	/* EVENT_TICK_MS passed */
+
+/* Period of the timer tick, how late telemetry and reports may be */
+#ifndef EVENT_TICK_MS
+#define EVENT_TICK_MS	10
+#endif
+
+struct event_stats {
+	u64 idle_cycles;	/* slept in platform_sleep() */
+	u64 wakeups;
+};
+
+extern struct event_stats event_stats;
+extern volatile u32 event_flags;
+
+/* Post events, from interrupt handlers or the main loop */
+static inline void event_post(u32 events)
+{
+	__atomic_fetch_or(&event_flags, events, __ATOMIC_RELEASE);
+}
+
+/* Whether events are waiting, platform_sleep() asks with interrupts off */
+static inline u32 event_pending(void)
+{
+	return __atomic_load_n(&event_flags, __ATOMIC_ACQUIRE);
+}
+
+/* Take the events posted since the last call */
+static inline u32 event_take(void)
+{
+	return __atomic_exchange_n(&event_flags, 0, __ATOMIC_ACQUIRE);
+}
+
+/* Sleep until the next interrupt, unless an event is pending */
+void event_wait(void);
+
+#endif /* __EVENT_LOOP_H_ */
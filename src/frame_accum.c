@@ -0,0 +1,186 @@
+/*
+ * frame_accum.c
+ *
+ * The NEON kernels add 16 pixels per iteration, widened to the sum width
+ * with saturating adds, and byte swap the sums with vrev while storing
+ * them. Saturation is detected at the store, a sum equal to the maximum
+ * of its width counts as saturated.
+ */
+
+#include <string.h>
+#include "frame_accum.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ACCUM_NEON 1
+#else
+#define ACCUM_NEON 0
+#endif
+
+void frame_accum_init(struct frame_accum *a, void *sums, uint32_t max_pixels)
+{
+	a->sums = sums;
+	a->max_pixels = max_pixels;
+	frame_accum_setup(a, 1, 2);
+}
+
+void frame_accum_setup(struct frame_accum *a, uint32_t frames,
+		uint32_t bytes)
+{
+	a->frames = frames ? frames : 1;
+	a->bytes = bytes == 4 ? 4 : 2;
+	a->pixels = 0;
+	a->count = 0;
+}
+
+static void accum_add16_scalar(uint16_t *s, const uint8_t *p, uint32_t n)
+{
+	uint32_t v;
+
+	for (uint32_t i = 0; i < n; i++) {
+		v = s[i] + p[i];
+		s[i] = v > 0xffff ? 0xffff : v;
+	}
+}
+
+static void accum_add32_scalar(uint32_t *s, const uint8_t *p, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++)
+		s[i] = s[i] + p[i] < s[i] ? 0xffffffff : s[i] + p[i];
+}
+
+static int accum_store16_scalar(uint8_t *out, const uint16_t *s, uint32_t n)
+{
+	int saturated = 0;
+
+	for (uint32_t i = 0; i < n; i++) {
+		frame_put16(out + 2 * i, s[i]);
+		saturated |= s[i] == 0xffff;
+	}
+	return saturated;
+}
+
+static int accum_store32_scalar(uint8_t *out, const uint32_t *s, uint32_t n)
+{
+	int saturated = 0;
+
+	for (uint32_t i = 0; i < n; i++) {
+		frame_put32(out + 4 * i, s[i]);
+		saturated |= s[i] == 0xffffffff;
+	}
+	return saturated;
+}
+
+#if ACCUM_NEON
+static void accum_add16(uint16_t *s, const uint8_t *p, uint32_t n)
+{
+	uint8x16_t px;
+	uint32_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		px = vld1q_u8(p + i);
+		vst1q_u16(s + i, vqaddq_u16(vld1q_u16(s + i),
+				vmovl_u8(vget_low_u8(px))));
+		vst1q_u16(s + i + 8, vqaddq_u16(vld1q_u16(s + i + 8),
+				vmovl_u8(vget_high_u8(px))));
+	}
+
+	if (i < n)
+		accum_add16_scalar(s + i, p + i, n - i);
+}
+
+static void accum_add32(uint32_t *s, const uint8_t *p, uint32_t n)
+{
+	uint8x16_t px;
+	uint16x8_t lo, hi;
+	uint32_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		px = vld1q_u8(p + i);
+		lo = vmovl_u8(vget_low_u8(px));
+		hi = vmovl_u8(vget_high_u8(px));
+		vst1q_u32(s + i, vqaddq_u32(vld1q_u32(s + i),
+				vmovl_u16(vget_low_u16(lo))));
+		vst1q_u32(s + i + 4, vqaddq_u32(vld1q_u32(s + i + 4),
+				vmovl_u16(vget_high_u16(lo))));
+		vst1q_u32(s + i + 8, vqaddq_u32(vld1q_u32(s + i + 8),
+				vmovl_u16(vget_low_u16(hi))));
+		vst1q_u32(s + i + 12, vqaddq_u32(vld1q_u32(s + i + 12),
+				vmovl_u16(vget_high_u16(hi))));
+	}
+
+	if (i < n)
+		accum_add32_scalar(s + i, p + i, n - i);
+}
+
+static int accum_store16(uint8_t *out, const uint16_t *s, uint32_t n)
+{
+	uint16x8_t v, sat = vdupq_n_u16(0);
+	uint32x2_t any;
+	uint32_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		v = vld1q_u16(s + i);
+		sat = vorrq_u16(sat, vceqq_u16(v, vdupq_n_u16(0xffff)));
+		vst1q_u8(out + 2 * i, vrev16q_u8(vreinterpretq_u8_u16(v)));
+	}
+
+	any = vreinterpret_u32_u16(vorr_u16(vget_low_u16(sat),
+			vget_high_u16(sat)));
+	any = vorr_u32(any, vrev64_u32(any));
+	return !!vget_lane_u32(any, 0) |
+			accum_store16_scalar(out + 2 * i, s + i, n - i);
+}
+
+static int accum_store32(uint8_t *out, const uint32_t *s, uint32_t n)
+{
+	uint32x4_t v, sat = vdupq_n_u32(0);
+	uint32x2_t any;
+	uint32_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		v = vld1q_u32(s + i);
+		sat = vorrq_u32(sat, vceqq_u32(v, vdupq_n_u32(0xffffffff)));
+		vst1q_u8(out + 4 * i, vrev32q_u8(vreinterpretq_u8_u32(v)));
+	}
+
+	any = vorr_u32(vget_low_u32(sat), vget_high_u32(sat));
+	any = vorr_u32(any, vrev64_u32(any));
+	return !!vget_lane_u32(any, 0) |
+			accum_store32_scalar(out + 4 * i, s + i, n - i);
+}
+#else
+#define accum_add16 accum_add16_scalar
+#define accum_add32 accum_add32_scalar
+#define accum_store16 accum_store16_scalar
+#define accum_store32 accum_store32_scalar
+#endif
+
+int frame_accum_add(struct frame_accum *a, const uint8_t *pixels, uint32_t n)
+{
+	if (n > a->max_pixels)
+		n = a->max_pixels;
+
+	if (!a->count || n != a->pixels) {
+		/* first frame, or the readout window changed */
+		memset(a->sums, 0, n * a->bytes);
+		a->pixels = n;
+		a->count = 0;
+	}
+
+	if (a->bytes == 2)
+		accum_add16(a->sums, pixels, n);
+	else
+		accum_add32(a->sums, pixels, n);
+
+	return ++a->count >= a->frames;
+}
+
+int frame_accum_store(struct frame_accum *a, uint8_t *out)
+{
+	a->count = 0;
+
+	if (a->bytes == 2)
+		return accum_store16(out, a->sums, a->pixels);
+	return accum_store32(out, a->sums, a->pixels);
+}
@@ -0,0 +1,48 @@
+/*
+ * frame_accum.h
+ *
+ * Integration of consecutive 8 bit frames into 16 or 32 bit sums per
+ * pixel. Sums saturate at the maximum of their width instead of wrapping,
+ * an integrated frame reports whether any pixel did. The stored sums are
+ * big endian, payload of FRAME_FMT_SUM16 / FRAME_FMT_SUM32.
+ */
+
+#ifndef __FRAME_ACCUM_H_
+#define __FRAME_ACCUM_H_
+
+#include <stdint.h>
+#include "frame_proto.h"
+
+struct frame_accum {
+	/* one sum per pixel, 16 byte aligned */
+	void *sums;
+	uint32_t max_pixels;
+	/* frames per integrated frame and bytes per sum, 2 or 4 */
+	uint32_t frames;
+	uint32_t bytes;
+	/* pixels of the frames being summed and how many are in */
+	uint32_t pixels;
+	uint32_t count;
+};
+
+/* sums holds 4 * max_pixels bytes */
+void frame_accum_init(struct frame_accum *a, void *sums, uint32_t max_pixels);
+
+/* Sum frames frames of bytes (2 or 4) per sum from now on */
+void frame_accum_setup(struct frame_accum *a, uint32_t frames,
+		uint32_t bytes);
+
+/*
+ * Add a frame of n pixels. A frame of a different size than the ones
+ * summed so far starts over. Returns 1 once the integrated frame is
+ * complete.
+ */
+int frame_accum_add(struct frame_accum *a, const uint8_t *pixels, uint32_t n);
+
+/*
+ * Store the complete integrated frame big endian at out, bytes * pixels
+ * bytes, and start the next one. Returns 1 if any sum saturated.
+ */
+int frame_accum_store(struct frame_accum *a, uint8_t *out);
+
+#endif /* __FRAME_ACCUM_H_ */
@@ -0,0 +1,37 @@
+/*
+ * frame_arena.c
+ *
+ * Bump allocator over a static array, placed by FRAME_MEM (mem_place.h).
+ */
+
+#include "frame_arena.h"
+
+#define ARENA_ROUND(n) (((n) + FRAME_ARENA_ALIGN - 1) & ~(FRAME_ARENA_ALIGN - 1))
+
+static u8 arena[FRAME_ARENA_SIZE] FRAME_DATA
+		__attribute__((aligned(FRAME_ARENA_ALIGN)));
+static u32 arena_used = 0;
+
+void frame_arena_reset(void)
+{
+	arena_used = 0;
+}
+
+void *frame_arena_alloc(u32 bytes)
+{
+	void *p;
+
+	if (bytes > FRAME_ARENA_SIZE - arena_used)
+		return NULL;
+
+	p = arena + arena_used;
+	arena_used += ARENA_ROUND(bytes);
+	if (arena_used > FRAME_ARENA_SIZE)
+		arena_used = FRAME_ARENA_SIZE;
+	return p;
+}
+
+u32 frame_arena_left(void)
+{
+	return FRAME_ARENA_SIZE - arena_used;
+}
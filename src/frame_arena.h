@@ -0,0 +1,40 @@
+/*
+ * frame_arena.h
+ *
+ * Preallocated memory region the frame buffers and the per-pixel work buffers
+ * are carved from when the frame size is set, so the frame size is a run
+ * time setting bounded only by FRAME_ARENA_SIZE. Allocations are never
+ * freed one by one, the whole arena is reset and carved again for a new
+ * frame size while acquisition is stopped.
+ */
+
+#ifndef __FRAME_ARENA_H_
+#define __FRAME_ARENA_H_
+
+#include "xil_types.h"
+#include "mem_place.h"
+
+/* Bytes of the arena, in OCM (mem_place.h) it shares the 192 KB with the
+ * code and data placed there */
+#ifndef FRAME_ARENA_SIZE
+#if FRAME_MEM == MEM_OCM
+#define FRAME_ARENA_SIZE (128 * 1024)
+#else
+#define FRAME_ARENA_SIZE (8 * 1024 * 1024)
+#endif
+#endif
+
+/* Alignment of every allocation, the cache line, so buffers can be DMA
+ * targets and cache maintenance never touches a neighbour */
+#define FRAME_ARENA_ALIGN 32
+
+void frame_arena_reset(void);
+
+/* Returns bytes of memory aligned to FRAME_ARENA_ALIGN, NULL when the arena
+ * is exhausted */
+void *frame_arena_alloc(u32 bytes);
+
+/* Bytes still available */
+u32 frame_arena_left(void);
+
+#endif /* __FRAME_ARENA_H_ */
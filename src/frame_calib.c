@@ -0,0 +1,67 @@
+/*
+ * frame_calib.c
+ *
+ * The NEON kernel corrects 16 pixels per iteration: a saturating subtract
+ * of the dark offsets, a widening 16 x 16 bit multiply by the gains, and a
+ * rounding, saturating narrow back to 8 bits in two steps.
+ */
+
+#include "frame_calib.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CALIB_NEON 1
+#else
+#define CALIB_NEON 0
+#endif
+
+void frame_calib_apply_scalar(uint8_t *pixels, const uint8_t *dark,
+		const uint16_t *gain, uint32_t n)
+{
+	uint32_t v;
+
+	for (uint32_t i = 0; i < n; i++) {
+		v = pixels[i] > dark[i] ? pixels[i] - dark[i] : 0;
+		v = (v * gain[i] + (FRAME_CALIB_GAIN_ONE >> 1)) >>
+				FRAME_CALIB_GAIN_SHIFT;
+		pixels[i] = v > 255 ? 255 : v;
+	}
+}
+
+#if CALIB_NEON
+static inline uint8x8_t calib_scale(uint8x8_t d, uint16x8_t g)
+{
+	uint16x8_t d16 = vmovl_u8(d);
+	uint32x4_t lo, hi;
+
+	lo = vmull_u16(vget_low_u16(d16), vget_low_u16(g));
+	hi = vmull_u16(vget_high_u16(d16), vget_high_u16(g));
+	return vqmovn_u16(vcombine_u16(
+			vqrshrn_n_u32(lo, FRAME_CALIB_GAIN_SHIFT),
+			vqrshrn_n_u32(hi, FRAME_CALIB_GAIN_SHIFT)));
+}
+
+void frame_calib_apply(uint8_t *pixels, const uint8_t *dark,
+		const uint16_t *gain, uint32_t n)
+{
+	uint8x16_t d;
+	uint32_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		d = vqsubq_u8(vld1q_u8(pixels + i), vld1q_u8(dark + i));
+		vst1q_u8(pixels + i, vcombine_u8(
+				calib_scale(vget_low_u8(d), vld1q_u16(gain + i)),
+				calib_scale(vget_high_u8(d),
+						vld1q_u16(gain + i + 8))));
+	}
+
+	if (i < n)
+		frame_calib_apply_scalar(pixels + i, dark + i, gain + i, n - i);
+}
+#else
+void frame_calib_apply(uint8_t *pixels, const uint8_t *dark,
+		const uint16_t *gain, uint32_t n)
+{
+	frame_calib_apply_scalar(pixels, dark, gain, n);
+}
+#endif
@@ -0,0 +1,29 @@
+/*
+ * frame_calib.h
+ *
+ * Dark frame subtraction and flat field correction of 8 bit pixels, shared
+ * by the board and the host tools. A corrected pixel is
+ *
+ *	(pixel - dark) * gain / FRAME_CALIB_GAIN_ONE
+ *
+ * rounded and clamped to 0..255, with one dark offset (8 bit) and one gain
+ * (unsigned 4.12 fixed point, 16 bit) per sensor pixel.
+ */
+
+#ifndef __FRAME_CALIB_H_
+#define __FRAME_CALIB_H_
+
+#include <stdint.h>
+
+#define FRAME_CALIB_GAIN_SHIFT	12
+#define FRAME_CALIB_GAIN_ONE	(1u << FRAME_CALIB_GAIN_SHIFT)
+
+/* Correct n pixels in place */
+void frame_calib_apply(uint8_t *pixels, const uint8_t *dark,
+		const uint16_t *gain, uint32_t n);
+
+/* The same without NEON, the reference the benchmarks compare against */
+void frame_calib_apply_scalar(uint8_t *pixels, const uint8_t *dark,
+		const uint16_t *gain, uint32_t n);
+
+#endif /* __FRAME_CALIB_H_ */
@@ -0,0 +1,375 @@
+/*
+ * frame_codec.c
+ *
+ * The residual pass runs 32 pixels at a time on NEON when the compiler
+ * targets it (-mfpu=neon on the board) and produces the per-block sums the
+ * Rice parameter is chosen from, the bit packing is scalar with a 64 bit
+ * accumulator that is stored a word at a time. The Cortex-A9 has no
+ * divider, so full blocks derive k from a shift of their sum.
+ */
+
+#include <string.h>
+#include "frame_codec.h"
+#include "frame_pack.h"
+#include "frame_sparse.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CODEC_NEON 1
+#else
+#define CODEC_NEON 0
+#endif
+
+/* Longest code: CODEC_ESCAPE ones and 8 raw bits */
+#define CODEC_MAX_CODE_BITS	(CODEC_ESCAPE + 8)
+/* Worst case bytes of one block, including a flushed partial word */
+#define CODEC_MAX_BLOCK_BYTES \
+	((CODEC_K_BITS + CODEC_BLOCK * CODEC_MAX_CODE_BITS) / 8 + 8)
+
+struct bit_writer {
+	uint8_t *out;
+	uint32_t pos;
+	uint64_t acc;
+	uint32_t nbits;
+};
+
+struct bit_reader {
+	const uint8_t *in;
+	uint32_t pos;
+	uint32_t len;
+	/* next bits top aligned */
+	uint64_t acc;
+	uint32_t nbits;
+};
+
+void frame_codec_init(struct frame_codec *c, void *work, uint32_t max_pixels,
+		uint32_t key_interval)
+{
+	uint8_t *mem = work;
+
+	c->sums = (uint16_t *)mem;
+	mem += CODEC_ALIGN16(2 * CODEC_BLOCKS(max_pixels));
+	c->ref = mem;
+	mem += CODEC_ALIGN16(max_pixels);
+	c->pred = mem;
+	mem += CODEC_ALIGN16(max_pixels);
+	c->res = mem;
+
+	c->max_pixels = max_pixels;
+	c->key_interval = key_interval;
+	frame_codec_reset(c);
+}
+
+void frame_codec_reset(struct frame_codec *c)
+{
+	c->ref_valid = 0;
+	c->ref_len = 0;
+	c->ref_sequence = 0;
+	c->since_key = 0;
+}
+
+static inline uint8_t codec_zigzag(uint8_t cur, uint8_t pred)
+{
+	uint8_t d = cur - pred;
+
+	return (uint8_t)((d << 1) ^ -(d >> 7));
+}
+
+static inline uint8_t codec_unzigzag(uint8_t z)
+{
+	return (uint8_t)((z >> 1) ^ -(z & 1));
+}
+
+static void codec_residuals_scalar(uint8_t *res, uint16_t *sums,
+		const uint8_t *cur, const uint8_t *pred, uint32_t n)
+{
+	uint32_t i, end, sum;
+
+	for (i = 0; i < n; i = end) {
+		end = i + CODEC_BLOCK < n ? i + CODEC_BLOCK : n;
+		sum = 0;
+		for (; i < end; i++) {
+			res[i] = codec_zigzag(cur[i], pred[i]);
+			sum += res[i];
+		}
+		*sums++ = (uint16_t)sum;
+	}
+}
+
+#if CODEC_NEON
+static inline uint8x16_t codec_zigzag_q(uint8x16_t cur, uint8x16_t pred)
+{
+	int8x16_t d = vreinterpretq_s8_u8(vsubq_u8(cur, pred));
+
+	return vreinterpretq_u8_s8(veorq_s8(vshlq_n_s8(d, 1),
+			vshrq_n_s8(d, 7)));
+}
+
+static void codec_residuals(uint8_t *res, uint16_t *sums,
+		const uint8_t *cur, const uint8_t *pred, uint32_t n)
+{
+	uint8x16_t z0, z1;
+	uint16x8_t s16;
+	uint32x4_t s32;
+	uint32x2_t s;
+	uint32_t i;
+
+	for (i = 0; i + CODEC_BLOCK <= n; i += CODEC_BLOCK) {
+		z0 = codec_zigzag_q(vld1q_u8(cur + i), vld1q_u8(pred + i));
+		z1 = codec_zigzag_q(vld1q_u8(cur + i + 16),
+				vld1q_u8(pred + i + 16));
+		vst1q_u8(res + i, z0);
+		vst1q_u8(res + i + 16, z1);
+
+		s16 = vpadalq_u8(vpaddlq_u8(z0), z1);
+		s32 = vpaddlq_u16(s16);
+		s = vadd_u32(vget_low_u32(s32), vget_high_u32(s32));
+		s = vpadd_u32(s, s);
+		*sums++ = (uint16_t)vget_lane_u32(s, 0);
+	}
+
+	if (i < n)
+		codec_residuals_scalar(res + i, sums, cur + i, pred + i, n - i);
+}
+#else
+#define codec_residuals codec_residuals_scalar
+#endif
+
+/* Rice parameter near log2 of the mean residual */
+static inline uint32_t codec_k(uint32_t sum, uint32_t count)
+{
+	uint32_t mean, k;
+
+	mean = count == CODEC_BLOCK ? sum / CODEC_BLOCK : sum / count;
+	if (!mean)
+		return 0;
+
+	k = 31 - __builtin_clz(mean);
+	return k > CODEC_K_MAX ? CODEC_K_MAX : k;
+}
+
+static inline void bw_put(struct bit_writer *w, uint32_t code, uint32_t len)
+{
+	w->acc = (w->acc << len) | code;
+	w->nbits += len;
+	if (w->nbits >= 32) {
+		w->nbits -= 32;
+		frame_put32(w->out + w->pos, (uint32_t)(w->acc >> w->nbits));
+		w->pos += 4;
+	}
+}
+
+static void bw_flush(struct bit_writer *w)
+{
+	uint32_t bits;
+
+	if (!w->nbits)
+		return;
+
+	/* pad the last byte with zeros */
+	bits = (uint32_t)(w->acc << (32 - w->nbits));
+	while (w->nbits) {
+		w->out[w->pos++] = bits >> 24;
+		bits <<= 8;
+		w->nbits = w->nbits > 8 ? w->nbits - 8 : 0;
+	}
+}
+
+/* Returns the bytes written, 0 if they would exceed max */
+static uint32_t codec_rice_encode(uint8_t *out, uint32_t max,
+		const uint8_t *res, const uint16_t *sums, uint32_t n)
+{
+	struct bit_writer w = { out, 0, 0, 0 };
+	uint32_t i, end, k, v, q;
+
+	for (i = 0; i < n; i = end) {
+		if (w.pos + CODEC_MAX_BLOCK_BYTES > max)
+			return 0;
+
+		end = i + CODEC_BLOCK < n ? i + CODEC_BLOCK : n;
+		if (!*sums) {
+			/* nothing changed, typical of a static scene */
+			sums++;
+			bw_put(&w, CODEC_K_ZERO, CODEC_K_BITS);
+			continue;
+		}
+		k = codec_k(*sums++, end - i);
+		bw_put(&w, k, CODEC_K_BITS);
+
+		for (; i < end; i++) {
+			v = res[i];
+			q = v >> k;
+			if (q < CODEC_ESCAPE) {
+				bw_put(&w, (((1u << q) - 1) << (k + 1)) |
+						(v & ((1u << k) - 1)), q + 1 + k);
+			} else {
+				bw_put(&w, (((1u << CODEC_ESCAPE) - 1) << 8) | v,
+						CODEC_ESCAPE + 8);
+			}
+		}
+	}
+
+	bw_flush(&w);
+	return w.pos;
+}
+
+static inline void br_refill(struct bit_reader *r)
+{
+	while (r->nbits <= 56) {
+		/* zeros past the end, overreading is caught by the caller */
+		if (r->pos < r->len)
+			r->acc |= (uint64_t)r->in[r->pos] << (56 - r->nbits);
+		r->pos++;
+		r->nbits += 8;
+	}
+}
+
+/* 1 to 32 bits */
+static inline uint32_t br_get(struct bit_reader *r, uint32_t n)
+{
+	uint32_t v = (uint32_t)(r->acc >> (64 - n));
+
+	r->acc <<= n;
+	r->nbits -= n;
+	return v;
+}
+
+static int codec_rice_decode(uint8_t *res, uint32_t n, const uint8_t *in,
+		uint32_t len)
+{
+	struct bit_reader r = { in, 0, len, 0, 0 };
+	uint32_t i, end, k, q, top;
+
+	for (i = 0; i < n; i = end) {
+		br_refill(&r);
+		k = br_get(&r, CODEC_K_BITS);
+		end = i + CODEC_BLOCK < n ? i + CODEC_BLOCK : n;
+		if (k == CODEC_K_ZERO) {
+			memset(res + i, 0, end - i);
+			continue;
+		}
+
+		for (; i < end; i++) {
+			br_refill(&r);
+			/* count the leading ones, at most CODEC_ESCAPE */
+			top = (uint32_t)(r.acc >> 32);
+			q = __builtin_clz(~top | (1u << (31 - CODEC_ESCAPE)));
+			if (q < CODEC_ESCAPE) {
+				br_get(&r, q + 1);
+				res[i] = (uint8_t)((q << k) |
+						(k ? br_get(&r, k) : 0));
+			} else {
+				br_get(&r, CODEC_ESCAPE);
+				res[i] = (uint8_t)br_get(&r, 8);
+			}
+		}
+
+		/* consumed more bits than the payload holds */
+		if ((uint64_t)r.pos * 8 - r.nbits > (uint64_t)len * 8)
+			return -1;
+	}
+
+	return 0;
+}
+
+uint32_t frame_codec_encode(struct frame_codec *c, uint8_t *buf, uint32_t n,
+		uint32_t sequence, uint16_t *format, uint16_t *flags)
+{
+	const uint8_t *pred;
+	uint32_t len;
+	int key;
+
+	*format = FRAME_FMT_RAW8;
+	if (n > c->max_pixels || n <= CODEC_PAYLOAD_HEADER) {
+		/* the next delta would refer to a frame the codec did not keep */
+		c->ref_valid = 0;
+		return n;
+	}
+
+	key = !c->ref_valid || c->ref_len != n ||
+			(c->key_interval && c->since_key >= c->key_interval);
+	if (key) {
+		c->pred[0] = 0;
+		memcpy(c->pred + 1, buf, n - 1);
+		pred = c->pred;
+	} else {
+		pred = c->ref;
+	}
+
+	codec_residuals(c->res, c->sums, buf, pred, n);
+	memcpy(c->ref, buf, n);
+	c->ref_len = n;
+	c->ref_valid = 1;
+
+	/* coded output has to be smaller than the raw pixels */
+	len = codec_rice_encode(buf + CODEC_PAYLOAD_HEADER,
+			n - CODEC_PAYLOAD_HEADER - 1, c->res, c->sums, n);
+	if (!len) {
+		/* the raw frame is the reference of the next one */
+		memcpy(buf, c->ref, n);
+		c->ref_sequence = sequence;
+		c->since_key = 1;
+		return n;
+	}
+
+	frame_put32(buf, key ? sequence : c->ref_sequence);
+	c->ref_sequence = sequence;
+	c->since_key = key ? 1 : c->since_key + 1;
+
+	*format = FRAME_FMT_RICE;
+	if (key)
+		*flags |= FRAME_FLAG_KEY;
+	return len + CODEC_PAYLOAD_HEADER;
+}
+
+int frame_codec_decode(struct frame_codec *c, const struct frame_header *h,
+		const uint8_t *payload, uint8_t *pixels)
+{
+	uint32_t n = h->pixel_count;
+	uint8_t p = 0;
+
+	if (h->format == FRAME_FMT_RAW8) {
+		if (h->payload_len < n)
+			return -1;
+		memcpy(pixels, payload, n);
+	} else if (FRAME_FMT_IS_PACKED(h->format)) {
+		if (frame_unpack(pixels, payload, h->payload_len, n,
+				FRAME_FMT_PACKED_BITS(h->format)))
+			return -1;
+	} else if (h->format == FRAME_FMT_SPARSE) {
+		/* the board codes sparse frames without touching its reference */
+		return frame_sparse_decode(pixels, n, payload, h->payload_len);
+	} else if (h->format == FRAME_FMT_RICE) {
+		if (n > c->max_pixels || h->payload_len < CODEC_PAYLOAD_HEADER)
+			return -1;
+		if (!(h->flags & FRAME_FLAG_KEY) && (!c->ref_valid ||
+				c->ref_len != n ||
+				c->ref_sequence != frame_get32(payload)))
+			return -1;
+		if (codec_rice_decode(c->res, n, payload + CODEC_PAYLOAD_HEADER,
+				h->payload_len - CODEC_PAYLOAD_HEADER))
+			return -1;
+
+		if (h->flags & FRAME_FLAG_KEY) {
+			for (uint32_t i = 0; i < n; i++) {
+				p += codec_unzigzag(c->res[i]);
+				pixels[i] = p;
+			}
+		} else {
+			for (uint32_t i = 0; i < n; i++)
+				pixels[i] = c->ref[i] + codec_unzigzag(c->res[i]);
+		}
+	} else {
+		return -1;
+	}
+
+	if (n <= c->max_pixels) {
+		memcpy(c->ref, pixels, n);
+		c->ref_len = n;
+		c->ref_sequence = h->sequence;
+		c->ref_valid = 1;
+	} else {
+		c->ref_valid = 0;
+	}
+	return 0;
+}
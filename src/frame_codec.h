@@ -0,0 +1,83 @@
+/*
+ * frame_codec.h
+ *
+ * Lossless temporal delta coding of 8 bit frames, shared by the board and
+ * the host tools.
+ *
+ * A FRAME_FMT_RICE payload starts with the big endian sequence number of
+ * the reference frame, followed by a bit stream (MSB first) of residual
+ * blocks. A delta frame codes pixel - reference pixel, a key frame
+ * (FRAME_FLAG_KEY) pixel - left neighbour and needs no reference. Residuals
+ * are taken modulo 256 and zigzag mapped to 0..255, every block of
+ * CODEC_BLOCK residuals starts with its 3 bit Rice parameter k and codes
+ * each residual v as v >> k in unary (ones ended by a zero) and the low k
+ * bits of v. A unary part of CODEC_ESCAPE ones is followed by v in 8 bits.
+ * k = CODEC_K_ZERO marks a block of zero residuals with nothing following.
+ *
+ * The encoder falls back to FRAME_FMT_RAW8 when coding does not make the
+ * frame smaller, a raw frame is a valid reference for the next delta frame.
+ */
+
+#ifndef __FRAME_CODEC_H_
+#define __FRAME_CODEC_H_
+
+#include <stdint.h>
+#include "frame_proto.h"
+
+/* Residuals sharing one Rice parameter */
+#define CODEC_BLOCK		32
+#define CODEC_K_BITS		3
+#define CODEC_K_MAX		6
+#define CODEC_K_ZERO		7
+#define CODEC_ESCAPE		12
+/* Reference sequence in front of the bit stream */
+#define CODEC_PAYLOAD_HEADER	4
+
+#define CODEC_BLOCKS(n)		(((n) + CODEC_BLOCK - 1) / CODEC_BLOCK)
+#define CODEC_ALIGN16(n)	(((n) + 15) & ~15u)
+
+/* Bytes of work memory, 16 byte aligned, for frames of up to n pixels */
+#define FRAME_CODEC_WORK_SIZE(n) \
+	(CODEC_ALIGN16(2 * CODEC_BLOCKS(n)) + 3 * CODEC_ALIGN16(n))
+
+struct frame_codec {
+	/* pixels of the last frame coded or decoded */
+	uint8_t *ref;
+	uint32_t ref_len;
+	uint32_t ref_sequence;
+	int ref_valid;
+	/* left neighbour predictor of a key frame */
+	uint8_t *pred;
+	/* zigzag residuals and their sum per block */
+	uint8_t *res;
+	uint16_t *sums;
+	uint32_t max_pixels;
+	/* encoder: a key frame every key_interval frames, 0 only the first */
+	uint32_t key_interval;
+	uint32_t since_key;
+};
+
+void frame_codec_init(struct frame_codec *c, void *work, uint32_t max_pixels,
+		uint32_t key_interval);
+
+/* Forget the reference, the next frame is coded as a key frame */
+void frame_codec_reset(struct frame_codec *c);
+
+/*
+ * Code the n pixels in buf in place, buf is left holding the payload.
+ * Returns the payload length and sets *format, FRAME_FLAG_KEY is added to
+ * *flags for a key frame. A frame that does not get smaller stays raw.
+ */
+uint32_t frame_codec_encode(struct frame_codec *c, uint8_t *buf, uint32_t n,
+		uint32_t sequence, uint16_t *format, uint16_t *flags);
+
+/*
+ * Reconstruct the h->pixel_count pixels of a RAW8, RICE, packed or sparse
+ * payload. Returns 0, or -1 if the payload is corrupt or its reference
+ * frame was not the last one decoded (lost frame), decoding resumes with
+ * the next key frame.
+ */
+int frame_codec_decode(struct frame_codec *c, const struct frame_header *h,
+		const uint8_t *payload, uint8_t *pixels);
+
+#endif /* __FRAME_CODEC_H_ */
@@ -0,0 +1,190 @@
+/*
+ * frame_pack.c
+ *
+ * The NEON kernels work on 16 pixels, two groups of 8 pixels / N bytes, at
+ * a time. Packing merges neighbours in three widening steps (8 -> 16 -> 32
+ * -> 64 bit lanes) until each 64 bit lane holds the 8N bits of a group,
+ * which is then byte reversed and stored with two overlapping 8 byte
+ * stores. Unpacking runs the same steps backwards with narrowing moves. The
+ * scalar versions pack through a 64 bit accumulator and unpack a group of
+ * 8 pixels from one word, they handle the tails and other targets.
+ */
+
+#include <string.h>
+#include "frame_proto.h"
+#include "frame_pack.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PACK_NEON 1
+#else
+#define PACK_NEON 0
+#endif
+
+static uint32_t pack_scalar(uint8_t *out, const uint8_t *in, uint32_t n,
+		uint32_t bits)
+{
+	uint32_t mask = (1u << bits) - 1;
+	uint32_t nbits = 0, pos = 0, i, last;
+	uint64_t acc = 0;
+
+	for (i = 0; i < n; i++) {
+		acc = (acc << bits) | (in[i] & mask);
+		nbits += bits;
+		if (nbits >= 32) {
+			nbits -= 32;
+			frame_put32(out + pos, (uint32_t)(acc >> nbits));
+			pos += 4;
+		}
+	}
+
+	/* zero padded last bytes */
+	if (nbits) {
+		last = (uint32_t)(acc << (32 - nbits));
+		for (; nbits; nbits = nbits > 8 ? nbits - 8 : 0) {
+			out[pos++] = last >> 24;
+			last <<= 8;
+		}
+	}
+
+	return pos;
+}
+
+static void unpack_scalar(uint8_t *out, const uint8_t *in, uint32_t n,
+		uint32_t bits)
+{
+	uint32_t mask = (1u << bits) - 1;
+	uint32_t i, j, bytes;
+	uint64_t v;
+
+	for (i = 0; i + 8 <= n; i += 8, in += bits) {
+		v = 0;
+		for (j = 0; j < bits; j++)
+			v = v << 8 | in[j];
+		for (j = 0; j < 8; j++)
+			out[i + j] = (v >> (bits * (7 - j))) & mask;
+	}
+
+	if (i < n) {
+		bytes = FRAME_PACK_LEN(n - i, bits);
+		v = 0;
+		for (j = 0; j < bytes; j++)
+			v = v << 8 | in[j];
+		for (j = 0; i + j < n; j++)
+			out[i + j] = (v >> (bytes * 8 - bits * (j + 1))) & mask;
+	}
+}
+
+#if PACK_NEON
+uint32_t frame_pack(uint8_t *out, const uint8_t *in, uint32_t n,
+		uint32_t bits)
+{
+	const uint8x16_t mask = vdupq_n_u8((1u << bits) - 1);
+	const int16x8_t sh1 = vdupq_n_s16(bits);
+	const int32x4_t sh2 = vdupq_n_s32(2 * bits);
+	const int64x2_t sh4 = vdupq_n_s64(4 * bits);
+	const int64x2_t top = vdupq_n_s64(64 - 8 * bits);
+	uint8x16_t p;
+	uint8x8x2_t p1;
+	uint16x8_t pairs;
+	uint16x4x2_t p2;
+	uint32x4_t quads;
+	uint32x2x2_t p4;
+	uint64x2_t groups;
+	uint32_t i, pos = 0;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		p = vandq_u8(vld1q_u8(in + i), mask);
+
+		/* (p0 << N) | p1, (p2 << N) | p3, ... */
+		p1 = vuzp_u8(vget_low_u8(p), vget_high_u8(p));
+		pairs = vorrq_u16(vshlq_u16(vmovl_u8(p1.val[0]), sh1),
+				vmovl_u8(p1.val[1]));
+
+		p2 = vuzp_u16(vget_low_u16(pairs), vget_high_u16(pairs));
+		quads = vorrq_u32(vshlq_u32(vmovl_u16(p2.val[0]), sh2),
+				vmovl_u16(p2.val[1]));
+
+		p4 = vuzp_u32(vget_low_u32(quads), vget_high_u32(quads));
+		groups = vorrq_u64(vshlq_u64(vmovl_u32(p4.val[0]), sh4),
+				vmovl_u32(p4.val[1]));
+
+		/* MSB first in memory, N valid bytes per group */
+		p = vrev64q_u8(vreinterpretq_u8_u64(vshlq_u64(groups, top)));
+		vst1_u8(out + pos, vget_low_u8(p));
+		vst1_u8(out + pos + bits, vget_high_u8(p));
+		pos += 2 * bits;
+	}
+
+	if (i < n)
+		pos += pack_scalar(out + pos, in + i, n - i, bits);
+	return pos;
+}
+
+static uint32_t unpack_neon(uint8_t *out, const uint8_t *in, uint32_t len,
+		uint32_t n, uint32_t bits)
+{
+	const int64x2_t down = vdupq_n_s64(-(int64_t)(64 - 8 * bits));
+	const int64x2_t sh4 = vdupq_n_s64(-(int64_t)(4 * bits));
+	const uint64x2_t mask4 = vdupq_n_u64((1ull << (4 * bits)) - 1);
+	const int32x4_t sh2 = vdupq_n_s32(-(int32_t)(2 * bits));
+	const uint32x4_t mask2 = vdupq_n_u32((1u << (2 * bits)) - 1);
+	const int16x8_t sh1 = vdupq_n_s16(-(int16_t)bits);
+	const uint16x8_t mask1 = vdupq_n_u16((1u << bits) - 1);
+	uint64x2_t groups;
+	uint32x2x2_t q;
+	uint32x4_t quads;
+	uint16x4x2_t p2;
+	uint16x8_t pairs;
+	uint8x8x2_t p1;
+	uint32_t i, pos = 0;
+
+	/* the second load reads 8 bytes from pos + N */
+	for (i = 0; i + 16 <= n && pos + bits + 8 <= len; i += 16) {
+		groups = vreinterpretq_u64_u8(vrev64q_u8(vcombine_u8(
+				vld1_u8(in + pos), vld1_u8(in + pos + bits))));
+		groups = vshlq_u64(groups, down);
+
+		q = vzip_u32(vmovn_u64(vshlq_u64(groups, sh4)),
+				vmovn_u64(vandq_u64(groups, mask4)));
+		quads = vcombine_u32(q.val[0], q.val[1]);
+
+		p2 = vzip_u16(vmovn_u32(vshlq_u32(quads, sh2)),
+				vmovn_u32(vandq_u32(quads, mask2)));
+		pairs = vcombine_u16(p2.val[0], p2.val[1]);
+
+		p1 = vzip_u8(vmovn_u16(vshlq_u16(pairs, sh1)),
+				vmovn_u16(vandq_u16(pairs, mask1)));
+		vst1q_u8(out + i, vcombine_u8(p1.val[0], p1.val[1]));
+		pos += 2 * bits;
+	}
+
+	return i;
+}
+#else
+uint32_t frame_pack(uint8_t *out, const uint8_t *in, uint32_t n,
+		uint32_t bits)
+{
+	return pack_scalar(out, in, n, bits);
+}
+#endif
+
+int frame_unpack(uint8_t *out, const uint8_t *in, uint32_t len, uint32_t n,
+		uint32_t bits)
+{
+	uint32_t i = 0;
+
+	if (bits < 1 || bits > 8 || len < FRAME_PACK_LEN(n, bits))
+		return -1;
+
+	if (bits == 8) {
+		memcpy(out, in, n);
+		return 0;
+	}
+
+#if PACK_NEON
+	i = unpack_neon(out, in, len, n, bits);
+#endif
+	unpack_scalar(out + i, in + FRAME_PACK_LEN(i, bits), n - i, bits);
+	return 0;
+}
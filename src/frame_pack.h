@@ -0,0 +1,33 @@
+/*
+ * frame_pack.h
+ *
+ * Dense bit packing of pixels with fewer than 8 significant bits, shared by
+ * the board and the host tools. Pixels are written MSB first without
+ * padding, 8 pixels of N bits take N bytes, the last byte of a frame is
+ * padded with zeros. Only the low N bits of a pixel are kept.
+ */
+
+#ifndef __FRAME_PACK_H_
+#define __FRAME_PACK_H_
+
+#include <stdint.h>
+
+/* Bytes a frame of n pixels takes when packed to bits per pixel */
+#define FRAME_PACK_LEN(n, bits)	(((n) * (bits) + 7) / 8)
+
+/*
+ * Pack n pixels to bits (1 to 7) per pixel, returns the packed length. out
+ * may be the same buffer as in, otherwise it needs FRAME_PACK_LEN bytes
+ * plus 8 bytes of slack.
+ */
+uint32_t frame_pack(uint8_t *out, const uint8_t *in, uint32_t n,
+		uint32_t bits);
+
+/*
+ * Unpack n pixels of bits (1 to 8) per pixel from len bytes. Returns 0, or
+ * -1 if len is too short.
+ */
+int frame_unpack(uint8_t *out, const uint8_t *in, uint32_t len, uint32_t n,
+		uint32_t bits);
+
+#endif /* __FRAME_PACK_H_ */
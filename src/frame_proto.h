@@ -0,0 +1,215 @@
+/*
+ * frame_proto.h
+ *
+ * Wire format of the sensor stream. Every frame in a datagram is preceded
+ * by a fixed layout header, all fields in network byte order:
+ *
+ *  offset size field
+ *       0    2 magic 'M' 'G'
+ *       2    1 version
+ *       3    1 header length in bytes
+ *       4    2 flags (FRAME_FLAG_*)
+ *       6    2 payload format (FRAME_FMT_*)
+ *       8    8 capture timestamp, useconds of the board clock
+ *      16    4 frame sequence number
+ *      20    4 pixel count
+ *      24    4 payload length in bytes, the next header follows the payload
+ *
+ * Version 2 appends the sensor window the frame was read out from:
+ *
+ *      28    2 first column of the window
+ *      30    2 first row of the window
+ *      32    2 columns of the frame, after binning
+ *      34    1 sensor columns binned into one pixel
+ *      35    1 sensor rows binned into one pixel
+ *
+ * Version 3 appends the number of sensor frames summed into the payload:
+ *
+ *      36    4 frames integrated, 1 for a single frame
+ *
+ * Version 4 appends the fragment a datagram carries. A frame too large for
+ * one datagram is split into fragments, each with its own header and the
+ * payload length counting only the bytes of that fragment:
+ *
+ *      40    2 fragment index
+ *      42    2 fragments of the frame, 1 for a frame sent whole
+ *      44    4 offset of the fragment in the frame payload
+ *
+ * Receivers must skip header_len bytes to reach the payload, so later
+ * versions may append fields without breaking older parsers.
+ *
+ * This header is shared with the host tools and only depends on stdint.h.
+ */
+
+#ifndef __FRAME_PROTO_H_
+#define __FRAME_PROTO_H_
+
+#include <stdint.h>
+
+#define FRAME_MAGIC0		'M'
+#define FRAME_MAGIC1		'G'
+#define FRAME_PROTO_VERSION	4
+#define FRAME_HEADER_SIZE	48
+/* Header of version 1, without the geometry */
+#define FRAME_HEADER_SIZE_V1	28
+/* Header of version 2, without the integrated frame count */
+#define FRAME_HEADER_SIZE_V2	36
+/* Header of version 3, without the fragment */
+#define FRAME_HEADER_SIZE_V3	40
+
+/* Header flags */
+#define FRAME_FLAG_LAST		0x0001	/* last frame of the session */
+#define FRAME_FLAG_OVERRUN	0x0002	/* pixels beyond the buffer were lost */
+#define FRAME_FLAG_KEY		0x0004	/* coded without a reference frame */
+#define FRAME_FLAG_SATURATED	0x0008	/* an integrated sum was clipped */
+
+/* Payload formats */
+#define FRAME_FMT_RAW8		0	/* one byte per pixel */
+#define FRAME_FMT_RICE		1	/* Rice coded residuals, frame_codec.h */
+#define FRAME_FMT_SUM16		2	/* 16 bit sums of frames, frame_accum.h */
+#define FRAME_FMT_SUM32		3	/* 32 bit sums of frames */
+#define FRAME_FMT_SPARSE	4	/* runs above a threshold, frame_sparse.h */
+/* pixels of 1 to 7 significant bits packed MSB first, frame_pack.h */
+#define FRAME_FMT_PACKED(bits)		(0x0100 | (bits))
+#define FRAME_FMT_IS_PACKED(fmt)	(((fmt) & 0xff00) == 0x0100)
+#define FRAME_FMT_PACKED_BITS(fmt)	((fmt) & 0x00ff)
+
+/* Sensor window a frame was read out from */
+struct frame_geometry {
+	uint16_t x;
+	uint16_t y;
+	/* columns of the frame as sent, after binning */
+	uint16_t width;
+	uint8_t bin_x;
+	uint8_t bin_y;
+};
+
+struct frame_header {
+	uint8_t version;
+	uint8_t header_len;
+	uint16_t flags;
+	uint16_t format;
+	uint64_t timestamp_us;
+	uint32_t sequence;
+	uint32_t pixel_count;
+	uint32_t payload_len;
+	struct frame_geometry geometry;
+	uint32_t frames;
+	uint16_t frag_index;
+	uint16_t frag_count;
+	uint32_t frag_offset;
+};
+
+static inline void frame_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static inline void frame_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static inline uint16_t frame_get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline uint32_t frame_get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+			(uint32_t)p[2] << 8 | p[3];
+}
+
+/* Serialize a header into FRAME_HEADER_SIZE bytes at buf */
+static inline void frame_header_put(uint8_t *buf, const struct frame_header *h)
+{
+	buf[0] = FRAME_MAGIC0;
+	buf[1] = FRAME_MAGIC1;
+	buf[2] = FRAME_PROTO_VERSION;
+	buf[3] = FRAME_HEADER_SIZE;
+	frame_put16(buf + 4, h->flags);
+	frame_put16(buf + 6, h->format);
+	frame_put32(buf + 8, (uint32_t)(h->timestamp_us >> 32));
+	frame_put32(buf + 12, (uint32_t)h->timestamp_us);
+	frame_put32(buf + 16, h->sequence);
+	frame_put32(buf + 20, h->pixel_count);
+	frame_put32(buf + 24, h->payload_len);
+	frame_put16(buf + 28, h->geometry.x);
+	frame_put16(buf + 30, h->geometry.y);
+	frame_put16(buf + 32, h->geometry.width);
+	buf[34] = h->geometry.bin_x;
+	buf[35] = h->geometry.bin_y;
+	frame_put32(buf + 36, h->frames);
+	frame_put16(buf + 40, h->frag_index);
+	frame_put16(buf + 42, h->frag_count);
+	frame_put32(buf + 44, h->frag_offset);
+}
+
+/*
+ * Parse the header at buf, len bytes are available. Returns the offset of
+ * the payload, or -1 if the header is malformed or the payload is cut off.
+ */
+static inline int frame_header_get(const uint8_t *buf, uint32_t len,
+		struct frame_header *h)
+{
+	if (len < FRAME_HEADER_SIZE_V1)
+		return -1;
+	if (buf[0] != FRAME_MAGIC0 || buf[1] != FRAME_MAGIC1)
+		return -1;
+
+	h->version = buf[2];
+	h->header_len = buf[3];
+	if (h->version < 1 || h->header_len < FRAME_HEADER_SIZE_V1 ||
+			h->header_len > len)
+		return -1;
+
+	h->flags = frame_get16(buf + 4);
+	h->format = frame_get16(buf + 6);
+	h->timestamp_us = (uint64_t)frame_get32(buf + 8) << 32 |
+			frame_get32(buf + 12);
+	h->sequence = frame_get32(buf + 16);
+	h->pixel_count = frame_get32(buf + 20);
+	h->payload_len = frame_get32(buf + 24);
+
+	if (h->version >= 2 && h->header_len >= FRAME_HEADER_SIZE_V2) {
+		h->geometry.x = frame_get16(buf + 28);
+		h->geometry.y = frame_get16(buf + 30);
+		h->geometry.width = frame_get16(buf + 32);
+		h->geometry.bin_x = buf[34];
+		h->geometry.bin_y = buf[35];
+	} else {
+		/* a single row of unbinned pixels */
+		h->geometry.x = 0;
+		h->geometry.y = 0;
+		h->geometry.width = h->pixel_count;
+		h->geometry.bin_x = 1;
+		h->geometry.bin_y = 1;
+	}
+
+	if (h->version >= 3 && h->header_len >= FRAME_HEADER_SIZE_V3)
+		h->frames = frame_get32(buf + 36);
+	else
+		h->frames = 1;
+
+	if (h->version >= 4 && h->header_len >= FRAME_HEADER_SIZE) {
+		h->frag_index = frame_get16(buf + 40);
+		h->frag_count = frame_get16(buf + 42);
+		h->frag_offset = frame_get32(buf + 44);
+	} else {
+		h->frag_index = 0;
+		h->frag_count = 1;
+		h->frag_offset = 0;
+	}
+
+	if (h->payload_len > len - h->header_len)
+		return -1;
+
+	return h->header_len;
+}
+
+#endif /* __FRAME_PROTO_H_ */
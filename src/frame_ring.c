@@ -0,0 +1,250 @@
+/*
+ * frame_ring.c
+ *
+ * Single producer / single consumer ring of acquisition frame buffers.
+ * The producer indices are only written by the interrupt handlers and the
+ * consumer index only by the main loop, the per-slot state carries the
+ * ownership of the buffer between them.
+ *
+ * The producer may hold several buffers at once (scatter-gather DMA keeps
+ * one descriptor per buffer queued), ring_fill runs ahead of ring_head by
+ * the number of reserved buffers. Frames are always committed in order.
+ *
+ * A slot state change hands the buffer to the other side. The release
+ * fence in front of it makes the buffer contents and descriptor fields
+ * visible before the new state, the acquire fence after reading a state
+ * keeps the accesses to the buffer from being hoisted above that read. On
+ * ARMv7 both are a dmb, which also orders them against the other core and
+ * the TX completion interrupt.
+ */
+
+#include "frame_ring.h"
+#include "mem_place.h"
+#include "event_loop.h"
+#include "frame_arena.h"
+
+#define ring_release_fence() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define ring_acquire_fence() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+#define FRAME_RING_MASK (FRAME_RING_SIZE - 1)
+
+#if (FRAME_RING_SIZE & FRAME_RING_MASK)
+#error "FRAME_RING_SIZE must be a power of 2"
+#endif
+
+static struct frame_slot frame_slots[FRAME_RING_SIZE] HOT_DATA;
+static u32 frame_slot_size = 0;
+static u8 *frame_discard = NULL;
+
+static volatile u32 ring_fill HOT_DATA = 0;
+static volatile u32 ring_head HOT_DATA = 0;
+static volatile u32 ring_tail HOT_DATA = 0;
+static u32 ring_sequence HOT_DATA = 0;
+
+struct frame_ring_stats frame_ring_stats HOT_DATA;
+
+void frame_ring_init(void)
+{
+	for (int i = 0; i < FRAME_RING_SIZE; i++) {
+		frame_slots[i].data = NULL;
+		frame_slots[i].len = 0;
+		frame_slots[i].index = i;
+		frame_slots[i].state = FRAME_FREE;
+	}
+
+	ring_fill = 0;
+	ring_head = 0;
+	ring_tail = 0;
+	ring_sequence = 0;
+
+	frame_ring_stats.frames_captured = 0;
+	frame_ring_stats.frames_dropped = 0;
+	frame_ring_stats.pixels_overrun = 0;
+	frame_ring_stats.dma_ring_dry = 0;
+	frame_ring_stats.queue_high_water = 0;
+}
+
+int frame_ring_configure(u32 pixels)
+{
+	u32 size = FRAME_SLOT_BYTES(pixels);
+	u8 *buf;
+
+	/* arena allocations are cache line aligned, as the DMA needs them */
+	for (int i = 0; i < FRAME_RING_SIZE; i++) {
+		buf = frame_arena_alloc(FRAME_HEADROOM + size);
+		if (!buf)
+			return -1;
+		frame_slots[i].data = buf + FRAME_HEADROOM;
+	}
+	frame_discard = frame_arena_alloc(size);
+	if (!frame_discard)
+		return -1;
+
+	frame_slot_size = size;
+	return 0;
+}
+
+u32 frame_ring_slot_size(void)
+{
+	return frame_slot_size;
+}
+
+u8 *frame_ring_discard(void)
+{
+	return frame_discard;
+}
+
+int frame_ring_idle(void)
+{
+	for (int i = 0; i < FRAME_RING_SIZE; i++)
+		if (frame_slots[i].state != FRAME_FREE)
+			return 0;
+	return ring_fill == ring_head && ring_head == ring_tail;
+}
+
+ISR_CODE struct frame_slot *frame_ring_reserve(void)
+{
+	struct frame_slot *slot = &frame_slots[ring_fill & FRAME_RING_MASK];
+
+	if (slot->state != FRAME_FREE)
+		return NULL;
+	/* the consumer is done with the buffer */
+	ring_acquire_fence();
+
+	slot->len = 0;
+	slot->flags = 0;
+	slot->format = FRAME_FMT_RAW8;
+	slot->frames = 1;
+	slot->prepared = 0;
+	slot->state = FRAME_FILLING;
+	ring_fill++;
+
+	return slot;
+}
+
+ISR_CODE struct frame_slot *frame_ring_begin(void)
+{
+	struct frame_slot *slot = frame_ring_reserve();
+
+	if (!slot) {
+		/* consumer is behind, drop this frame instead of tearing one */
+		frame_ring_stats.frames_dropped++;
+		ring_sequence++;
+	}
+
+	return slot;
+}
+
+ISR_CODE void frame_ring_commit(struct frame_slot *slot, u32 pixels, u32 len)
+{
+	u32 depth;
+
+	slot->len = len;
+	slot->pixels = pixels;
+	slot->timestamp = get_time_us();
+	PROBE_STAMP(slot->commit_cycles);
+	slot->sequence = ring_sequence++;
+	ring_release_fence();
+	slot->state = FRAME_READY;
+	ring_head++;
+	frame_ring_stats.frames_captured++;
+
+	depth = ring_head - ring_tail;
+	if (depth > frame_ring_stats.queue_high_water)
+		frame_ring_stats.queue_high_water = depth;
+	event_post(EVENT_FRAME);
+}
+
+/* Hand back a reserved buffer without a frame, in ring order. The main loop
+ * frees it, the producer may have no other buffer to refill with. */
+ISR_CODE void frame_ring_skip(struct frame_slot *slot)
+{
+	slot->len = 0;
+	ring_release_fence();
+	slot->state = FRAME_SKIP;
+	ring_head++;
+	event_post(EVENT_FRAME);
+}
+
+/* Return every reserved but not committed buffer to the pool */
+ISR_CODE void frame_ring_abort(void)
+{
+	while (ring_fill != ring_head) {
+		ring_fill--;
+		frame_slots[ring_fill & FRAME_RING_MASK].state = FRAME_FREE;
+	}
+}
+
+/* Free the skipped buffers at the tail, they have nothing to send */
+static void ring_free_skipped(void)
+{
+	struct frame_slot *slot;
+
+	for (;;) {
+		slot = &frame_slots[ring_tail & FRAME_RING_MASK];
+		if (slot->state != FRAME_SKIP)
+			break;
+		ring_tail++;
+		slot->state = FRAME_FREE;
+	}
+}
+
+int frame_ring_pending(void)
+{
+	ring_free_skipped();
+	return frame_slots[ring_tail & FRAME_RING_MASK].state == FRAME_READY;
+}
+
+u32 frame_ring_depth(void)
+{
+	return ring_head - ring_tail;
+}
+
+struct frame_slot *frame_ring_peek(void)
+{
+	struct frame_slot *slot;
+
+	ring_free_skipped();
+	slot = &frame_slots[ring_tail & FRAME_RING_MASK];
+	if (slot->state != FRAME_READY)
+		return NULL;
+	ring_acquire_fence();
+
+	return slot;
+}
+
+/* n-th ready frame after the oldest one, NULL if not (yet) ready */
+struct frame_slot *frame_ring_peek_n(u32 n)
+{
+	struct frame_slot *slot;
+
+	if (n >= FRAME_RING_SIZE)
+		return NULL;
+	if (n == 0)
+		ring_free_skipped();
+
+	slot = &frame_slots[(ring_tail + n) & FRAME_RING_MASK];
+	if (slot->state != FRAME_READY)
+		return NULL;
+	ring_acquire_fence();
+
+	return slot;
+}
+
+void frame_ring_pop(void)
+{
+	frame_slots[ring_tail & FRAME_RING_MASK].state = FRAME_SENDING;
+	ring_tail++;
+}
+
+void frame_ring_release(struct frame_slot *slot)
+{
+	/* finish reading the buffer before the producer may refill it */
+	ring_release_fence();
+	slot->state = FRAME_FREE;
+}
+
+struct frame_slot *frame_ring_slot(u32 index)
+{
+	return &frame_slots[index & FRAME_RING_MASK];
+}
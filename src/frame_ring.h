@@ -0,0 +1,124 @@
+/*
+ * frame_ring.h
+ *
+ * Ring of acquisition frame buffers shared between the sensor interrupt
+ * handlers (producer) and the network send path (consumer).
+ */
+
+#ifndef __FRAME_RING_H_
+#define __FRAME_RING_H_
+
+#include "xil_types.h"
+#include "platform.h"
+#include "frame_proto.h"
+#include "latency_probe.h"
+
+/* Number of frame buffers in the ring, must be a power of 2 */
+#define FRAME_RING_SIZE 8
+
+/* Bytes of a frame buffer for frames of up to n pixels, integrated frames
+ * carry up to 4 bytes a pixel */
+#define FRAME_SLOT_BYTES(n) (4 * (n))
+
+/* Room reserved in front of every frame for its wire header, a multiple of
+ * the cache line so the pixel data stays aligned for the DMA */
+#define FRAME_HEADROOM 64
+
+#if FRAME_HEADROOM < FRAME_HEADER_SIZE
+#error "FRAME_HEADROOM too small for the frame header"
+#endif
+
+/*
+ * Ownership of a frame buffer. A slot only moves forward through
+ * FREE -> FILLING (EOC interrupt) -> READY (EOS interrupt)
+ * -> SENDING (main loop) -> FREE (once the network no longer uses it).
+ * The producer never touches a slot that is not FREE, so a frame that is
+ * queued or being sent can not be overwritten. A buffer whose frame went
+ * into a later one (integration) moves FILLING -> SKIP, the consumer frees
+ * it in ring order without sending it.
+ */
+enum frame_state {
+	FRAME_FREE,
+	FRAME_FILLING,
+	FRAME_READY,
+	FRAME_SENDING,
+	FRAME_SKIP
+};
+
+struct frame_slot {
+	/* pixels, FRAME_HEADROOM bytes are available in front of them and
+	 * frame_ring_slot_size() bytes from them on */
+	u8 *data;
+	/* payload bytes in data, less than pixels once the frame is coded */
+	u32 len;
+	u32 pixels;
+	/* FRAME_FMT_* of the payload */
+	u32 format;
+	/* set by the consumer once the payload is ready to be sent */
+	u32 prepared;
+	u32 index;
+	/* capture sequence, frames dropped by the ring still use a number */
+	u32 sequence;
+	/* FRAME_FLAG_* set by the producer */
+	u32 flags;
+	/* sensor window and binning the frame was read out with */
+	struct frame_geometry geometry;
+	/* sensor frames summed into this one */
+	u32 frames;
+	/* capture time in useconds, set when the frame is committed */
+	u64 timestamp;
+#if PROBE_ENABLE
+	/* cycle counter at commit */
+	u32 commit_cycles;
+#endif
+	volatile u32 state;
+};
+
+struct frame_ring_stats {
+	u32 frames_captured;
+	/* frames lost because no free buffer was available at frame start */
+	u32 frames_dropped;
+	/* pixels received after the frame buffer was already full */
+	u32 pixels_overrun;
+	/* times the scatter-gather DMA was left without a queued descriptor */
+	u32 dma_ring_dry;
+	/* most frames ever waiting to be sent at once */
+	u32 queue_high_water;
+};
+
+extern struct frame_ring_stats frame_ring_stats;
+
+void frame_ring_init(void);
+
+/*
+ * Carve the buffers for frames of up to pixels pixels from the frame arena
+ * (frame_arena.h), plus a discard buffer of the same size. Only while
+ * acquisition is stopped and the ring is idle, returns -1 if the arena is
+ * exhausted.
+ */
+int frame_ring_configure(u32 pixels);
+u32 frame_ring_slot_size(void);
+/* Target for frames a DMA has to take while the ring is full */
+u8 *frame_ring_discard(void);
+/* No buffer is filled, queued or still used by the network */
+int frame_ring_idle(void);
+
+/* Producer side, called from interrupt context */
+struct frame_slot *frame_ring_reserve(void);
+struct frame_slot *frame_ring_begin(void);
+void frame_ring_commit(struct frame_slot *slot, u32 pixels, u32 len);
+void frame_ring_skip(struct frame_slot *slot);
+void frame_ring_abort(void);
+
+/* Consumer side, called from the main loop. frame_ring_release may also
+ * run from the EMAC TX completion when frames are sent by reference. */
+int frame_ring_pending(void);
+/* Frames committed and not yet sent */
+u32 frame_ring_depth(void);
+struct frame_slot *frame_ring_peek(void);
+struct frame_slot *frame_ring_peek_n(u32 n);
+void frame_ring_pop(void);
+void frame_ring_release(struct frame_slot *slot);
+struct frame_slot *frame_ring_slot(u32 index);
+
+#endif /* __FRAME_RING_H_ */
@@ -0,0 +1,125 @@
+/*
+ * frame_sparse.c
+ *
+ * The encoder spends its time looking for the next pixel above the
+ * threshold. The NEON scan compares 16 pixels per iteration and skips the
+ * whole vector when none of them is above, so an empty frame costs about
+ * one load and compare per 16 pixels.
+ */
+
+#include <string.h>
+#include "frame_sparse.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SPARSE_NEON 1
+#else
+#define SPARSE_NEON 0
+#endif
+
+/* Longest varint of a 32 bit value */
+#define SPARSE_VARINT_MAX	5
+
+static uint32_t sparse_put_varint(uint8_t *out, uint32_t v)
+{
+	uint32_t len = 0;
+
+	while (v >= 0x80) {
+		out[len++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	out[len++] = v;
+	return len;
+}
+
+/* Returns the number of bytes read, 0 if the varint runs past end */
+static uint32_t sparse_get_varint(const uint8_t *in, const uint8_t *end,
+		uint32_t *v)
+{
+	uint32_t len = 0, shift = 0;
+
+	*v = 0;
+	while (in + len < end && shift < 32) {
+		*v |= (uint32_t)(in[len] & 0x7f) << shift;
+		if (!(in[len++] & 0x80))
+			return len;
+		shift += 7;
+	}
+	return 0;
+}
+
+/* Index of the first pixel from i on above threshold, n if there is none */
+static uint32_t sparse_next_above(const uint8_t *pixels, uint32_t i,
+		uint32_t n, uint8_t threshold)
+{
+#if SPARSE_NEON
+	uint8x16_t t = vdupq_n_u8(threshold), m;
+	uint8x8_t any;
+
+	for (; i + 16 <= n; i += 16) {
+		m = vcgtq_u8(vld1q_u8(pixels + i), t);
+		any = vorr_u8(vget_low_u8(m), vget_high_u8(m));
+		if (vget_lane_u64(vreinterpret_u64_u8(any), 0))
+			break;
+	}
+#endif
+	while (i < n && pixels[i] <= threshold)
+		i++;
+	return i;
+}
+
+uint32_t frame_sparse_encode(uint8_t *out, uint32_t max, const uint8_t *pixels,
+		uint32_t n, uint8_t threshold)
+{
+	uint32_t len = 1, end = 0, start, i = 0;
+
+	if (!max)
+		return 0;
+	out[0] = threshold;
+
+	for (;;) {
+		start = i = sparse_next_above(pixels, i, n, threshold);
+		if (i >= n)
+			break;
+		while (i < n && pixels[i] > threshold)
+			i++;
+
+		if (len + 2 * SPARSE_VARINT_MAX + (i - start) > max)
+			return 0;
+		len += sparse_put_varint(out + len, start - end);
+		len += sparse_put_varint(out + len, i - start);
+		memcpy(out + len, pixels + start, i - start);
+		len += i - start;
+		end = i;
+	}
+	return len;
+}
+
+int frame_sparse_decode(uint8_t *pixels, uint32_t n, const uint8_t *in,
+		uint32_t len)
+{
+	const uint8_t *end = in + len;
+	uint32_t pos = 0, gap, count, used;
+
+	if (!len)
+		return -1;
+	memset(pixels, 0, n);
+
+	for (in++; in < end; in += count) {
+		used = sparse_get_varint(in, end, &gap);
+		if (!used)
+			return -1;
+		in += used;
+		used = sparse_get_varint(in, end, &count);
+		if (!used)
+			return -1;
+		in += used;
+		if (gap > n - pos || count > n - pos - gap ||
+				count > (uint32_t)(end - in))
+			return -1;
+		pos += gap;
+		memcpy(pixels + pos, in, count);
+		pos += count;
+	}
+	return 0;
+}
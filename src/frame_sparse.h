@@ -0,0 +1,34 @@
+/*
+ * frame_sparse.h
+ *
+ * Zero suppressed frames, shared by the board and the host tools. Only the
+ * pixels above a threshold are sent, grouped into runs of adjacent pixels:
+ *
+ *	threshold (1 byte)
+ *	per run: gap, count, count pixel values
+ *
+ * gap is the number of suppressed pixels since the end of the previous
+ * run (the frame start for the first one), gap and count are varints of
+ * 7 bits per byte, least significant group first, the top bit set on all
+ * but the last byte. Pixels outside the runs decode as 0, the pixels above
+ * the threshold are exact.
+ */
+
+#ifndef __FRAME_SPARSE_H_
+#define __FRAME_SPARSE_H_
+
+#include <stdint.h>
+
+/*
+ * Encode the pixels of n above threshold into at most max bytes of out.
+ * Returns the encoded length, or 0 if it would take more than max bytes,
+ * the frame is then better sent dense.
+ */
+uint32_t frame_sparse_encode(uint8_t *out, uint32_t max, const uint8_t *pixels,
+		uint32_t n, uint8_t threshold);
+
+/* Expand len bytes into n pixels. Returns 0, or -1 if in is corrupt. */
+int frame_sparse_decode(uint8_t *pixels, uint32_t n, const uint8_t *in,
+		uint32_t len);
+
+#endif /* __FRAME_SPARSE_H_ */
@@ -0,0 +1,139 @@
+/*
+ * latency_probe.c
+ *
+ * Log-linear histograms of the probe durations. A value falls into one of
+ * 4 buckets per power of 2, i.e. it is known within 25%, and adding it is a
+ * count-leading-zeros and an increment, cheap enough for the EOC interrupt.
+ * Each probe has a single writer, either an interrupt handler or the main
+ * loop, so no locking is needed. A dump while capturing can be off by the
+ * samples added during it.
+ */
+
+#include "latency_probe.h"
+#include "xil_printf.h"
+
+#if PROBE_ENABLE
+
+static struct probe_hist probes[PROBE_COUNT];
+
+static const char *probe_names[PROBE_COUNT] = {
+	[PROBE_EOC_ISR] = "EOC isr",
+	[PROBE_EOS_ISR] = "EOS isr",
+	[PROBE_FRAME_TO_ALLOC] = "frame -> pbuf",
+	[PROBE_FRAME_TO_SENT] = "frame -> sent",
+	[PROBE_UDP_SEND] = "udp_send",
+	[PROBE_NET_INPUT] = "net input",
+	[PROBE_CORRECTION] = "correction",
+};
+
+static u32 probe_bucket(u32 cycles)
+{
+	u32 exp;
+
+	if (cycles < (1 << PROBE_SUB_BITS))
+		return cycles;
+
+	exp = 31 - __builtin_clz(cycles);
+	return ((exp - PROBE_SUB_BITS + 1) << PROBE_SUB_BITS) |
+			((cycles >> (exp - PROBE_SUB_BITS)) &
+			((1 << PROBE_SUB_BITS) - 1));
+}
+
+/* Smallest value of a bucket */
+static u64 probe_bucket_low(u32 bucket)
+{
+	u32 exp = bucket >> PROBE_SUB_BITS;
+
+	if (exp == 0)
+		return bucket;
+
+	return (u64)((1 << PROBE_SUB_BITS) |
+			(bucket & ((1 << PROBE_SUB_BITS) - 1))) << (exp - 1);
+}
+
+/* Upper bound of the bucket holding the pct percentile, at most max */
+static u32 probe_percentile(const struct probe_hist *h, u32 pct)
+{
+	u64 rank = ((u64)h->count * pct + 99) / 100;
+	u64 seen = 0, high;
+
+	for (u32 i = 0; i < PROBE_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank && seen) {
+			high = probe_bucket_low(i + 1) - 1;
+			return high < h->max ? (u32)high : h->max;
+		}
+	}
+
+	return h->max;
+}
+
+void probe_add(enum probe_id id, u32 cycles)
+{
+	struct probe_hist *h = &probes[id];
+
+	if (h->count == 0 || cycles < h->min)
+		h->min = cycles;
+	if (cycles > h->max)
+		h->max = cycles;
+	h->count++;
+	h->sum += cycles;
+	h->buckets[probe_bucket(cycles)]++;
+}
+
+void probe_reset(void)
+{
+	struct probe_hist *h;
+
+	for (int id = 0; id < PROBE_COUNT; id++) {
+		h = &probes[id];
+		h->count = 0;
+		h->min = 0;
+		h->max = 0;
+		h->sum = 0;
+		for (int i = 0; i < PROBE_BUCKETS; i++)
+			h->buckets[i] = 0;
+	}
+}
+
+/* cycles to nanoseconds */
+static u32 probe_ns(u32 cycles)
+{
+	return (u32)((u64)cycles * 1000 / get_cycles_per_us());
+}
+
+void probe_dump(void)
+{
+	struct probe_hist *h;
+	u32 avg;
+
+	xil_printf("probe          count      min      avg      p50      p99"
+			"      max  [ns]\r\n");
+	for (int id = 0; id < PROBE_COUNT; id++) {
+		h = &probes[id];
+		avg = h->count ? (u32)(h->sum / h->count) : 0;
+		xil_printf("%-13s %6d %8d %8d %8d %8d %8d\r\n", probe_names[id],
+				h->count, probe_ns(h->min), probe_ns(avg),
+				probe_ns(probe_percentile(h, 50)),
+				probe_ns(probe_percentile(h, 99)),
+				probe_ns(h->max));
+	}
+	probe_reset();
+}
+
+#else
+
+void probe_add(enum probe_id id, u32 cycles)
+{
+}
+
+void probe_reset(void)
+{
+}
+
+void probe_dump(void)
+{
+	xil_printf("Latency probes are disabled, build with PROBE_ENABLE 1\r\n");
+}
+
+#endif
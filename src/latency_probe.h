@@ -0,0 +1,56 @@
+/*
+ * latency_probe.h
+ *
+ * Optional cycle counter instrumentation of the acquisition and send path.
+ * Every probe collects the durations it is given in a fixed-bucket
+ * histogram, "probes" on the command port prints and clears them. With
+ * PROBE_ENABLE 0 the probe macros expand to nothing and no state is kept.
+ */
+
+#ifndef __LATENCY_PROBE_H_
+#define __LATENCY_PROBE_H_
+
+#include "xil_types.h"
+#include "platform.h"
+
+#define PROBE_ENABLE 0
+
+/* Buckets of a probe histogram, 4 per power of 2 up to 2^32 cycles */
+#define PROBE_SUB_BITS 2
+#define PROBE_BUCKETS ((32 - PROBE_SUB_BITS + 1) << PROBE_SUB_BITS)
+
+enum probe_id {
+	PROBE_EOC_ISR,		/* EOC interrupt handler */
+	PROBE_EOS_ISR,		/* EOS interrupt handler */
+	PROBE_FRAME_TO_ALLOC,	/* frame commit to its pbuf allocated */
+	PROBE_FRAME_TO_SENT,	/* frame commit to udp_send() returned */
+	PROBE_UDP_SEND,		/* udp_send() call */
+	PROBE_NET_INPUT,	/* xemacif_input() while a frame was ready */
+	PROBE_CORRECTION,	/* dark / gain correction of a frame */
+	PROBE_COUNT
+};
+
+struct probe_hist {
+	u32 count;
+	u32 min;
+	u32 max;
+	u64 sum;
+	u32 buckets[PROBE_BUCKETS];
+};
+
+#if PROBE_ENABLE
+#define PROBE_START(var) u32 var = get_cycles()
+#define PROBE_END(id, var) probe_add((id), get_cycles() - (var))
+#define PROBE_STAMP(lvalue) ((lvalue) = get_cycles())
+#else
+#define PROBE_START(var)
+#define PROBE_END(id, var) do { } while (0)
+#define PROBE_STAMP(lvalue) do { } while (0)
+#endif
+
+void probe_add(enum probe_id id, u32 cycles);
+void probe_reset(void);
+/* Print every probe and clear it, the interrupt probes keep counting */
+void probe_dump(void);
+
+#endif /* __LATENCY_PROBE_H_ */
@@ -0,0 +1,138 @@
+/*
+ * log_ring.c
+ *
+ * Several producers, the main loop and the interrupt handlers, one
+ * consumer, the main loop. A producer claims an entry by advancing
+ * log_head with a compare and swap, ldrex / strex on ARMv7, so a handler
+ * preempting another producer gets an entry of its own. It fills the entry
+ * and then publishes it by storing the sequence number the entry holds
+ * once valid, the consumer stops at the first entry not published yet.
+ * Nothing waits on anything, a full ring only drops the new message.
+ */
+
+#include "log_ring.h"
+#include "xil_printf.h"
+#include "mem_place.h"
+#include "event_loop.h"
+
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+
+#if (LOG_RING_SIZE & LOG_RING_MASK)
+#error "LOG_RING_SIZE must be a power of 2"
+#endif
+
+struct log_entry {
+	/* claim number + 1 once the entry is filled */
+	volatile u32 seq;
+	u32 id;
+	u32 args[LOG_ARGS_MAX];
+};
+
+static const char *const log_formats[LOG_COUNT] = {
+	[LOG_EOC_UNKNOWN] = "Unknown interrupt for GPIO EOC\r\n",
+	[LOG_EOC_IDLE] = "Interrupt for GPIO EOC not in meas time\r\n",
+	[LOG_EOS_UNKNOWN] = "Unknown interrupt for GPIO EOS\r\n",
+	[LOG_EOS_IDLE] = "Interrupt for GPIO EOS not in meas time\r\n",
+	[LOG_SG_SUBMIT] = "RX BD submit failed\r\n",
+	[LOG_TX_PBUF] = "error allocating pbuf to send\r\n",
+	[LOG_FRAME_NO_ROOM] = "udp_client: no room for frames of %d "
+			"pixels\r\n",
+	[LOG_DMA_RESET] = "DMA reset timed out\r\n",
+	[LOG_CTRL_PBUF] = "error allocating pbuf for a control reply\r\n",
+	[LOG_CMD_START] = "Start sending via udp \r\n",
+	[LOG_CMD_TOO_MANY] = "Too many receivers\r\n",
+	[LOG_CMD_STOP] = "Stop sending via udp \r\n",
+	[LOG_CMD_LEFT] = "Receiver left, %d still streaming\r\n",
+	[LOG_CMD_MCAST_OFF] = "Streaming to the server\r\n",
+	[LOG_CMD_MCAST_INVALID] = "Invalid multicast group or streaming\r\n",
+	[LOG_CMD_MCAST] = "Streaming to group %d.%d.%d.%d, ttl %d\r\n",
+	[LOG_CMD_RATE] = "TX rate %d kbit/s, burst %d bytes\r\n",
+	[LOG_CMD_ROI_INVALID] = "Invalid readout window\r\n",
+	[LOG_CMD_ROI] = "ROI %d,%d %dx%d, bin %dx%d\r\n",
+	[LOG_CMD_FRAME_INVALID] = "Invalid frame size or streaming\r\n",
+	[LOG_CMD_FRAME] = "Frames of %d pixels, %d columns\r\n",
+	[LOG_CMD_SUM_INVALID] = "Invalid integration setting\r\n",
+	[LOG_CMD_SUM] = "Integrating %d frames, %d bit sums\r\n",
+	[LOG_CMD_CAL_TABLE_INVALID] = "Invalid calibration table entries\r\n",
+	[LOG_CMD_CAL_ON] = "Correction on\r\n",
+	[LOG_CMD_CAL_OFF] = "Correction off\r\n",
+	[LOG_CMD_CAL_RESET] = "Calibration tables reset\r\n",
+	[LOG_CMD_CAL_BENCH] = "Correction of %d pixels: %d cycles (%d ns), "
+			"scalar %d cycles\r\n",
+	[LOG_CMD_SPARSE_OFF] = "Sparse frames off\r\n",
+	[LOG_CMD_SPARSE_INVALID] = "Invalid sparse threshold\r\n",
+	[LOG_CMD_SPARSE] = "Sparse frames above %d\r\n",
+	[LOG_CMD_MEM_LAYOUT] = "Frames in %d, ISRs in %d, hot data in %d "
+			"(0 DDR, 1 OCM, 2 non-cacheable DDR), "
+			"OCM non-cacheable %d\r\n",
+	[LOG_CMD_MEM_BENCH] = "Interrupt entry %d cycles warm, %d cold; "
+			"frame of %d pixels: maintenance %d cycles, "
+			"read %d cycles\r\n",
+	[LOG_CMD_MEM_BUSY] = "Stop capturing before mem bench\r\n",
+	[LOG_CMD_UNKNOWN] = "Unknown command received \r\n",
+};
+
+static struct log_entry log_ring[LOG_RING_SIZE] HOT_DATA;
+static u32 log_head HOT_DATA = 0;
+static u32 log_tail HOT_DATA = 0;
+static u32 log_drops HOT_DATA = 0;
+static u32 log_drops_reported = 0;
+
+ISR_CODE void log_post(u32 id, u32 a0, u32 a1, u32 a2, u32 a3, u32 a4, u32 a5)
+{
+	struct log_entry *e;
+	u32 head = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+
+	do {
+		if (head - __atomic_load_n(&log_tail, __ATOMIC_ACQUIRE) >=
+				LOG_RING_SIZE) {
+			__atomic_fetch_add(&log_drops, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&log_head, &head, head + 1, 1,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	e = &log_ring[head & LOG_RING_MASK];
+	e->id = id;
+	e->args[0] = a0;
+	e->args[1] = a1;
+	e->args[2] = a2;
+	e->args[3] = a3;
+	e->args[4] = a4;
+	e->args[5] = a5;
+	__atomic_store_n(&e->seq, head + 1, __ATOMIC_RELEASE);
+	event_post(EVENT_LOG);
+}
+
+int log_drain(void)
+{
+	struct log_entry *e;
+	u32 drops;
+
+	for (int i = 0; i < LOG_DRAIN_MAX; i++) {
+		e = &log_ring[log_tail & LOG_RING_MASK];
+		if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != log_tail + 1)
+			break;
+		if (e->id < LOG_COUNT)
+			xil_printf(log_formats[e->id], e->args[0], e->args[1],
+					e->args[2], e->args[3], e->args[4],
+					e->args[5]);
+		/* the entry may be claimed again from here on */
+		__atomic_store_n(&log_tail, log_tail + 1, __ATOMIC_RELEASE);
+	}
+
+	drops = __atomic_load_n(&log_drops, __ATOMIC_RELAXED);
+	if (drops != log_drops_reported) {
+		xil_printf("log: %d messages dropped\r\n",
+				drops - log_drops_reported);
+		log_drops_reported = drops;
+	}
+
+	e = &log_ring[log_tail & LOG_RING_MASK];
+	return __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) == log_tail + 1;
+}
+
+u32 log_dropped(void)
+{
+	return __atomic_load_n(&log_drops, __ATOMIC_RELAXED);
+}
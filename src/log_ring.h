@@ -0,0 +1,87 @@
+/*
+ * log_ring.h
+ *
+ * Deferred console messages. Interrupt handlers and the lwIP callbacks
+ * post a message id and its arguments into a fixed ring in a few dozen
+ * cycles, the main loop formats and prints them on the UART while it has
+ * nothing to send. Messages that find the ring full are counted and
+ * reported instead of blocking the poster.
+ */
+
+#ifndef __LOG_RING_H_
+#define __LOG_RING_H_
+
+#include "xil_types.h"
+
+/* Entries of the ring, must be a power of 2 */
+#define LOG_RING_SIZE 64
+
+/* Entries printed per call of log_drain, bounds the time on the UART */
+#define LOG_DRAIN_MAX 4
+
+/* Most arguments of a message, all of them integers. Strings are not
+ * possible, the text they point to may be gone by the time it is printed. */
+#define LOG_ARGS_MAX 6
+
+/* Messages, the formats are in log_ring.c */
+enum log_id {
+	/* interrupt handlers */
+	LOG_EOC_UNKNOWN,
+	LOG_EOC_IDLE,
+	LOG_EOS_UNKNOWN,
+	LOG_EOS_IDLE,
+	LOG_SG_SUBMIT,
+	/* send path */
+	LOG_TX_PBUF,
+	/* frame size changes */
+	LOG_FRAME_NO_ROOM,
+	LOG_DMA_RESET,
+	/* command port */
+	LOG_CTRL_PBUF,
+	LOG_CMD_START,
+	LOG_CMD_TOO_MANY,
+	LOG_CMD_STOP,
+	LOG_CMD_LEFT,
+	LOG_CMD_MCAST_OFF,
+	LOG_CMD_MCAST_INVALID,
+	LOG_CMD_MCAST,
+	LOG_CMD_RATE,
+	LOG_CMD_ROI_INVALID,
+	LOG_CMD_ROI,
+	LOG_CMD_FRAME_INVALID,
+	LOG_CMD_FRAME,
+	LOG_CMD_SUM_INVALID,
+	LOG_CMD_SUM,
+	LOG_CMD_CAL_TABLE_INVALID,
+	LOG_CMD_CAL_ON,
+	LOG_CMD_CAL_OFF,
+	LOG_CMD_CAL_RESET,
+	LOG_CMD_CAL_BENCH,
+	LOG_CMD_SPARSE_OFF,
+	LOG_CMD_SPARSE_INVALID,
+	LOG_CMD_SPARSE,
+	LOG_CMD_MEM_LAYOUT,
+	LOG_CMD_MEM_BENCH,
+	LOG_CMD_MEM_BUSY,
+	LOG_CMD_UNKNOWN,
+	LOG_COUNT
+};
+
+/* Safe from any context, interrupt handlers included */
+void log_post(u32 id, u32 a0, u32 a1, u32 a2, u32 a3, u32 a4, u32 a5);
+
+/* LOG(id, args...) with up to LOG_ARGS_MAX arguments */
+#define LOG(...) LOG_POST(__VA_ARGS__, 0, 0, 0, 0, 0, 0, 0)
+#define LOG_POST(id, a0, a1, a2, a3, a4, a5, ...) \
+	log_post(id, (u32)(a0), (u32)(a1), (u32)(a2), (u32)(a3), (u32)(a4), \
+			(u32)(a5))
+
+/* Print up to LOG_DRAIN_MAX messages, and the count of messages dropped
+ * since the last call. Returns nonzero while more are waiting. Main loop
+ * only. */
+int log_drain(void);
+
+/* Messages dropped because the ring was full, since boot */
+u32 log_dropped(void);
+
+#endif /* __LOG_RING_H_ */
@@ -30,6 +30,12 @@
 #include "xparameters.h"
 #include "netif/xadapter.h"
 #include "platform.h"
+#include "frame_ring.h"
+#include "acquisition.h"
+#include "latency_probe.h"
+#include "telemetry.h"
+#include "log_ring.h"
+#include "event_loop.h"
 #include "lwipopts.h"
 #include "xil_printf.h"
 #include "sleep.h"
@@ -44,6 +50,10 @@
 void platform_enable_interrupts(void);
 void start_application(void);
 void transfer_data(void);
+int udp_tx_pending(void);
+int udp_tx_stalled(u64 *deadline_us);
+int udp_stream_set_frame_size(u32 width, u32 pixels);
+void udp_report_poll(void);
 void print_app_header(void);
 
 struct netif server_netif;
@@ -85,6 +95,9 @@ static void assign_default_ip(ip_addr_t *ip, ip_addr_t *mask, ip_addr_t *gw)
 int main(void)
 {
 	struct netif *netif;
+	u32 events = 0;
+	u64 deadline_us = 0;
+	int busy;
 
 	/* the mac address of the board. this should be unique per board */
 	unsigned char mac_ethernet_address[] = {
@@ -93,6 +106,11 @@ int main(void)
 	netif = &server_netif;
 
 	init_platform();
+	/* the command port may change it while streaming is stopped */
+	if (udp_stream_set_frame_size(ACQ_SENSOR_WIDTH, BUFFER_SIZE)) {
+		xil_printf("Error allocating the frame buffers\r\n");
+		return -1;
+	}
 
 	xil_printf("\r\n\r\n");
 	xil_printf("-----lwIP RAW Mode UDP Client Application-----\r\n");
@@ -127,22 +145,53 @@ int main(void)
 
 	/* start the application*/
 	start_application();
-	/*int status = dma_transfer();
-
-	if(status == XST_FAILURE)
-	{
-		xil_printf("DMA transfer failed\r\n");
-		return 0;
-	}
-	xil_printf("DMA transfer succeeded\r\n");*/
 
 	while (1) {
-		xemacif_input(netif);
-		if(send_udp)
-		{
+		/* an event stays set until what it stands for is done, the
+		 * frame ring and the send path say what is ready */
+		events |= event_take();
+		events &= ~(EVENT_FRAME | EVENT_TX);
+
+		/* frames first, the ring itself says which are ready */
+		if (udp_tx_pending())
 			transfer_data();
-		}
 
+		if (events & EVENT_NET) {
+#if PROBE_ENABLE
+			/* time the input processing that holds back a ready
+			 * frame */
+			int frame_waiting = frame_ring_pending();
+			PROBE_START(input_start);
+#endif
+			if (!xemacif_input(netif))
+				events &= ~EVENT_NET;
+#if PROBE_ENABLE
+			if (frame_waiting)
+				PROBE_END(PROBE_NET_INPUT, input_start);
+#endif
+		}
+		platform_acq_poll();
+
+		/* the UART is slow, only print while no frame waits */
+		busy = udp_tx_pending();
+		if (events & EVENT_TICK) {
+			telemetry_poll();
+			if (!busy)
+				udp_report_poll();
+			events &= ~EVENT_TICK;
+		}
+		if (!busy && (events & EVENT_LOG) && !log_drain())
+			events &= ~EVENT_LOG;
+
+		/* a send path waiting for the driver or a deadline is idle */
+		if (busy && !udp_tx_stalled(&deadline_us))
+			continue;
+		if ((events & EVENT_NET) || (!busy && (events & EVENT_LOG)))
+			continue;
+		if (busy && deadline_us && deadline_us <= get_time_us())
+			continue;
+		platform_wake_at(busy ? deadline_us : 0);
+		event_wait();
 	}
 
 	/* never reached */
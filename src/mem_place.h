@@ -0,0 +1,81 @@
+/*
+ * mem_place.h
+ *
+ * Where the frame buffers, the capture interrupt handlers and the data they
+ * share live. Each can stay in cached DDR with everything else, or move to
+ * the 192 KB on-chip memory (ps7_ram_0), which lscript.ld otherwise leaves
+ * unused, and the data to DDR mapped non-cacheable. Frame buffers that are
+ * not cached need no cache maintenance around their DMA, but every access
+ * of the CPU goes to memory. "mem bench" on the command port measures what
+ * a layout costs (platform_mem_bench).
+ *
+ * The attributes below put objects into the sections lscript.ld reserves
+ * for them: .text.ocm and .bss.ocm in OCM, .bss.ddr_nc in DDR sections of
+ * 1 MB that init_platform() maps non-cacheable. Only objects without an
+ * initial value other than 0 may be placed, the OCM and non-cacheable
+ * sections are cleared by init_platform(), not by the C startup code.
+ */
+
+#ifndef __MEM_PLACE_H_
+#define __MEM_PLACE_H_
+
+#define MEM_DDR		0	/* cached DDR */
+#define MEM_OCM		1	/* on-chip memory */
+#define MEM_DDR_NC	2	/* non-cacheable DDR */
+
+/* The frame arena (frame_arena.h) */
+#ifndef FRAME_MEM
+#define FRAME_MEM MEM_DDR
+#endif
+
+/* The EOC / EOS / S2MM handlers and the producer side of the frame ring,
+ * MEM_DDR or MEM_OCM */
+#ifndef ISR_MEM
+#define ISR_MEM MEM_DDR
+#endif
+
+/* State the handlers and the main loop share: frame ring slots and
+ * indices, the pixel counters, the log ring and the interrupt counters */
+#ifndef HOT_MEM
+#define HOT_MEM MEM_DDR
+#endif
+
+/* Map the whole OCM non-cacheable, the BSP maps it cached like DDR */
+#ifndef OCM_NONCACHEABLE
+#define OCM_NONCACHEABLE 0
+#endif
+
+#if ISR_MEM == MEM_DDR_NC
+#error "ISR_MEM can be MEM_DDR or MEM_OCM"
+#endif
+
+#define MEM_NAME(mem) ((mem) == MEM_OCM ? "OCM" : \
+		(mem) == MEM_DDR_NC ? "non-cacheable DDR" : "DDR")
+
+/* Whether the CPU caches memory of a placement */
+#define MEM_CACHED(mem) ((mem) == MEM_DDR || \
+		((mem) == MEM_OCM && !OCM_NONCACHEABLE))
+
+#if ISR_MEM == MEM_OCM
+#define ISR_CODE __attribute__((section(".text.ocm")))
+#else
+#define ISR_CODE
+#endif
+
+#if HOT_MEM == MEM_OCM
+#define HOT_DATA __attribute__((section(".bss.ocm")))
+#elif HOT_MEM == MEM_DDR_NC
+#define HOT_DATA __attribute__((section(".bss.ddr_nc")))
+#else
+#define HOT_DATA
+#endif
+
+#if FRAME_MEM == MEM_OCM
+#define FRAME_DATA __attribute__((section(".bss.ocm")))
+#elif FRAME_MEM == MEM_DDR_NC
+#define FRAME_DATA __attribute__((section(".bss.ddr_nc")))
+#else
+#define FRAME_DATA
+#endif
+
+#endif /* __MEM_PLACE_H_ */
@@ -32,18 +32,62 @@
 #define DEBUG_ENABLE 1
 #define BUFFER_SIZE 1024
 
+/* Pixel capture modes */
+#define ACQ_MODE_GPIO 0	/* one EOC interrupt per pixel, EOS ends the frame */
+#define ACQ_MODE_DMA 1	/* AXI DMA S2MM writes a frame, one interrupt per frame */
+#define ACQ_MODE_DMA_SG 2	/* S2MM scatter-gather, one descriptor per ring buffer */
+
+#define ACQ_MODE ACQ_MODE_GPIO
+
+#define ACQ_MODE_IS_DMA (ACQ_MODE == ACQ_MODE_DMA || ACQ_MODE == ACQ_MODE_DMA_SG)
+
+/*
+ * Platform interface of the hardware independent code (main.c,
+ * udp_perf_client.c, frame_ring.c, acquisition.c). platform_zynq.c
+ * implements it on the board, host/sim/platform_linux.c on a Linux machine
+ * where the EOC / EOS interrupts are simulated.
+ */
 void init_platform();
 void cleanup_platform();
 void platform_setup_timer();
 void platform_enable_interrupts();
 void platform_setup_dma();
 void read_data_from_d_out();
-void star_stop_measurements(int start_stop);
-int dma_transfer();
+void start_stop_measurements(int start);
+void platform_acq_poll();
+/* While capture is stopped, cancel the capture DMA and return the buffers
+ * it was armed with to the ring. Returns -1 if it could not be stopped. */
+int platform_acq_quiesce();
 u64 get_time_ms();
+u64 get_time_us();
+/* Free running CPU cycle counter, wraps every few seconds */
+u32 get_cycles();
+u32 get_cycles_per_us();
+/* Wait for an interrupt unless an event (event_loop.h) is pending, returns
+ * the cycles slept, 0 if it did not */
+u32 platform_sleep();
+/* Post EVENT_TX once get_time_us() reaches time_us, 0 cancels it */
+void platform_wake_at(u64 time_us);
+
+/* Interrupts taken by the capture handlers. They stay 32 bit so a handler
+ * updates them with one store, the telemetry widens them to 64 bits. */
+struct platform_irq_stats {
+	u32 eoc;
+	u32 eos;
+	u32 dma;
+};
+
+extern struct platform_irq_stats platform_irq_stats;
+
+/* What the memory layout of mem_place.h costs, in cycles */
+struct platform_mem_bench {
+	u32 irq_warm;		/* software interrupt to handler, cached */
+	u32 irq_cold;		/* the same after cleaning the caches */
+	u32 frame_maint;	/* cache maintenance around a frame DMA */
+	u32 frame_read;		/* CPU reading a frame */
+};
 
-extern u8 tx_buffer[BUFFER_SIZE];
-extern u8 rx_buffer[BUFFER_SIZE];
-extern int send_udp;
+/* Fills r, returns -1 while capturing */
+int platform_mem_bench(struct platform_mem_bench *r);
 
 #endif
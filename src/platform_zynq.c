@@ -48,6 +48,7 @@
 #include "xparameters.h"
 #include "xparameters_ps.h"	/* defines XPAR values */
 #include "xil_cache.h"
+#include "xil_mmu.h"
 #include "platform.h"
 #include "xscugic.h"
 #include "xil_printf.h"
@@ -56,6 +57,14 @@
 #include "xaxidma.h"
 #include "xgpio.h"
 #include "xtime_l.h"
+#include "xpseudo_asm.h"
+#include "xil_io.h"
+#include "frame_ring.h"
+#include "acquisition.h"
+#include "latency_probe.h"
+#include "log_ring.h"
+#include "mem_place.h"
+#include "event_loop.h"
 #include <string.h>
 
 
@@ -67,6 +76,15 @@
 #define DMA_DEV_ID			XPAR_AXIDMA_0_DEVICE_ID
 #define RX_INTR_ID			XPAR_FABRIC_AXI_DMA_0_S2MM_INTROUT_INTR
 #define TX_INTR_ID			XPAR_FABRIC_AXIDMA_0_MM2S_INTROUT_VEC_ID
+#define EMAC_INTR_ID		XPAR_XEMACPS_0_INTR
+#define WAKE_INTR_ID		XPS_GLOBAL_TMR_INT_ID
+
+/* Comparator of the global timer (xtime_l.h), the wake up timer */
+#define GTIMER_STATUS_OFFSET		0x0C
+#define GTIMER_COMPARE_LOWER_OFFSET	0x10
+#define GTIMER_COMPARE_UPPER_OFFSET	0x14
+#define GTIMER_COMP_ENABLE		(1 << 1)
+#define GTIMER_IRQ_ENABLE		(1 << 2)
 
 //#define GPIO_AD_SEL_ID 	  	XPAR_AXI_GPIO_VSEL_DEVICE_ID
 //#define GPIO_D_OUT_ID     	XPAR_AXI_GPIO_D_OUT_DEVICE_ID
@@ -96,16 +114,51 @@ extern struct netif server_netif;
 volatile int tx_done = 0;
 volatile int rx_done = 0;
 volatile int error = 0;
-int send_udp = 0;
-int is_measurement_time = 0;
 
-u8 tx_buffer[BUFFER_SIZE] = {0};
-u8 rx_buffer[BUFFER_SIZE] = {0};
+struct platform_irq_stats platform_irq_stats HOT_DATA;
 
 //u16 counter_bits = MEAS_CHANNEL_SIZE;
 //u8 data_read = 0;
-int counter_pixels = 0;
-
+#if ACQ_MODE == ACQ_MODE_DMA
+static struct frame_slot *dma_frame HOT_DATA = NULL;
+#endif
+
+#if ACQ_MODE == ACQ_MODE_DMA
+static int acq_dma_arm(XAxiDma *axi_dma_inst);
+static void acq_dma_complete(XAxiDma *axi_dma_inst);
+#elif ACQ_MODE == ACQ_MODE_DMA_SG
+static int acq_sg_setup(XAxiDma *axi_dma_inst);
+static void acq_sg_start(XAxiDma *axi_dma_inst);
+static void acq_sg_complete(XAxiDma *axi_dma_inst);
+#endif
+
+/* MMU section the BSP maps the low OCM with */
+#define OCM_SECTION_ADDR	0x0
+#define MMU_SECTION_SIZE	0x100000
+
+/* Software interrupt of the memory benchmark */
+#define MEM_BENCH_SGI		15
+#define MEM_BENCH_RUNS		64
+
+/* Bounds of the mem_place.h sections, from lscript.ld */
+extern u8 __ocm_bss_start[], __ocm_bss_end[];
+extern u8 __ddr_nc_start[], __ddr_nc_end[];
+
+static volatile u32 mem_bench_entry;
+
+/* The EMAC handler xemac_add() installed, emac_intr_callback wraps it */
+static XScuGic_VectorTableEntry emac_handler;
+
+/* Frame buffers only need cache maintenance where they are cached */
+static inline void frame_dcache_invalidate(UINTPTR addr, u32 len)
+{
+#if MEM_CACHED(FRAME_MEM)
+	Xil_DCacheInvalidateRange(addr, len);
+#else
+	(void)addr;
+	(void)len;
+#endif
+}
 
 void timer_callback(XScuTimer * timer_inst)
 {
@@ -124,14 +177,34 @@ void timer_callback(XScuTimer * timer_inst)
 	}
 
 	XScuTimer_ClearInterruptStatus(timer_inst);
+	event_post(EVENT_TICK);
 }
 
-static void rx_dma_callback(void *callback)
+/* One shot, platform_wake_at() arms it again */
+static void wake_timer_callback(void *callback)
+{
+	u32 control = Xil_In32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET);
+
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET,
+			control & ~(GTIMER_COMP_ENABLE | GTIMER_IRQ_ENABLE));
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_STATUS_OFFSET, 1);
+	event_post(EVENT_TX);
+}
+
+/* Received packets wait in the adapter's queue for xemacif_input() */
+static void emac_intr_callback(void *callback)
+{
+	emac_handler.Handler(emac_handler.CallBackRef);
+	event_post(EVENT_NET);
+}
+
+static ISR_CODE void rx_dma_callback(void *callback)
 {
 	u32 irq_status;
 	int time_out;
 	XAxiDma *axi_dma_inst = (XAxiDma *)callback;
 
+	platform_irq_stats.dma++;
 	irq_status = XAxiDma_IntrGetIrq(axi_dma_inst, XAXIDMA_DEVICE_TO_DMA);
 	XAxiDma_IntrAckIrq(axi_dma_inst, irq_status, XAXIDMA_DEVICE_TO_DMA);
 	//xil_printf("in rx\r\n");
@@ -154,13 +227,41 @@ static void rx_dma_callback(void *callback)
 			time_out -= 1;
 		}
 
+#if ACQ_MODE == ACQ_MODE_DMA
+		/* the reset also cleared the interrupt enables */
+		XAxiDma_IntrEnable(axi_dma_inst, XAXIDMA_IRQ_IOC_MASK |
+				XAXIDMA_IRQ_ERROR_MASK, XAXIDMA_DEVICE_TO_DMA);
+		if (dma_frame) {
+			frame_ring_abort();
+			dma_frame = NULL;
+		}
+		if (is_measurement_time)
+			acq_dma_arm(axi_dma_inst);
+#elif ACQ_MODE == ACQ_MODE_DMA_SG
+		/* descriptors in flight are lost, rebuild the ring from scratch */
+		frame_ring_abort();
+		acq_sg_setup(axi_dma_inst);
+		if (is_measurement_time)
+			acq_sg_start(axi_dma_inst);
+#endif
 		return;
 	}
 
+#if ACQ_MODE == ACQ_MODE_DMA_SG
+	if ((irq_status & (XAXIDMA_IRQ_IOC_MASK | XAXIDMA_IRQ_DELAY_MASK)))
+	{
+		rx_done = 1;
+		acq_sg_complete(axi_dma_inst);
+	}
+#else
 	if ((irq_status & XAXIDMA_IRQ_IOC_MASK))
 	{
 		rx_done = 1;
+#if ACQ_MODE == ACQ_MODE_DMA
+		acq_dma_complete(axi_dma_inst);
+#endif
 	}
+#endif
 }
 
 
@@ -203,43 +304,45 @@ static void tx_dma_callback(void *callback)
 	}
 }
 
-static void gpio_eos_intr_callback(void *callback)
+static ISR_CODE void gpio_eos_intr_callback(void *callback)
 {
+	PROBE_START(isr_start);
 	XGpio *gpio_inst = (XGpio *)callback;
 	u32 irq_status = XGpio_InterruptGetStatus(gpio_inst);
 
 	XGpio_InterruptClear(gpio_inst, GPIO_CHANNEL);
+	platform_irq_stats.eos++;
 
 	if(is_measurement_time)
 	{
 		if(irq_status & XGPIO_IR_CH1_MASK)
 		{
 			//xil_printf("Interrupt for GPIO EOS\r\n");
-			counter_pixels = 0;
-			//Xil_DCacheFlushRange((UINTPTR)tx_buffer, BUFFER_SIZE);
-			//dma_transfer();
-			send_udp = 1;
+			acq_end_of_frame();
 
 			XGpio_DiscreteWrite(&gpio_start, GPIO_CHANNEL, 0);
 		}
 		else
 		{
-			xil_printf("Unknown interrupt for GPIO EOS\r\n");
+			LOG(LOG_EOS_UNKNOWN);
 		}
 	}
 	else
 	{
-		xil_printf("Interrupt for GPIO EOS not in meas time\r\n");
+		LOG(LOG_EOS_IDLE);
 	}
 
+	PROBE_END(PROBE_EOS_ISR, isr_start);
 
 }
 
-static void gpio_eoc_intr_callback(void *callback)
+static ISR_CODE void gpio_eoc_intr_callback(void *callback)
 {
+	PROBE_START(isr_start);
 	XGpio *gpio_inst = (XGpio *)callback;
 	u32 irq_status = XGpio_InterruptGetStatus(gpio_inst);
 	XGpio_InterruptClear(gpio_inst, GPIO_CHANNEL);
+	platform_irq_stats.eoc++;
 
 	if(is_measurement_time)
 	{
@@ -251,10 +354,9 @@ static void gpio_eoc_intr_callback(void *callback)
 			//xil_printf("data read %d\r\n", data_read);
 			//counter_bits = MEAS_CHANNEL_SIZE;
 			//data_read = 0;
-			tx_buffer[counter_pixels] = XGpio_DiscreteRead(&gpio_data, GPIO_CHANNEL);
-			counter_pixels++;
+			u8 pixel = XGpio_DiscreteRead(&gpio_data, GPIO_CHANNEL);
 
-			if(counter_pixels == 1)
+			if(acq_pixel(pixel) == 0)
 			{
 				XGpio_DiscreteWrite(&gpio_start, GPIO_CHANNEL, 1);
 			}
@@ -262,15 +364,16 @@ static void gpio_eoc_intr_callback(void *callback)
 		}
 		else
 		{
-			xil_printf("Unknown interrupt for GPIO EOC\r\n");
+			LOG(LOG_EOC_UNKNOWN);
 		}
 
 	}
 	else
 	{
-		xil_printf("Interrupt for GPIO EOC not in meas time\r\n");
+		LOG(LOG_EOC_IDLE);
 	}
 
+	PROBE_END(PROBE_EOC_ISR, isr_start);
 
 }
 
@@ -311,59 +414,267 @@ void read_data_from_d_out(void)
 	counter_bits--;
 }*/
 
-void start_stop_measurements(int start)
+#if ACQ_MODE == ACQ_MODE_DMA
+/*
+ * Start an S2MM transfer of one frame. The PL ends every frame with TLAST on
+ * EOS, so the transfer completes with the actual frame length. The target is
+ * the next free ring buffer, or the ring's discard buffer when the ring is
+ * full so the stream keeps running and the frame is only counted as dropped.
+ * Transfers are as long as the frame size set at run time.
+ */
+static ISR_CODE int acq_dma_arm(XAxiDma *axi_dma_inst)
 {
-	if(start)
-	{
-		XGpio_DiscreteWrite(&gpio_start, GPIO_CHANNEL, 0);
-		is_measurement_time = 1;
+	u32 size = acq_frame_pixels();
+	u8 *target;
+
+	/* a frame that went into the integration sums left its buffer */
+	if (!dma_frame)
+		dma_frame = frame_ring_begin();
+	target = dma_frame ? dma_frame->data : frame_ring_discard();
+
+	/* no dirty line may be written back over the incoming data */
+	frame_dcache_invalidate((UINTPTR)target, size);
+
+	return XAxiDma_SimpleTransfer(axi_dma_inst, (UINTPTR)target,
+			size, XAXIDMA_DEVICE_TO_DMA);
+}
+
+static ISR_CODE void acq_dma_complete(XAxiDma *axi_dma_inst)
+{
+	u32 size = acq_frame_pixels(), len;
+
+	len = XAxiDma_ReadReg(axi_dma_inst->RegBase,
+			XAXIDMA_RX_OFFSET + XAXIDMA_BUFFLEN_OFFSET);
+	if (len > size)
+		len = size;
+
+	if (dma_frame) {
+		/* drop lines the core may have speculatively fetched meanwhile */
+		frame_dcache_invalidate((UINTPTR)dma_frame->data, size);
+		if (acq_commit_frame(dma_frame, len))
+			dma_frame = NULL;
 	}
-	else
-	{
-		is_measurement_time = 0;
+
+	if (is_measurement_time) {
+		acq_dma_arm(axi_dma_inst);
+	} else if (dma_frame) {
+		/* stopped after a summed frame, give its buffer back */
+		frame_ring_abort();
+		dma_frame = NULL;
 	}
 }
+#elif ACQ_MODE == ACQ_MODE_DMA_SG
+/*
+ * Scatter-gather capture. Every free ring buffer gets an S2MM descriptor, so
+ * the DMA moves from one frame to the next without the CPU. Completed frames
+ * are committed from the S2MM interrupt, and descriptors are re-queued as
+ * soon as the network side gives buffers back.
+ */
+#define ACQ_SG_BD_COUNT FRAME_RING_SIZE
+/* Completed frames per S2MM interrupt */
+#define ACQ_SG_COALESCE 1
 
-void init_buff(void)
+static u8 acq_bd_space[ACQ_SG_BD_COUNT * XAXIDMA_BD_MINIMUM_ALIGNMENT]
+		__attribute__((aligned(XAXIDMA_BD_MINIMUM_ALIGNMENT)));
+
+static int acq_sg_setup(XAxiDma *axi_dma_inst)
 {
-	u8 *tx_buffer_ptr = tx_buffer;
-	for (int i = 0; i < BUFFER_SIZE; i++)
-		tx_buffer_ptr[i] = (i % 10) + '0';
+	XAxiDma_BdRing *rx_ring = XAxiDma_GetRxRing(axi_dma_inst);
+	XAxiDma_Bd bd_template;
+	int status;
+
+	XAxiDma_BdRingIntDisable(rx_ring, XAXIDMA_IRQ_ALL_MASK);
+
+	status = XAxiDma_BdRingCreate(rx_ring, (UINTPTR)acq_bd_space,
+			(UINTPTR)acq_bd_space, XAXIDMA_BD_MINIMUM_ALIGNMENT,
+			ACQ_SG_BD_COUNT);
+	if (status != XST_SUCCESS) {
+		xil_printf("RX BD ring creation failed\r\n");
+		return status;
+	}
+
+	XAxiDma_BdClear(&bd_template);
+	status = XAxiDma_BdRingClone(rx_ring, &bd_template);
+	if (status != XST_SUCCESS) {
+		xil_printf("RX BD ring clone failed\r\n");
+		return status;
+	}
+
+	return XAxiDma_BdRingSetCoalesce(rx_ring, ACQ_SG_COALESCE, 0);
 }
 
-int dma_transfer(void)
+/* Queue a descriptor for every ring buffer that is free again */
+static ISR_CODE void acq_sg_refill(XAxiDma *axi_dma_inst)
 {
-	u8 *tx_buffer_ptr = tx_buffer;
-	u8 *rx_buffer_ptr = rx_buffer;
+	XAxiDma_BdRing *rx_ring = XAxiDma_GetRxRing(axi_dma_inst);
+	XAxiDma_Bd *bd;
+	struct frame_slot *slot;
+	u32 size = acq_frame_pixels();
+
+	while (XAxiDma_BdRingGetFreeCnt(rx_ring) > 0) {
+		if (XAxiDma_BdRingAlloc(rx_ring, 1, &bd) != XST_SUCCESS)
+			break;
+
+		slot = frame_ring_reserve();
+		if (!slot) {
+			XAxiDma_BdRingUnAlloc(rx_ring, 1, bd);
+			break;
+		}
 
-	tx_done = 0;
-	rx_done = 0;
-	error = 0;
+		/* no dirty line may be written back over the incoming data */
+		frame_dcache_invalidate((UINTPTR)slot->data, size);
 
-	//init_buff();
-	Xil_DCacheFlushRange((UINTPTR)tx_buffer_ptr, BUFFER_SIZE);
-	Xil_DCacheFlushRange((UINTPTR)rx_buffer_ptr, BUFFER_SIZE);
+		XAxiDma_BdSetBufAddr(bd, (UINTPTR)slot->data);
+		XAxiDma_BdSetLength(bd, size, rx_ring->MaxTransferLen);
+		XAxiDma_BdSetCtrl(bd, 0);
+		XAxiDma_BdSetId(bd, slot->index);
 
-	int status = XAxiDma_SimpleTransfer(&dma_instance,(UINTPTR) rx_buffer_ptr,
-			BUFFER_SIZE, XAXIDMA_DEVICE_TO_DMA);
-	//xil_printf("rx transfer done, status %d \r\n", status);
-	if (status != XST_SUCCESS) {
-		return XST_FAILURE;
+		if (XAxiDma_BdRingToHw(rx_ring, 1, bd) != XST_SUCCESS) {
+			LOG(LOG_SG_SUBMIT);
+			break;
+		}
 	}
+}
 
-	status = XAxiDma_SimpleTransfer(&dma_instance,(UINTPTR) tx_buffer_ptr,
-			BUFFER_SIZE, XAXIDMA_DMA_TO_DEVICE);
-	Xil_DCacheFlushRange((UINTPTR)rx_buffer_ptr, BUFFER_SIZE);
-	//xil_printf("tx transfer done, status %d \r\n", status);
-	if (status != XST_SUCCESS) {
-		return XST_FAILURE;
+static void acq_sg_start(XAxiDma *axi_dma_inst)
+{
+	XAxiDma_BdRing *rx_ring = XAxiDma_GetRxRing(axi_dma_inst);
+
+	acq_sg_refill(axi_dma_inst);
+	XAxiDma_BdRingIntEnable(rx_ring, XAXIDMA_IRQ_ALL_MASK);
+	if (XAxiDma_BdRingStart(rx_ring) != XST_SUCCESS)
+		xil_printf("RX BD ring start failed\r\n");
+}
+
+static ISR_CODE void acq_sg_complete(XAxiDma *axi_dma_inst)
+{
+	XAxiDma_BdRing *rx_ring = XAxiDma_GetRxRing(axi_dma_inst);
+	XAxiDma_Bd *bd, *bd_cur;
+	struct frame_slot *slot;
+	u32 size = acq_frame_pixels(), len;
+	int count;
+
+	count = XAxiDma_BdRingFromHw(rx_ring, XAXIDMA_ALL_BDS, &bd);
+
+	/* descriptors complete in ring order, so frames are committed in order */
+	bd_cur = bd;
+	for (int i = 0; i < count; i++) {
+		slot = frame_ring_slot(XAxiDma_BdGetId(bd_cur));
+		len = XAxiDma_BdGetActualLength(bd_cur, rx_ring->MaxTransferLen);
+		if (len > size)
+			len = size;
+
+		/* drop lines the core may have speculatively fetched meanwhile */
+		frame_dcache_invalidate((UINTPTR)slot->data, size);
+		/* the descriptor of a summed frame is gone, its buffer is
+		 * skipped in ring order */
+		if (!acq_commit_frame(slot, len))
+			frame_ring_skip(slot);
+
+		bd_cur = (XAxiDma_Bd *)XAxiDma_BdRingNext(rx_ring, bd_cur);
 	}
 
-//	while (!tx_done && !rx_done && !error) {
-			/* NOP */
-//	}
+	if (count > 0)
+		XAxiDma_BdRingFree(rx_ring, count, bd);
+
+	if (!is_measurement_time)
+		return;
+
+	acq_sg_refill(axi_dma_inst);
+
+	/* the S2MM channel now waits for a buffer, the stream is stalled
+	 * until platform_acq_poll() finds one the network gave back */
+	if (rx_ring->HwCnt == 0)
+		frame_ring_stats.dma_ring_dry++;
+}
+#endif
+
+/* Main loop hook of the acquisition path */
+void platform_acq_poll(void)
+{
+#if ACQ_MODE == ACQ_MODE_DMA_SG
+	if (!is_measurement_time)
+		return;
+
+	/* the S2MM interrupt refills the same descriptor ring */
+	XScuGic_DisableIntr(INTC_DIST_BASE_ADDR, RX_INTR_ID);
+	acq_sg_refill(&dma_instance);
+	XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, RX_INTR_ID);
+#endif
+}
+
+int platform_acq_quiesce(void)
+{
+#if ACQ_MODE_IS_DMA
+	int time_out = RESET_TIMEOUT_COUNTER;
+
+	if (is_measurement_time)
+		return -1;
+
+	/* a transfer armed before the stop stays pending, into a ring slot or
+	 * the discard buffer, until the PL sends another frame */
+	XScuGic_DisableIntr(INTC_DIST_BASE_ADDR, RX_INTR_ID);
+	XAxiDma_Reset(&dma_instance);
+	while (time_out && !XAxiDma_ResetIsDone(&dma_instance))
+		time_out--;
+
+#if ACQ_MODE == ACQ_MODE_DMA
+	/* the reset also cleared the interrupt enables */
+	XAxiDma_IntrEnable(&dma_instance, XAXIDMA_IRQ_IOC_MASK |
+			XAXIDMA_IRQ_ERROR_MASK, XAXIDMA_DEVICE_TO_DMA);
+	dma_frame = NULL;
+#else
+	/* the descriptors are reclaimed with the ring, acq_sg_start()
+	 * enables their interrupts again */
+	acq_sg_setup(&dma_instance);
+#endif
+	XAxiDma_IntrEnable(&dma_instance, XAXIDMA_IRQ_IOC_MASK,
+			XAXIDMA_DMA_TO_DEVICE);
+	/* the slots the transfers were armed with */
+	frame_ring_abort();
+	XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, RX_INTR_ID);
+
+	if (!time_out) {
+		LOG(LOG_DMA_RESET);
+		return -1;
+	}
+#endif
+	return 0;
+}
 
-	return XST_SUCCESS;
+void start_stop_measurements(int start)
+{
+	if(start)
+	{
+#if ACQ_MODE == ACQ_MODE_DMA
+		/* the PL streams pixels for as long as the start signal is high */
+		acq_reset();
+		is_measurement_time = 1;
+		if (!dma_frame && !XAxiDma_Busy(&dma_instance, XAXIDMA_DEVICE_TO_DMA))
+			acq_dma_arm(&dma_instance);
+		XGpio_DiscreteWrite(&gpio_start, GPIO_CHANNEL, 1);
+		return;
+#elif ACQ_MODE == ACQ_MODE_DMA_SG
+		acq_reset();
+		is_measurement_time = 1;
+		XScuGic_DisableIntr(INTC_DIST_BASE_ADDR, RX_INTR_ID);
+		acq_sg_start(&dma_instance);
+		XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, RX_INTR_ID);
+		XGpio_DiscreteWrite(&gpio_start, GPIO_CHANNEL, 1);
+		return;
+#endif
+		XGpio_DiscreteWrite(&gpio_start, GPIO_CHANNEL, 0);
+		/* never resume into a frame interrupted by the last stop */
+		acq_reset();
+		is_measurement_time = 1;
+	}
+	else
+	{
+#if ACQ_MODE_IS_DMA
+		XGpio_DiscreteWrite(&gpio_start, GPIO_CHANNEL, 0);
+#endif
+		is_measurement_time = 0;
+	}
 }
 
 void platform_setup_gpio(void)
@@ -416,10 +727,20 @@ void platform_setup_dma(void)
 		return;
 	}
 
+#if ACQ_MODE == ACQ_MODE_DMA_SG
+	if(!XAxiDma_HasSg(&dma_instance)){
+		xil_printf("Device not configured as SG mode \r\n");
+		return;
+	}
+
+	acq_sg_setup(&dma_instance);
+	return;
+#else
 	if(XAxiDma_HasSg(&dma_instance)){
 		xil_printf("Device configured as SG mode \r\n");
 		return;
 	}
+#endif
 
 	XAxiDma_IntrDisable(&dma_instance, XAXIDMA_IRQ_ALL_MASK,
 						XAXIDMA_DMA_TO_DEVICE);
@@ -454,9 +775,11 @@ void platform_setup_timer(void)
 
 	XScuTimer_EnableAutoReload(&timer_instance);
 	/*
-	 * Set for 250 milli seconds timeout.
+	 * Interrupt every EVENT_TICK_MS, the private timer runs at half the
+	 * CPU clock.
 	 */
-	timer_load_value = XPAR_CPU_CORTEXA9_0_CPU_CLK_FREQ_HZ / 8;
+	timer_load_value = XPAR_CPU_CORTEXA9_0_CPU_CLK_FREQ_HZ / 2000 *
+			EVENT_TICK_MS;
 
 	XScuTimer_LoadTimer(&timer_instance, timer_load_value);
 	return;
@@ -475,6 +798,9 @@ void platform_setup_interrupts(void)
 	XScuGic_RegisterHandler(INTC_BASE_ADDR, TIMER_IRPT_INTR,
 					(Xil_ExceptionHandler)timer_callback,
 					(void *)&timer_instance);
+	XScuGic_RegisterHandler(INTC_BASE_ADDR, WAKE_INTR_ID,
+					(Xil_ExceptionHandler)wake_timer_callback,
+					NULL);
 	XScuGic_RegisterHandler(INTC_BASE_ADDR, RX_INTR_ID,
 					(Xil_ExceptionHandler)rx_dma_callback,
 					(void *)&dma_instance);
@@ -493,6 +819,7 @@ void platform_setup_interrupts(void)
 
 
 	XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, TIMER_IRPT_INTR);
+	XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, WAKE_INTR_ID);
 	XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, RX_INTR_ID);
 	XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, TX_INTR_ID);
 	//XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, GPIO_D_TRIG_INTR_ID);
@@ -504,6 +831,13 @@ void platform_setup_interrupts(void)
 
 void platform_enable_interrupts()
 {
+	XScuGic_Config *intc = XScuGic_LookupConfig(INTC_DEVICE_ID);
+
+	/* xemac_add() has connected the EMAC by now */
+	emac_handler = intc->HandlerTable[EMAC_INTR_ID];
+	XScuGic_RegisterHandler(INTC_BASE_ADDR, EMAC_INTR_ID,
+			(Xil_ExceptionHandler)emac_intr_callback, NULL);
+
 	Xil_ExceptionEnable();
 
 	XScuTimer_EnableInterrupt(&timer_instance);
@@ -511,6 +845,12 @@ void platform_enable_interrupts()
 
 	XAxiDma_IntrEnable(&dma_instance, XAXIDMA_IRQ_IOC_MASK,
 							XAXIDMA_DMA_TO_DEVICE);
+#if ACQ_MODE == ACQ_MODE_DMA
+	XAxiDma_IntrEnable(&dma_instance, XAXIDMA_IRQ_IOC_MASK |
+			XAXIDMA_IRQ_ERROR_MASK, XAXIDMA_DEVICE_TO_DMA);
+#elif ACQ_MODE == ACQ_MODE_DMA_SG
+	/* S2MM interrupts are enabled on the BD ring once capture starts */
+#else
 	XAxiDma_IntrEnable(&dma_instance, XAXIDMA_IRQ_IOC_MASK,
 							XAXIDMA_DEVICE_TO_DMA);
 
@@ -520,12 +860,113 @@ void platform_enable_interrupts()
 	//XGpio_InterruptEnable(&gpio_trig, XGPIO_IR_CH1_MASK);
 	XGpio_InterruptEnable(&gpio_eoc, XGPIO_IR_CH1_MASK);
 	XGpio_InterruptEnable(&gpio_eos, XGPIO_IR_CH1_MASK);
+#endif
 
 	return;
 }
 
+/* Start the PMU cycle counter, counting every CPU clock */
+static void platform_setup_cycle_counter(void)
+{
+	/* PMCR: enable the counters and reset the cycle counter */
+	mtcp(XREG_CP15_PERF_MONITOR_CTRL, 0x5);
+	/* PMCNTENSET: enable the cycle counter */
+	mtcp(XREG_CP15_COUNT_ENABLE_SET, 0x80000000);
+}
+
+/* Map and clear the sections of mem_place.h before anything uses them */
+static void platform_setup_memory(void)
+{
+	UINTPTR addr;
+
+	/* no line of them may be written back once they are non-cacheable */
+	Xil_DCacheFlush();
+#if OCM_NONCACHEABLE
+	Xil_SetTlbAttributes(OCM_SECTION_ADDR, NORM_NONCACHE);
+#endif
+	for (addr = (UINTPTR)__ddr_nc_start; addr < (UINTPTR)__ddr_nc_end;
+			addr += MMU_SECTION_SIZE)
+		Xil_SetTlbAttributes(addr, NORM_NONCACHE);
+
+	memset(__ocm_bss_start, 0, __ocm_bss_end - __ocm_bss_start);
+	memset(__ddr_nc_start, 0, __ddr_nc_end - __ddr_nc_start);
+
+	xil_printf("Frames in %s, ISRs in %s, hot data in %s\r\n",
+			MEM_NAME(FRAME_MEM), MEM_NAME(ISR_MEM), MEM_NAME(HOT_MEM));
+}
+
+static ISR_CODE void mem_bench_callback(void *callback)
+{
+	mem_bench_entry = get_cycles();
+}
+
+/* Mean cycles from raising a software interrupt to its handler running */
+static u32 mem_bench_irq(int cold)
+{
+	u32 start, sum = 0;
+
+	for (int i = 0; i < MEM_BENCH_RUNS; i++) {
+		if (cold) {
+			/* the handler, its data and the GIC driver come from
+			 * wherever they are placed */
+			Xil_DCacheFlush();
+			Xil_ICacheInvalidate();
+		}
+		mem_bench_entry = 0;
+		start = get_cycles();
+		XScuGic_WriteReg(INTC_DIST_BASE_ADDR, XSCUGIC_SFI_TRIG_OFFSET,
+				(1 << 16) | MEM_BENCH_SGI);
+		while (!mem_bench_entry)
+			;
+		sum += mem_bench_entry - start;
+	}
+	return sum / MEM_BENCH_RUNS;
+}
+
+int platform_mem_bench(struct platform_mem_bench *r)
+{
+	u8 *frame = frame_ring_discard();
+	u32 size = acq_frame_pixels(), start, sum = 0;
+
+	/* the discard buffer is a DMA target while capturing */
+	if (is_measurement_time || !frame)
+		return -1;
+
+	XScuGic_RegisterHandler(INTC_BASE_ADDR, MEM_BENCH_SGI,
+			(Xil_ExceptionHandler)mem_bench_callback, NULL);
+	XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, MEM_BENCH_SGI);
+	r->irq_warm = mem_bench_irq(0);
+	r->irq_cold = mem_bench_irq(1);
+	XScuGic_DisableIntr(INTC_DIST_BASE_ADDR, MEM_BENCH_SGI);
+
+	/* dirty, as the send path leaves a frame it coded in place, then
+	 * what a DMA transfer into it costs the CPU */
+	r->frame_maint = 0;
+	r->frame_read = 0;
+	for (int i = 0; i < MEM_BENCH_RUNS; i++) {
+		memset(frame, i, size);
+		start = get_cycles();
+		frame_dcache_invalidate((UINTPTR)frame, size);
+		frame_dcache_invalidate((UINTPTR)frame, size);
+		r->frame_maint += get_cycles() - start;
+
+		start = get_cycles();
+		for (u32 j = 0; j + 4 <= size; j += 4)
+			sum += *(volatile u32 *)(frame + j);
+		r->frame_read += get_cycles() - start;
+	}
+	r->frame_maint /= MEM_BENCH_RUNS;
+	r->frame_read /= MEM_BENCH_RUNS;
+	(void)sum;
+	return 0;
+}
+
 void init_platform()
 {
+	platform_setup_memory();
+	platform_setup_cycle_counter();
+	frame_ring_init();
+	acq_init();
 	platform_setup_timer();
 	platform_setup_dma();
 	platform_setup_gpio();
@@ -549,3 +990,71 @@ u64 get_time_ms()
 	return (t_cur/COUNTS_PER_MILLI_SECOND);
 }
 
+
+u64 get_time_us()
+{
+#define COUNTS_PER_MICRO_SECOND (COUNTS_PER_SECOND/1000000)
+	XTime t_cur = 0;
+	XTime_GetTime(&t_cur);
+	return (t_cur/COUNTS_PER_MICRO_SECOND);
+}
+
+/*
+ * The comparator of the global timer, which get_time_us() reads. It only
+ * fires when the counter passes the compare value, a time already gone is
+ * posted at once.
+ */
+void platform_wake_at(u64 time_us)
+{
+	u32 control = Xil_In32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET);
+	XTime compare = time_us * COUNTS_PER_MICRO_SECOND;
+
+	control &= ~(GTIMER_COMP_ENABLE | GTIMER_IRQ_ENABLE);
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET, control);
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_STATUS_OFFSET, 1);
+	if (!time_us)
+		return;
+
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_COMPARE_LOWER_OFFSET,
+			(u32)compare);
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_COMPARE_UPPER_OFFSET,
+			(u32)(compare >> 32));
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET,
+			control | GTIMER_COMP_ENABLE | GTIMER_IRQ_ENABLE);
+	if (get_time_us() >= time_us)
+		event_post(EVENT_TX);
+}
+
+u32 get_cycles()
+{
+	return mfcp(XREG_CP15_PERF_CYCLE_COUNTER);
+}
+
+u32 get_cycles_per_us()
+{
+	return XPAR_CPU_CORTEXA9_0_CPU_CLK_FREQ_HZ / 1000000;
+}
+
+u32 platform_sleep()
+{
+	XTime start, end;
+
+	/* a masked interrupt still ends WFI and is taken once IRQs are
+	 * enabled again, so an event posted after the check is not slept
+	 * through */
+	Xil_ExceptionDisable();
+	if (event_pending()) {
+		Xil_ExceptionEnable();
+		return 0;
+	}
+	XTime_GetTime(&start);
+	dsb();
+	wfi();
+	XTime_GetTime(&end);
+	Xil_ExceptionEnable();
+
+	/* the cycle counter stops while WFI gates the core clock, the global
+	 * timer does not */
+	return (u32)(end - start) *
+			(XPAR_CPU_CORTEXA9_0_CPU_CLK_FREQ_HZ / COUNTS_PER_SECOND);
+}
@@ -0,0 +1,118 @@
+/*
+ * telem_proto.h
+ *
+ * Wire format of the telemetry datagrams the board sends to UDP_TELEM_PORT
+ * of wherever the stream goes, all fields in network byte order:
+ *
+ *  offset size field
+ *       0    2 magic 'M' 'T'
+ *       2    1 version
+ *       3    1 number of counters that follow
+ *       4    4 datagram sequence number
+ *       8    8 board time in useconds
+ *      16  8*n counters, in TELEM_* order
+ *
+ * Counters only ever grow while the board runs, rates are the difference of
+ * two datagrams over the difference of their times. A counter that went
+ * back means the board was reset. Gauges, TELEM_GAUGE_FIRST to
+ * TELEM_GAUGE_LAST, are the value at the time of the datagram. Later
+ * versions only append counters, receivers use the ones they know.
+ *
+ * This header is shared with the host tools and only depends on stdint.h.
+ */
+
+#ifndef __TELEM_PROTO_H_
+#define __TELEM_PROTO_H_
+
+#include <stdint.h>
+#include "frame_proto.h"
+
+#define TELEM_MAGIC0		'M'
+#define TELEM_MAGIC1		'T'
+#define TELEM_PROTO_VERSION	1
+#define TELEM_HEADER_SIZE	16
+
+/* Counters */
+#define TELEM_TX_BYTES			0	/* payload bytes sent */
+#define TELEM_TX_DATAGRAMS		1
+#define TELEM_TX_FRAMES			2
+#define TELEM_TX_PARKED			3	/* datagrams refused at least once */
+#define TELEM_TX_RETRIES		4	/* sends refused by the full TX ring */
+#define TELEM_TX_DROPPED_DATAGRAMS	5
+#define TELEM_TX_DROPPED_FRAMES		6
+#define TELEM_TX_SEND_ERRORS		7
+#define TELEM_TX_DEFERRED		8	/* datagrams the pacer held, once each */
+#define TELEM_FRAMES_CAPTURED		9
+#define TELEM_FRAMES_DROPPED		10	/* no free buffer at frame start */
+#define TELEM_PIXELS_OVERRUN		11
+#define TELEM_DMA_RING_DRY		12
+#define TELEM_IRQ_EOC			13	/* interrupts taken */
+#define TELEM_IRQ_EOS			14
+#define TELEM_IRQ_DMA			15
+/* Gauges */
+#define TELEM_GAUGE_FIRST		16
+#define TELEM_RING_DEPTH		16	/* frames waiting to be sent */
+#define TELEM_RING_HIGH_WATER		17
+#define TELEM_TX_QUEUE_DEPTH		18	/* datagrams parked */
+#define TELEM_GAUGE_LAST		18
+/* Counters */
+#define TELEM_IDLE_US			19	/* main loop asleep */
+#define TELEM_WAKEUPS			20
+#define TELEM_COUNT			21
+
+#define TELEM_IS_GAUGE(id) \
+		((id) >= TELEM_GAUGE_FIRST && (id) <= TELEM_GAUGE_LAST)
+
+#define TELEM_SIZE(n)		(TELEM_HEADER_SIZE + 8 * (n))
+
+static inline void telem_put64(uint8_t *p, uint64_t v)
+{
+	frame_put32(p, (uint32_t)(v >> 32));
+	frame_put32(p + 4, (uint32_t)v);
+}
+
+static inline uint64_t telem_get64(const uint8_t *p)
+{
+	return (uint64_t)frame_get32(p) << 32 | frame_get32(p + 4);
+}
+
+/* Serialize TELEM_COUNT counters into TELEM_SIZE(TELEM_COUNT) bytes */
+static inline void telem_put(uint8_t *buf, uint32_t sequence, uint64_t time_us,
+		const uint64_t *counters)
+{
+	buf[0] = TELEM_MAGIC0;
+	buf[1] = TELEM_MAGIC1;
+	buf[2] = TELEM_PROTO_VERSION;
+	buf[3] = TELEM_COUNT;
+	frame_put32(buf + 4, sequence);
+	telem_put64(buf + 8, time_us);
+	for (int i = 0; i < TELEM_COUNT; i++)
+		telem_put64(buf + TELEM_HEADER_SIZE + 8 * i, counters[i]);
+}
+
+/*
+ * Parse the datagram of len bytes at buf into counters, the ones it does not
+ * carry are set to 0. Returns the number it carries, or -1 if the datagram
+ * is no telemetry or cut off.
+ */
+static inline int telem_get(const uint8_t *buf, uint32_t len,
+		uint32_t *sequence, uint64_t *time_us, uint64_t *counters)
+{
+	int n;
+
+	if (len < TELEM_HEADER_SIZE || buf[0] != TELEM_MAGIC0 ||
+			buf[1] != TELEM_MAGIC1 || buf[2] < 1)
+		return -1;
+	n = buf[3];
+	if (len < (uint32_t)TELEM_SIZE(n))
+		return -1;
+
+	*sequence = frame_get32(buf + 4);
+	*time_us = telem_get64(buf + 8);
+	for (int i = 0; i < TELEM_COUNT; i++)
+		counters[i] = i < n ?
+				telem_get64(buf + TELEM_HEADER_SIZE + 8 * i) : 0;
+	return n;
+}
+
+#endif /* __TELEM_PROTO_H_ */
@@ -0,0 +1,106 @@
+/*
+ * telemetry.c
+ *
+ * The send path counters are 64 bit already, only the main loop updates
+ * them. Those of the interrupt handlers stay 32 bit, a 64 bit increment
+ * takes two stores on the A9 and could be read half done. They are widened
+ * here by adding up what they advanced since the last snapshot, which is
+ * right as long as a snapshot is taken before they wrap.
+ */
+
+#include "telemetry.h"
+#include "udp_perf_client.h"
+#include "frame_ring.h"
+#include "tx_pacer.h"
+#include "event_loop.h"
+
+/* An interrupt counter widened to 64 bits */
+struct telem_wide {
+	u32 last;
+	u64 total;
+};
+
+static struct udp_pcb *telem_pcb;
+static u32 telem_sequence;
+static u64 telem_last_ms;
+
+static struct telem_wide wide_captured, wide_dropped, wide_overrun,
+		wide_dry, wide_eoc, wide_eos, wide_dma;
+
+static u64 telem_widen(struct telem_wide *w, u32 now)
+{
+	w->total += (u32)(now - w->last);
+	w->last = now;
+	return w->total;
+}
+
+void telemetry_init(void)
+{
+	telem_pcb = udp_new();
+	if (!telem_pcb || udp_bind(telem_pcb, IP_ADDR_ANY, 0) != ERR_OK) {
+		xil_printf("telemetry: Error in PCB creation\r\n");
+		telem_pcb = NULL;
+	}
+	telem_last_ms = get_time_ms();
+}
+
+void telemetry_snapshot(uint64_t *c)
+{
+	c[TELEM_TX_BYTES] = udp_tx_stats.bytes;
+	c[TELEM_TX_DATAGRAMS] = udp_tx_stats.datagrams;
+	c[TELEM_TX_FRAMES] = udp_tx_stats.frames;
+	c[TELEM_TX_PARKED] = udp_tx_stats.parked;
+	c[TELEM_TX_RETRIES] = udp_tx_stats.retries;
+	c[TELEM_TX_DROPPED_DATAGRAMS] = udp_tx_stats.dropped_datagrams;
+	c[TELEM_TX_DROPPED_FRAMES] = udp_tx_stats.dropped_frames;
+	c[TELEM_TX_SEND_ERRORS] = udp_tx_stats.send_errors;
+	c[TELEM_TX_DEFERRED] = tx_pacer_stats.deferred;
+	c[TELEM_FRAMES_CAPTURED] = telem_widen(&wide_captured,
+			frame_ring_stats.frames_captured);
+	c[TELEM_FRAMES_DROPPED] = telem_widen(&wide_dropped,
+			frame_ring_stats.frames_dropped);
+	c[TELEM_PIXELS_OVERRUN] = telem_widen(&wide_overrun,
+			frame_ring_stats.pixels_overrun);
+	c[TELEM_DMA_RING_DRY] = telem_widen(&wide_dry,
+			frame_ring_stats.dma_ring_dry);
+	c[TELEM_IRQ_EOC] = telem_widen(&wide_eoc, platform_irq_stats.eoc);
+	c[TELEM_IRQ_EOS] = telem_widen(&wide_eos, platform_irq_stats.eos);
+	c[TELEM_IRQ_DMA] = telem_widen(&wide_dma, platform_irq_stats.dma);
+	c[TELEM_RING_DEPTH] = frame_ring_depth();
+	c[TELEM_RING_HIGH_WATER] = frame_ring_stats.queue_high_water;
+	c[TELEM_TX_QUEUE_DEPTH] = udp_tx_queued();
+	c[TELEM_IDLE_US] = event_stats.idle_cycles / get_cycles_per_us();
+	c[TELEM_WAKEUPS] = event_stats.wakeups;
+}
+
+void telemetry_poll(void)
+{
+	uint64_t counters[TELEM_COUNT];
+	struct pbuf *p;
+	u64 now;
+#if UDP_MCAST
+	ip_addr_t group;
+	u32 ttl;
+#endif
+
+	if (!telem_pcb || !udp_tx_config.telem_ms)
+		return;
+	now = get_time_ms();
+	if (now - telem_last_ms < udp_tx_config.telem_ms)
+		return;
+	telem_last_ms = now;
+
+	p = pbuf_alloc(PBUF_TRANSPORT, TELEM_SIZE(TELEM_COUNT), PBUF_RAM);
+	if (!p)
+		return;
+	telemetry_snapshot(counters);
+	telem_put(p->payload, telem_sequence++, get_time_us(), counters);
+
+#if UDP_MCAST
+	if (udp_stream_multicast(&group, &ttl))
+		udp_set_multicast_ttl(telem_pcb, ttl);
+#endif
+	/* a lost datagram only costs resolution, the next one has the sums */
+	udp_sendto(telem_pcb, p, udp_stream_dest(), UDP_TELEM_PORT);
+	pbuf_free(p);
+}
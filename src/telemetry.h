@@ -0,0 +1,25 @@
+/*
+ * telemetry.h
+ *
+ * Sends the counters of the capture and send paths as telemetry datagrams
+ * (telem_proto.h) to UDP_TELEM_PORT, every udp_tx_config.telem_ms. The
+ * datagrams are built and sent from the main loop, between two passes of
+ * the send path, a host turns them into rates (host/telem_dump.c).
+ */
+
+#ifndef __TELEMETRY_H_
+#define __TELEMETRY_H_
+
+#include "xil_types.h"
+#include "telem_proto.h"
+
+/* Bind the telemetry PCB, call once lwIP is up */
+void telemetry_init(void);
+
+/* The counters as they are now, TELEM_COUNT of them */
+void telemetry_snapshot(uint64_t *counters);
+
+/* Send a datagram if one is due */
+void telemetry_poll(void);
+
+#endif /* __TELEMETRY_H_ */
@@ -0,0 +1,96 @@
+/*
+ * tx_pacer.c
+ *
+ * Tokens are kept in bit-microseconds, i.e. refilling adds elapsed_us * rate
+ * and a datagram costs its bits * 10^6, so no rounding error builds up at
+ * any rate. Only the main loop calls into the pacer.
+ */
+
+#include "tx_pacer.h"
+#include "platform.h"
+
+#define US_PER_SEC 1000000ULL
+
+struct tx_pacer_stats tx_pacer_stats;
+
+static u32 pacer_rate_kbps;
+static u32 pacer_burst;
+static u64 pacer_tokens;
+static u64 pacer_last_us;
+/* when the datagram refused last has its tokens */
+static u64 pacer_ready_us;
+/* that datagram is still waiting, it is counted as deferred once */
+static u8 pacer_holding;
+
+static u64 pacer_cost(u32 len)
+{
+	return (u64)(len + TX_PACER_OVERHEAD) * 8 * US_PER_SEC;
+}
+
+void tx_pacer_init(void)
+{
+	tx_pacer_stats.deferred = 0;
+	tx_pacer_set(TX_PACER_RATE_KBPS, TX_PACER_BURST_BYTES);
+}
+
+void tx_pacer_set(u32 rate_kbps, u32 burst_bytes)
+{
+	pacer_rate_kbps = rate_kbps;
+	pacer_burst = burst_bytes;
+	/* start full, the new rate applies from now on */
+	pacer_tokens = pacer_cost(burst_bytes);
+	pacer_last_us = get_time_us();
+	pacer_holding = 0;
+}
+
+u32 tx_pacer_rate(void)
+{
+	return pacer_rate_kbps;
+}
+
+u32 tx_pacer_burst(void)
+{
+	return pacer_burst;
+}
+
+int tx_pacer_admit(u32 len)
+{
+	u64 now, cap, cost, rate, elapsed;
+
+	if (!pacer_rate_kbps)
+		return 1;
+
+	now = get_time_us();
+	rate = (u64)pacer_rate_kbps * 1000;
+	cap = pacer_cost(pacer_burst);
+	cost = pacer_cost(len);
+	/* a datagram larger than the bucket goes once the bucket is full */
+	if (cost > cap)
+		cost = cap;
+
+	/* past the time that fills the bucket the product could overflow */
+	elapsed = now - pacer_last_us;
+	if (elapsed > cap / rate)
+		elapsed = cap / rate + 1;
+	pacer_tokens += elapsed * rate;
+	if (pacer_tokens > cap)
+		pacer_tokens = cap;
+	pacer_last_us = now;
+
+	if (pacer_tokens < cost) {
+		if (!pacer_holding)
+			tx_pacer_stats.deferred++;
+		pacer_holding = 1;
+		pacer_ready_us = now + (cost - pacer_tokens + rate - 1) / rate;
+		return 0;
+	}
+
+	pacer_tokens -= cost;
+	pacer_holding = 0;
+	return 1;
+}
+
+u64 tx_pacer_ready_us(void)
+{
+	return pacer_ready_us;
+}
@@ -0,0 +1,48 @@
+/*
+ * tx_pacer.h
+ *
+ * Token bucket limiting the transmit bitrate. The bucket fills at the
+ * target rate up to the burst size and every datagram takes its size in
+ * tokens, so datagrams leave evenly spaced instead of in bursts that fill
+ * the EMAC TX ring.
+ */
+
+#ifndef __TX_PACER_H_
+#define __TX_PACER_H_
+
+#include "xil_types.h"
+
+/* Default target rate in kbit/s, 0 sends unpaced */
+#define TX_PACER_RATE_KBPS 0
+
+/* Default bucket size in bytes, datagrams larger than it wait for a full
+ * bucket */
+#define TX_PACER_BURST_BYTES 6000
+
+/* Ethernet, IP and UDP headers the bucket charges per datagram */
+#define TX_PACER_OVERHEAD (14 + 20 + 8)
+
+struct tx_pacer_stats {
+	/* datagrams held back because the bucket was empty, each once
+	 * however often it is tried again */
+	u64 deferred;
+};
+
+extern struct tx_pacer_stats tx_pacer_stats;
+
+void tx_pacer_init(void);
+
+/* Change rate and burst, may be called while streaming */
+void tx_pacer_set(u32 rate_kbps, u32 burst_bytes);
+u32 tx_pacer_rate(void);
+u32 tx_pacer_burst(void);
+
+/* Take the tokens for a datagram of len payload bytes. Returns 0 if it has
+ * to wait, the caller tries again later with the same or a larger len. */
+int tx_pacer_admit(u32 len);
+
+/* get_time_us() at which the datagram tx_pacer_admit() refused last gets
+ * its tokens */
+u64 tx_pacer_ready_us(void);
+
+#endif /* __TX_PACER_H_ */
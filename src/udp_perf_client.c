@@ -29,19 +29,75 @@
 /* Connection handle for a UDP Client session */
 
 #include "udp_perf_client.h"
+#include "frame_ring.h"
+#include "frame_arena.h"
+#include "acquisition.h"
+#include "frame_codec.h"
+#include "frame_pack.h"
+#include "frame_sparse.h"
+#include "latency_probe.h"
+#include "tx_pacer.h"
+#include "control.h"
+#include "telemetry.h"
+#include "log_ring.h"
+#include "event_loop.h"
 #include <string.h>
 
 
+#if UDP_MCAST && !(LWIP_IGMP && LWIP_MULTICAST_TX_OPTIONS)
+#error "UDP_MCAST needs LWIP_IGMP and LWIP_MULTICAST_TX_OPTIONS enabled in the lwIP BSP settings"
+#endif
+
 extern struct netif server_netif;
 static struct udp_pcb *pcb;
+static struct udp_pcb *ctrl_pcb;
+/* where the datagrams go, the server or a multicast group */
+static ip_addr_t server_addr;
+static ip_addr_t tx_dest;
+static u32 tx_mcast_ttl = UDP_MCAST_TTL;
+
+struct udp_consumer {
+	ip_addr_t addr;
+	u16_t port;
+};
+
+static struct udp_consumer tx_consumers[UDP_MCAST_CONSUMERS];
+static u32 tx_consumer_count = 0;
+struct udp_tx_stats udp_tx_stats;
+#if UDP_TX_CODEC
+static struct frame_codec tx_codec;
+#endif
+/* carved from the frame arena with the frame buffers, as large as a frame */
+static u8 *tx_sparse_buf;
+static u32 tx_sparse_size;
+static u64_t session_start;
 #define FINISH	1
-/* Report interval time in ms */
-#define REPORT_INTERVAL_TIME (INTERIM_REPORT_INTERVAL * 1000)
-/* End time in ms */
-#define END_TIME (UDP_TIME_INTERVAL * 600)
 
-#if DEBUG_ENABLE
+struct udp_tx_config udp_tx_config = {
+	.batch_frames = UDP_BATCH_FRAMES,
+	.batch_flush_us = UDP_BATCH_FLUSH_US,
+	.sparse_threshold = UDP_TX_SPARSE_THRESHOLD,
+	/* Report interval time in ms */
+	.report_ms = INTERIM_REPORT_INTERVAL * 1000,
+	/* End time in ms */
+	.session_ms = UDP_TIME_INTERVAL * 600,
+	.telem_ms = UDP_TELEM_INTERVAL,
+};
+
+/* labels for formats [KMG] */
+static const char kLabel[] =
+{
+	' ',
+	'K',
+	'M',
+	'G'
+};
+
+#if UDP_UART_REPORT
 static struct perf_stats client;
+/* session time of the final report still to be printed, 0 for none */
+static u64_t report_done_ms = 0;
+
 static void print_udp_conn_stats(void)
 {
 	xil_printf("[%3d] local %s port %d connected with ",
@@ -52,72 +108,86 @@ static void print_udp_conn_stats(void)
 	xil_printf("[ ID] Interval\t\tTransfer   Bandwidth\n\r");
 }
 
-static void stats_buffer(char* outString,
-		double data, enum measure_t type)
+/* A value scaled down to at most 4 digits and its unit label */
+struct stats_value {
+	u32 whole;
+	u32 tenths;
+	char label;
+};
+
+/* Integer only, xil_printf has neither floats nor 64 bit values */
+static void stats_buffer(struct stats_value *out, u64_t data,
+		enum measure_t type)
 {
 	int conv = KCONV_UNIT;
-	const char *format;
-	double unit = 1024.0;
-
-	if (type == SPEED)
-		unit = 1000.0;
+	u32 unit = type == SPEED ? 1000 : 1024;
 
-	while (data >= unit && conv <= KCONV_GIGA) {
+	data *= 10;
+	while (data >= (u64_t)unit * 10 && conv < KCONV_GIGA) {
 		data /= unit;
 		conv++;
 	}
-
-	/* Fit data in 4 places */
-	if (data < 9.995) { /* 9.995 rounded to 10.0 */
-		format = "%4.2f %c"; /* #.## */
-	} else if (data < 99.95) { /* 99.95 rounded to 100 */
-		format = "%4.1f %c"; /* ##.# */
-	} else {
-		format = "%4.0f %c"; /* #### */
-	}
-	sprintf(outString, format, data, kLabel[conv]);
+	out->whole = (u32)(data / 10);
+	out->tenths = (u32)(data % 10);
+	out->label = kLabel[conv];
 }
 
-
 /* The report function of a UDP client session */
 static void udp_conn_report(u64_t diff,
 		enum report_type report_type)
 {
-	u64_t total_len;
-	double duration, bandwidth = 0;
-	char data[16], perf[16], time[64];
+	struct stats_value data, perf;
+	u64_t total_len, from, idle;
 
 	if (report_type == INTER_REPORT) {
-		total_len = client.i_report.total_bytes;
+		total_len = udp_tx_stats.bytes - client.i_report.start_bytes;
+		from = client.i_report.last_report_time;
 	} else {
-		client.i_report.last_report_time = 0;
-		total_len = client.total_bytes;
-	}
-
-	/* Converting duration from milliseconds to secs,
-	 * and bandwidth to bits/sec .
-	 */
-	duration = diff / 1000.0; /* secs */
-	if (duration)
-		bandwidth = (total_len / duration) * 8.0;
-
-	stats_buffer(data, total_len, BYTES);
-	stats_buffer(perf, bandwidth, SPEED);
-	/* On 32-bit platforms, xil_printf is not able to print
-	 * u64_t values, so converting these values in strings and
-	 * displaying results
-	 */
-	sprintf(time, "%4.1f-%4.1f sec",
-			(double)client.i_report.last_report_time,
-			(double)(client.i_report.last_report_time + duration));
-	xil_printf("[%3d] %s  %sBytes  %sbits/sec\n\r", client.client_id,
-			time, data, perf);
-
-	if (report_type == INTER_REPORT)
-		client.i_report.last_report_time += duration;
-	else
-		xil_printf("[%3d] sent %llu datagrams\n\r",
-				client.client_id, client.cnt_datagrams);
+		total_len = udp_tx_stats.bytes - client.start_bytes;
+		from = 0;
+	}
+
+	stats_buffer(&data, total_len, BYTES);
+	/* bits/sec over a duration in ms */
+	stats_buffer(&perf, diff ? total_len * 8000 / diff : 0, SPEED);
+	xil_printf("[%3d] %d.%d-%d.%d sec  %d.%d %cBytes  %d.%d %cbits/sec\n\r",
+			client.client_id, (u32)(from / 1000),
+			(u32)(from % 1000 / 100), (u32)((from + diff) / 1000),
+			(u32)((from + diff) % 1000 / 100), data.whole, data.tenths,
+			data.label, perf.whole, perf.tenths, perf.label);
+
+	if (report_type == INTER_REPORT) {
+		client.i_report.last_report_time += diff;
+		return;
+	}
+
+	xil_printf("[%3d] sent %d frames in %d datagrams\n\r",
+			client.client_id,
+			(u32)(udp_tx_stats.frames - client.start_frames),
+			(u32)(udp_tx_stats.datagrams - client.start_datagrams));
+	xil_printf("[%3d] dropped %d frames, %d pixels overrun, "
+			"DMA ran dry %d times\n\r",
+			client.client_id, frame_ring_stats.frames_dropped,
+			frame_ring_stats.pixels_overrun,
+			frame_ring_stats.dma_ring_dry);
+	xil_printf("[%3d] queue high water %d of %d frames\n\r",
+			client.client_id, frame_ring_stats.queue_high_water,
+			FRAME_RING_SIZE);
+	xil_printf("[%3d] %d datagrams parked, %d dropped with %d frames, "
+			"%d send errors\n\r", client.client_id,
+			(u32)udp_tx_stats.parked,
+			(u32)udp_tx_stats.dropped_datagrams,
+			(u32)udp_tx_stats.dropped_frames,
+			(u32)udp_tx_stats.send_errors);
+	if (tx_pacer_rate())
+		xil_printf("[%3d] paced at %d kbit/s, %d datagrams "
+				"deferred\n\r", client.client_id,
+				tx_pacer_rate(), (u32)tx_pacer_stats.deferred);
+	/* idle useconds per ms of session are per mille */
+	idle = diff ? (event_stats.idle_cycles - client.start_idle) /
+			get_cycles_per_us() / diff : 0;
+	xil_printf("[%3d] main loop idle %d.%d%%\n\r", client.client_id,
+			(u32)(idle / 10), (u32)(idle % 10));
 }
 
 
@@ -128,82 +198,608 @@ static void reset_stats(void)
 	print_udp_conn_stats();
 	/* Save start time for final report */
 	client.start_time = get_time_ms();
-	client.total_bytes = 0;
-	client.cnt_datagrams = 0;
+	client.start_bytes = udp_tx_stats.bytes;
+	client.start_datagrams = udp_tx_stats.datagrams;
+	client.start_frames = udp_tx_stats.frames;
+	client.start_idle = event_stats.idle_cycles;
 
 	/* Initialize Interim report parameters */
 	client.i_report.start_time = 0;
-	client.i_report.total_bytes = 0;
+	client.i_report.start_bytes = udp_tx_stats.bytes;
 	client.i_report.last_report_time = 0;
 }
 #endif
 
+void udp_report_poll(void)
+{
+#if UDP_UART_REPORT
+	u64_t now, diff_ms;
+
+	if (report_done_ms) {
+		udp_conn_report(report_done_ms, UDP_DONE_CLIENT);
+		report_done_ms = 0;
+		xil_printf("UDP test passed Successfully\n\r");
+		return;
+	}
+	if (!pcb || !udp_tx_config.report_ms)
+		return;
+
+	now = get_time_ms();
+	if (!client.i_report.start_time) {
+		client.i_report.start_time = now;
+		return;
+	}
+	diff_ms = now - client.i_report.start_time;
+	if (diff_ms < udp_tx_config.report_ms)
+		return;
+	/* quiet while nothing is streamed */
+	if (udp_tx_stats.bytes != client.i_report.start_bytes)
+		udp_conn_report(diff_ms, INTER_REPORT);
+	else
+		client.i_report.last_report_time += diff_ms;
+	client.i_report.start_time = now;
+	client.i_report.start_bytes = udp_tx_stats.bytes;
+#endif
+}
+
 void print_app_header(void)
 {
 	xil_printf("UDP client connecting to %s on port %d\r\n",
 			UDP_SERVER_IP_ADDRESS, UDP_CONN_PORT);
-	xil_printf("On Host: Run $iperf -s -i %d -u\r\n\r\n",
-			INTERIM_REPORT_INTERVAL);
+	if (UDP_MCAST_GROUP[0])
+		xil_printf("Streaming to multicast group %s\r\n",
+				UDP_MCAST_GROUP);
+	xil_printf("Control port %d\r\n", UDP_CTRL_PORT);
+	xil_printf("On Host: Run $stream_bench -p %d -i %d\r\n\r\n",
+			UDP_CONN_PORT, INTERIM_REPORT_INTERVAL);
 }
 
-static void udp_packet_send(u8_t finished)
+#define UDP_BATCH_MAX_PAYLOAD (UDP_BATCH_MTU - 28) /* IPv4 + UDP headers */
+
+#if UDP_BATCH_FRAMES < 1 || UDP_BATCH_FRAMES > FRAME_RING_SIZE
+#error "UDP_BATCH_FRAMES must be between 1 and FRAME_RING_SIZE"
+#endif
+
+/* Bytes a frame takes in a datagram */
+#define FRAME_RECORD_LEN(frame) (FRAME_HEADER_SIZE + (frame)->len)
+
+/* Payload bytes of a fragment, every fragment but the last fills a whole
+ * datagram */
+#define UDP_FRAG_DATA (UDP_BATCH_MAX_PAYLOAD - FRAME_HEADER_SIZE)
+
+/* Wire header of a frame sent whole */
+static void frame_header_build(struct frame_slot *frame, u16_t flags,
+		struct frame_header *header)
+{
+	header->flags = frame->flags | flags;
+	header->format = frame->format;
+	header->timestamp_us = frame->timestamp;
+	header->sequence = frame->sequence;
+	header->pixel_count = frame->pixels;
+	header->payload_len = frame->len;
+	header->geometry = frame->geometry;
+	header->frames = frame->frames;
+	header->frag_index = 0;
+	header->frag_count = 1;
+	header->frag_offset = 0;
+}
+
+/* Write the wire header into the headroom in front of the pixels, so header
+ * and pixels go out as one contiguous record without being copied.
+ */
+static u8 *frame_header_fill(struct frame_slot *frame, u16_t flags)
+{
+	struct frame_header header;
+	u8 *record = frame->data - FRAME_HEADER_SIZE;
+
+	frame_header_build(frame, flags, &header);
+	frame_header_put(record, &header);
+
+	return record;
+}
+
+#if UDP_TX_ZERO_COPY
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error "UDP_TX_ZERO_COPY needs LWIP_SUPPORT_CUSTOM_PBUF enabled in the lwIP BSP settings"
+#endif
+
+/* One custom pbuf per ring slot, the slot index selects the pbuf */
+static struct pbuf_custom frame_pbufs[FRAME_RING_SIZE];
+
+/* Called by lwIP once the last reference to the frame is dropped, which for
+ * a sent datagram is when the EMAC driver reclaims its TX descriptor.
+ */
+static void frame_pbuf_free(struct pbuf *p)
+{
+	struct pbuf_custom *pc = (struct pbuf_custom *)p;
+
+	frame_ring_release(frame_ring_slot(pc - frame_pbufs));
+}
+
+/* Chain the frame records themselves behind an empty header pbuf. lwIP and
+ * the EMAC driver prepend their headers in front of them and the driver
+ * flushes the payload from the data cache before handing it to the DMA.
+ * Returns the number of frames actually chained in *count.
+ */
+static struct pbuf *batch_pbuf_alloc(struct frame_slot **frames, int *count,
+		u32 len, u16_t flags)
+{
+	struct pbuf *header, *data;
+	struct pbuf_custom *pc;
+	u8 *record;
+	int i;
+
+	header = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_RAM);
+	if (!header)
+		return NULL;
+
+	for (i = 0; i < *count; i++) {
+		pc = &frame_pbufs[frames[i]->index];
+		pc->custom_free_function = frame_pbuf_free;
+		record = frame_header_fill(frames[i],
+				i == *count - 1 ? flags : 0);
+		data = pbuf_alloced_custom(PBUF_RAW, FRAME_RECORD_LEN(frames[i]),
+				PBUF_REF, pc, record, FRAME_RECORD_LEN(frames[i]));
+		if (!data)
+			break;
+		pbuf_cat(header, data);
+	}
+
+	if (i == 0) {
+		pbuf_free(header);
+		return NULL;
+	}
+
+	*count = i;
+	return header;
+}
+#else
+/* Copy the frames into one pool pbuf, the frame buffers are free right after */
+static struct pbuf *batch_pbuf_alloc(struct frame_slot **frames, int *count,
+		u32 len, u16_t flags)
 {
-	int *payload;
-	static int packet_id;
-	u8_t retries = MAX_SEND_RETRY;
 	struct pbuf *packet;
-	err_t err;
-	u8* send_buf = tx_buffer;
+	u16_t offset = 0;
+	u8 *record;
 
-	packet = pbuf_alloc(PBUF_TRANSPORT, BUFFER_SIZE, PBUF_POOL);
-	if (!packet) {
-		xil_printf("error allocating pbuf to send\r\n");
-		return;
-	} else {
-		pbuf_take(packet, send_buf, BUFFER_SIZE);
-	}
-
-	/* always increment the id */
-	//payload = (int*) (packet->payload);
-	if (finished == FINISH)
-		packet_id = -1;
-
-	//payload[0] = htonl(packet_id);
-
-	while (retries) {
-		err = udp_send(pcb, packet);
-		if (err != ERR_OK) {
-			xil_printf("Error on udp_send: %d\r\n", err);
-			retries--;
-			usleep(100);
-		} else {
-#if DEBUG_ENABLE
-			client.total_bytes += BUFFER_SIZE;
-			client.cnt_datagrams++;
-			client.i_report.total_bytes += BUFFER_SIZE;
+	packet = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_POOL);
+	if (!packet)
+		return NULL;
+
+	for (int i = 0; i < *count; i++) {
+		record = frame_header_fill(frames[i],
+				i == *count - 1 ? flags : 0);
+		pbuf_take_at(packet, record, FRAME_RECORD_LEN(frames[i]), offset);
+		offset += FRAME_RECORD_LEN(frames[i]);
+	}
+	return packet;
+}
+#endif
+
+/* Copy the fragment of len payload bytes at offset into one pool pbuf, behind
+ * a header of its own. Fragments are always copied, only the first one could
+ * use the headroom in front of the frame.
+ */
+static struct pbuf *frag_pbuf_alloc(struct frame_slot *frame, u32 offset,
+		u32 len, u16_t flags)
+{
+	struct frame_header header;
+	u8 record[FRAME_HEADER_SIZE];
+	struct pbuf *packet;
+
+	packet = pbuf_alloc(PBUF_TRANSPORT, FRAME_HEADER_SIZE + len, PBUF_POOL);
+	if (!packet)
+		return NULL;
+
+	frame_header_build(frame, flags, &header);
+	header.payload_len = len;
+	header.frag_index = offset / UDP_FRAG_DATA;
+	header.frag_count = (frame->len + UDP_FRAG_DATA - 1) / UDP_FRAG_DATA;
+	header.frag_offset = offset;
+	frame_header_put(record, &header);
+
+	pbuf_take_at(packet, record, FRAME_HEADER_SIZE, 0);
+	pbuf_take_at(packet, frame->data + offset, len, FRAME_HEADER_SIZE);
+	return packet;
+}
+
+/* Turn the captured pixels into the payload that goes on the wire. Runs
+ * once per frame, in place, the consumer owns a ready frame's buffer.
+ */
+static void frame_prepare(struct frame_slot *frame)
+{
+	u32 len;
+#if UDP_TX_CODEC
+	u16_t format, flags = 0;
+#endif
+
+	if (udp_tx_config.sparse_threshold >= 0 &&
+			frame->format == FRAME_FMT_RAW8 &&
+			frame->pixels > 1) {
+		/* only worth it when smaller than the frame sent dense */
+		len = frame_sparse_encode(tx_sparse_buf,
+				frame->pixels - 1 < tx_sparse_size ?
+				frame->pixels - 1 : tx_sparse_size,
+				frame->data, frame->pixels,
+				udp_tx_config.sparse_threshold);
+		if (len) {
+			memcpy(frame->data, tx_sparse_buf, len);
+			frame->len = len;
+			frame->format = FRAME_FMT_SPARSE;
+		}
+	}
+#if UDP_TX_CODEC
+
+	if (frame->format == FRAME_FMT_RAW8) {
+		frame->len = frame_codec_encode(&tx_codec, frame->data,
+				frame->pixels, frame->sequence, &format, &flags);
+		frame->format = format;
+		frame->flags |= flags;
+	}
 #endif
+#if UDP_TX_PIXEL_BITS < 8
+	if (frame->format == FRAME_FMT_RAW8) {
+		frame->len = frame_pack(frame->data, frame->data, frame->pixels,
+				UDP_TX_PIXEL_BITS);
+		frame->format = FRAME_FMT_PACKED(UDP_TX_PIXEL_BITS);
+	}
+#endif
+	frame->prepared = 1;
+}
+
+/* What keeps the last udp_packet_send() from going on: the driver refused
+ * a datagram or a pbuf, which its TX interrupt ends, or the batch flush time
+ * or the pacer tokens lie ahead, the earliest of them, 0 for none. */
+static u8 tx_wait_driver;
+static u8 tx_wait_pbuf;
+static u64 tx_wait_until;
+
+static void tx_wait_time(u64 time_us)
+{
+	if (!tx_wait_until || time_us < tx_wait_until)
+		tx_wait_until = time_us;
+}
+
+/* Collect the ready frames that go into the next datagram. Returns 0 while
+ * a partial batch may still grow, i.e. more frames fit, the batch is not
+ * full and the oldest frame is younger than the flush deadline.
+ */
+static int batch_collect(struct frame_slot **frames, int *count, u32 *len,
+		u8_t finished)
+{
+	struct frame_slot *frame;
+	int n = 0, full = 0;
+	u32 total = 0;
+	u64 due;
+
+	while (n < (int)udp_tx_config.batch_frames) {
+		frame = frame_ring_peek_n(n);
+		if (!frame)
+			break;
+		if (!frame->prepared)
+			frame_prepare(frame);
+		if (total + FRAME_RECORD_LEN(frame) > UDP_BATCH_MAX_PAYLOAD) {
+			full = 1;
 			break;
 		}
+		total += FRAME_RECORD_LEN(frame);
+		frames[n++] = frame;
 	}
-	if (!retries) {
-		/* Terminate this app */
-#if DEBUG_ENABLE
-		u64_t now = get_time_ms();
-		u64_t diff_ms = now - client.start_time;
-		udp_conn_report(diff_ms, UDP_DONE_CLIENT);
+
+	if (n == 0) {
+		/* a single frame larger than the MTU is sent in fragments */
+		frame = frame_ring_peek();
+		if (!frame)
+			return 0;
+		total = FRAME_RECORD_LEN(frame);
+		frames[n++] = frame;
+	}
+
+	*count = n;
+	*len = total;
+
+	if (finished == FINISH || n == (int)udp_tx_config.batch_frames ||
+			full)
+		return 1;
+
+	/* uncoded frames keep the size of the last one until the readout
+	 * changes, a batch that cannot take one more is complete */
+	if (!UDP_TX_CODEC &&
+			total + FRAME_RECORD_LEN(frames[n - 1]) > UDP_BATCH_MAX_PAYLOAD)
+		return 1;
+
+	due = frames[0]->timestamp + udp_tx_config.batch_flush_us;
+	if (get_time_us() >= due)
+		return 1;
+	tx_wait_time(due);
+	return 0;
+}
+
+/* A datagram handed to udp_send(), parked while the driver refuses it */
+struct tx_dgram {
+	struct pbuf *packet;
+	u32 len;
+	u32 frames;
+	/* already counted as parked */
+	u8 refused;
+	/* a fragment of the frame with this capture sequence */
+	u8 frag;
+	u32 sequence;
+#if PROBE_ENABLE
+	/* the slots may be reused once released, keep their commit times */
+	u32 commit_cycles[UDP_BATCH_FRAMES];
 #endif
-		xil_printf("Too many udp_send() retries, ");
-		xil_printf("Terminating application\n\r");
-		xil_printf("UDP test failed\n\r");
-		udp_remove(pcb);
-		pcb = NULL;
+};
+
+static struct tx_dgram tx_queue[UDP_TX_PENDING];
+static u32 tx_queue_head = 0;
+static u32 tx_queue_count = 0;
+
+/* Frame going out in fragments and the payload offset of the next one. It
+ * stays at the head of the ring until its last fragment is queued. */
+static struct frame_slot *tx_frag_frame = NULL;
+static u32 tx_frag_offset = 0;
+
+static void tx_drop_oldest(void)
+{
+	struct tx_dgram *dgram = &tx_queue[tx_queue_head];
+	u32 sequence = dgram->sequence;
+	u8 frag = dgram->frag;
+
+	/* a frame missing one fragment is lost as a whole, its other queued
+	 * fragments go along and the rest is never queued */
+	udp_tx_stats.dropped_frames += frag ? 1 : dgram->frames;
+	do {
+		udp_tx_stats.dropped_datagrams++;
+		pbuf_free(dgram->packet);
+		tx_queue_head = (tx_queue_head + 1) % UDP_TX_PENDING;
+		tx_queue_count--;
+		dgram = &tx_queue[tx_queue_head];
+	} while (frag && tx_queue_count && dgram->frag &&
+			dgram->sequence == sequence);
+	if (frag && tx_frag_frame && tx_frag_frame->sequence == sequence) {
+		frame_ring_pop();
+		frame_ring_release(tx_frag_frame);
+		tx_frag_frame = NULL;
 	}
-	if (finished == FINISH)
-		pcb = NULL;
+#if UDP_TX_CODEC
+	/* the next frame may refer to a dropped one, let the host resync */
+	frame_codec_reset(&tx_codec);
+#endif
+}
+
+/* Send the queued datagrams in order until the driver refuses one */
+static void tx_flush(void)
+{
+	struct tx_dgram *dgram;
+	err_t err;
+
+	tx_wait_driver = 0;
+	while (tx_queue_count) {
+		dgram = &tx_queue[tx_queue_head];
+
+		PROBE_START(send_start);
+		err = udp_sendto(pcb, dgram->packet, &tx_dest, UDP_CONN_PORT);
+		PROBE_END(PROBE_UDP_SEND, send_start);
+
+		if (err == ERR_MEM) {
+			/* TX ring full, retry on the next main loop pass */
+			udp_tx_stats.retries++;
+			tx_wait_driver = 1;
+			if (!dgram->refused) {
+				dgram->refused = 1;
+				udp_tx_stats.parked++;
+			}
+			return;
+		} else if (err != ERR_OK) {
+			/* not going to get better by retrying this datagram */
+			udp_tx_stats.send_errors++;
+			tx_drop_oldest();
+			continue;
+		}
 
-	pbuf_free(packet);
-	send_udp = 0;
-	//packet_id++;
+#if PROBE_ENABLE
+		for (u32 i = 0; i < dgram->frames; i++)
+			PROBE_END(PROBE_FRAME_TO_SENT, dgram->commit_cycles[i]);
+#endif
+		udp_tx_stats.bytes += dgram->len;
+		udp_tx_stats.datagrams++;
+		udp_tx_stats.frames += dgram->frames;
+		pbuf_free(dgram->packet);
+		tx_queue_head = (tx_queue_head + 1) % UDP_TX_PENDING;
+		tx_queue_count--;
+	}
+}
+
+/* Whether transfer_data() has work, frames captured after the session
+ * ended are not sent. frame_ring_pending() also frees the skipped slots,
+ * so it is asked even while datagrams are queued. */
+int udp_tx_pending(void)
+{
+	return pcb && (frame_ring_pending() || tx_queue_count);
+}
+
+/* Whether the last transfer_data() was held up by the driver or by a
+ * deadline, another pass before then would do nothing. *deadline_us is the
+ * get_time_us() to try again at, 0 if only the driver decides. */
+int udp_tx_stalled(u64 *deadline_us)
+{
+	*deadline_us = tx_wait_until;
+	return tx_wait_driver || tx_wait_pbuf || tx_wait_until;
+}
+
+u32 udp_tx_queued(void)
+{
+	return tx_queue_count;
+}
+
+/* Park a datagram carrying frames complete frames behind the queued ones */
+static struct tx_dgram *tx_queue_add(struct pbuf *packet, u32 frames)
+{
+	struct tx_dgram *dgram;
+
+	if (tx_queue_count == UDP_TX_PENDING) {
+		/* keep the stream current, the newest frames are worth more */
+		tx_drop_oldest();
+	}
+
+	dgram = &tx_queue[(tx_queue_head + tx_queue_count) % UDP_TX_PENDING];
+	dgram->packet = packet;
+	dgram->len = packet->tot_len;
+	dgram->frames = frames;
+	dgram->refused = 0;
+	dgram->frag = 0;
+	tx_queue_count++;
+	return dgram;
+}
+
+#if PROBE_ENABLE
+static struct tx_dgram *tx_queue_last(void)
+{
+	return &tx_queue[(tx_queue_head + tx_queue_count - 1) % UDP_TX_PENDING];
+}
+#endif
+
+/* Queue the next fragments of tx_frag_frame. A frame missing one fragment
+ * is lost as a whole, so fragments wait for the driver instead of pushing
+ * queued ones out, only the end of the session drops them.
+ */
+static void udp_frag_queue(u8_t finished)
+{
+	struct frame_slot *frame = tx_frag_frame;
+	struct tx_dgram *dgram;
+	struct pbuf *packet;
+	u32 len;
+	int last;
+
+	while (tx_frag_frame) {
+		len = frame->len - tx_frag_offset;
+		if (len > UDP_FRAG_DATA)
+			len = UDP_FRAG_DATA;
+		last = tx_frag_offset + len == frame->len;
+
+		if (tx_queue_count == UDP_TX_PENDING)
+			tx_flush();
+		if (tx_queue_count == UDP_TX_PENDING)
+			return;
+		if (finished != FINISH &&
+				!tx_pacer_admit(FRAME_HEADER_SIZE + len)) {
+			tx_wait_time(tx_pacer_ready_us());
+			return;
+		}
+
+		packet = frag_pbuf_alloc(frame, tx_frag_offset, len,
+				last && finished == FINISH ? FRAME_FLAG_LAST : 0);
+		if (!packet) {
+			/* retried from the same offset on the next pass */
+			LOG(LOG_TX_PBUF);
+			tx_wait_pbuf = 1;
+			return;
+		}
+
+		/* the frame counts as sent with its last fragment */
+		dgram = tx_queue_add(packet, last);
+		dgram->frag = 1;
+		dgram->sequence = frame->sequence;
+		tx_frag_offset += len;
+		if (!last)
+			continue;
+
+#if PROBE_ENABLE
+		tx_queue_last()->commit_cycles[0] = frame->commit_cycles;
+		PROBE_END(PROBE_FRAME_TO_ALLOC, frame->commit_cycles);
+#endif
+		frame_ring_pop();
+		frame_ring_release(frame);
+		tx_frag_frame = NULL;
+	}
+}
+
+/* Build the next datagram from the ready frames and queue it for sending */
+static void udp_batch_queue(u8_t finished)
+{
+	struct pbuf *packet;
+	struct frame_slot *frames[UDP_BATCH_FRAMES];
+	int count;
+	u32 len;
+
+	if (tx_frag_frame) {
+		udp_frag_queue(finished);
+		if (tx_frag_frame || finished == FINISH)
+			return;
+	}
+
+	if (!batch_collect(frames, &count, &len, finished))
+		return;
+
+	if (len > UDP_BATCH_MAX_PAYLOAD) {
+		/* a lone frame, never left to IP fragmentation */
+		tx_frag_frame = frames[0];
+		tx_frag_offset = 0;
+		udp_frag_queue(finished);
+		return;
+	}
+
+#if UDP_TX_DROP_POLICY == UDP_TX_DROP_NEWEST
+	/* the frames stay in the ring, which drops the newest once it is full */
+	if (tx_queue_count == UDP_TX_PENDING && finished != FINISH)
+		return;
+#endif
+
+	/* without tokens the frames stay queued, the batch may still grow */
+	if (finished != FINISH && !tx_pacer_admit(len)) {
+		tx_wait_time(tx_pacer_ready_us());
+		return;
+	}
+
+	packet = batch_pbuf_alloc(frames, &count, len,
+			finished == FINISH ? FRAME_FLAG_LAST : 0);
+	if (!packet) {
+		/* leave the frames queued, they are retried on the next pass */
+		LOG(LOG_TX_PBUF);
+		tx_wait_pbuf = 1;
+		return;
+	}
+
+	tx_queue_add(packet, count);
+
+	for (int i = 0; i < count; i++) {
+#if PROBE_ENABLE
+		tx_queue_last()->commit_cycles[i] = frames[i]->commit_cycles;
+		PROBE_END(PROBE_FRAME_TO_ALLOC, frames[i]->commit_cycles);
+#endif
+		frame_ring_pop();
+#if !UDP_TX_ZERO_COPY
+		/* the frame is copied out, hand the buffer back to acquisition */
+		frame_ring_release(frames[i]);
+#endif
+	}
+}
+
+static void udp_packet_send(u8_t finished)
+{
+	tx_wait_pbuf = 0;
+	tx_wait_until = 0;
+
+	/* datagrams refused earlier go first */
+	tx_flush();
+	udp_batch_queue(finished);
+	tx_flush();
+
+	if (finished == FINISH) {
+		/* the session ends, whatever the driver still refuses is lost */
+		while (tx_queue_count)
+			tx_drop_oldest();
+		if (tx_frag_frame) {
+			/* a fragment could not be allocated, the rest is lost */
+			udp_tx_stats.dropped_frames++;
+			frame_ring_pop();
+			frame_ring_release(tx_frag_frame);
+			tx_frag_frame = NULL;
+		}
+		tx_consumer_count = 0;
+		pcb = NULL;
+	}
 }
 
 /** Transmit data on a udp session */
@@ -211,76 +807,197 @@ void transfer_data(void)
 {
 	if (pcb == NULL)
 		return;
-#if DEBUG_ENABLE
-	if (END_TIME || REPORT_INTERVAL_TIME) {
-		u64_t now = get_time_ms();
-		if (REPORT_INTERVAL_TIME) {
-			if (client.i_report.start_time) {
-				u64_t diff_ms = now - client.i_report.start_time;
-				if (diff_ms >= REPORT_INTERVAL_TIME) {
-					udp_conn_report(diff_ms, INTER_REPORT);
-					client.i_report.start_time = 0;
-					client.i_report.total_bytes = 0;
-				}
-			} else {
-				client.i_report.start_time = now;
-			}
+	/* this session is time-limited */
+	if (udp_tx_config.session_ms) {
+		u64_t diff_ms = get_time_ms() - session_start;
+		if (diff_ms >= udp_tx_config.session_ms) {
+			/* time specified is over, close the connection, the
+			 * report waits for the main loop */
+			udp_packet_send(FINISH);
+#if UDP_UART_REPORT
+			report_done_ms = diff_ms;
+#endif
+			return;
 		}
+	}
+	udp_packet_send(!FINISH);
+}
 
-		if (END_TIME) {
-			/* this session is time-limited */
-			u64_t diff_ms = now - client.start_time;
-			if (diff_ms >= END_TIME) {
-				/* time specified is over,
-				 * close the connection */
-				udp_packet_send(FINISH);
-				udp_conn_report(diff_ms, UDP_DONE_CLIENT);
-				xil_printf("UDP test passed Successfully\n\r");
-				return;
-			}
-		}
+void udp_stream_start_stop(int start)
+{
+#if UDP_TX_CODEC
+	if (start)
+		frame_codec_reset(&tx_codec);
+#endif
+	start_stop_measurements(start);
+}
+
+int udp_stream_request(const ip_addr_t *addr, u16_t port, int start)
+{
+	u32 i;
+
+	if (!ip_addr_ismulticast(&tx_dest)) {
+		udp_stream_start_stop(start);
+		return 0;
+	}
+
+	for (i = 0; i < tx_consumer_count; i++)
+		if (ip_addr_cmp(&tx_consumers[i].addr, addr) &&
+				tx_consumers[i].port == port)
+			break;
+
+	if (!start) {
+		if (i == tx_consumer_count)
+			return 0;
+		tx_consumers[i] = tx_consumers[--tx_consumer_count];
+		if (!tx_consumer_count)
+			udp_stream_start_stop(0);
+		return 0;
+	}
+
+	if (i == tx_consumer_count) {
+		if (i == UDP_MCAST_CONSUMERS)
+			return -1;
+		tx_consumers[i].addr = *addr;
+		tx_consumers[i].port = port;
+		tx_consumer_count++;
 	}
+	if (!is_measurement_time) {
+		udp_stream_start_stop(1);
+	} else {
+#if UDP_TX_CODEC
+		/* the new receiver has no reference to decode against */
+		frame_codec_reset(&tx_codec);
 #endif
-	udp_packet_send(!FINISH);
+	}
+	return 0;
 }
 
-static void recive_udp_callback(void *arg, struct udp_pcb *tpcb,
-		struct pbuf *p, const ip_addr_t *addr, u16_t port)
+int udp_stream_set_multicast(const ip_addr_t *group, u32 ttl)
 {
-	char* payload = (char *)(p->payload);
-	int packet_lenght = (int)(*payload);
-	char string[packet_lenght];
-	for(int i=0; i < packet_lenght; i++)
-	{
-		string[i] = *(payload+i*sizeof(char));
-	}
-
-	if(!(strcmp(string, "start")))
-	{
-		start_stop_measurements(1);
-		xil_printf("Start sending via udp \r\n");
-	}
-	/*else if(!(strcmp(string, "tx")))
-	{
-		send_udp = 0;
-		//xil_printf("Ack received \r\n");
-	}*/
-	else if(!(strcmp(string, "finish")))
-	{
-		start_stop_measurements(0);
-		xil_printf("Stop sending via udp \r\n");
+	if (!pcb)
+		return -1;
+
+	/* the receivers of the old destination could not stop the stream,
+	 * only the ttl changes while streaming */
+	if (is_measurement_time && (group ? !ip_addr_cmp(&tx_dest, group) :
+			ip_addr_ismulticast(&tx_dest)))
+		return -1;
+
+	if (!group) {
+		if (udp_connect(pcb, &server_addr, UDP_CONN_PORT) != ERR_OK)
+			return -1;
+		tx_dest = server_addr;
+		tx_consumer_count = 0;
+		return 0;
 	}
-	else
-	{
-		xil_printf("Unknown command received \r\n");
+
+#if UDP_MCAST
+	if (!ip_addr_ismulticast(group) || ttl < 1 || ttl > 255)
+		return -1;
+
+	/* commands now come from every receiver, not just the server */
+	udp_disconnect(pcb);
+	udp_set_multicast_ttl(pcb, ttl);
+	tx_mcast_ttl = ttl;
+	if (!ip_addr_cmp(&tx_dest, group)) {
+		/* the receivers of the old group have to ask again */
+		tx_dest = *group;
+		tx_consumer_count = 0;
 	}
-	memset(string,0,packet_lenght);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+const ip_addr_t *udp_stream_dest(void)
+{
+	return &tx_dest;
+}
+
+int udp_stream_multicast(ip_addr_t *group, u32 *ttl)
+{
+	*group = tx_dest;
+	*ttl = tx_mcast_ttl;
+	return ip_addr_ismulticast(&tx_dest);
+}
+
+u32 udp_stream_consumers(void)
+{
+	return tx_consumer_count;
+}
+
+/* Carve the buffers of the stream for the given size from the arena */
+static int udp_stream_alloc(u32 width, u32 pixels)
+{
+#if UDP_TX_CODEC
+	void *work;
+#endif
+
+	frame_arena_reset();
+	if (frame_ring_configure(pixels) || acq_configure(width, pixels))
+		return -1;
+
+	tx_sparse_buf = frame_arena_alloc(pixels);
+	tx_sparse_size = pixels;
+	if (!tx_sparse_buf)
+		return -1;
+#if UDP_TX_CODEC
+	work = frame_arena_alloc(FRAME_CODEC_WORK_SIZE(pixels));
+	if (!work)
+		return -1;
+	frame_codec_init(&tx_codec, work, pixels, UDP_TX_KEY_INTERVAL);
+#endif
+	return 0;
+}
+
+int udp_stream_idle(void)
+{
+	return !is_measurement_time && !tx_frag_frame && !tx_queue_count &&
+			!frame_ring_pending();
+}
+
+int udp_stream_set_frame_size(u32 width, u32 pixels)
+{
+	static u32 cur_width, cur_pixels;
+
+	if (!udp_stream_idle())
+		return -1;
+	if (!pixels || pixels > FRAME_ARENA_SIZE)
+		return -1;
+
+	/* the buffers move, nothing may still be written or read from them:
+	 * the frame cut short by the stop is never completed, and the DMA
+	 * gives back the buffers it was armed with */
+	acq_reset();
+	if (platform_acq_quiesce() || !frame_ring_idle())
+		return -1;
+
+	if (udp_stream_alloc(width, pixels) == 0) {
+		cur_width = width;
+		cur_pixels = pixels;
+		return 0;
+	}
+
+	LOG(LOG_FRAME_NO_ROOM, pixels);
+	/* what the previous size took still fits */
+	if (cur_pixels)
+		udp_stream_alloc(cur_width, cur_pixels);
+	return -1;
+}
+
+static void recive_udp_callback(void *arg, struct udp_pcb *tpcb,
+		struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+	ctrl_input(tpcb, p, addr, port);
+	pbuf_free(p);
 }
 
 void start_application(void)
 {
 	err_t err;
-	ip_addr_t remote_addr;
+	ip_addr_t remote_addr, group;
 
 	err = inet_aton(UDP_SERVER_IP_ADDRESS, &remote_addr);
 	if (!err) {
@@ -303,10 +1020,29 @@ void start_application(void)
 	}
 	/* Wait for successful connection */
 	usleep(10);
+	server_addr = remote_addr;
+	tx_dest = remote_addr;
+
+	if (UDP_MCAST_GROUP[0] && (!inet_aton(UDP_MCAST_GROUP, &group) ||
+			udp_stream_set_multicast(&group, UDP_MCAST_TTL)))
+		xil_printf("udp_client: Invalid multicast group %s\r\n",
+				UDP_MCAST_GROUP);
 
 	udp_recv(pcb, (udp_recv_fn)recive_udp_callback, NULL);
 
-#if DEBUG_ENABLE
+	/* Control PCB, replies go to whoever sent the request */
+	ctrl_pcb = udp_new();
+	if (!ctrl_pcb || udp_bind(ctrl_pcb, IP_ADDR_ANY, UDP_CTRL_PORT) != ERR_OK)
+		xil_printf("udp_client: Error binding control port %d\r\n",
+				UDP_CTRL_PORT);
+	else
+		udp_recv(ctrl_pcb, (udp_recv_fn)recive_udp_callback, NULL);
+
+	tx_pacer_init();
+	telemetry_init();
+	session_start = get_time_ms();
+
+#if UDP_UART_REPORT
 	reset_stats();
 #endif
 }
@@ -47,15 +47,6 @@ enum {
 	KCONV_GIGA,
 };
 
-/* labels for formats [KMG] */
-const char kLabel[] =
-{
-	' ',
-	'K',
-	'M',
-	'G'
-};
-
 /* used as type of print */
 enum measure_t {
 	BYTES,
@@ -74,15 +65,21 @@ enum report_type {
 
 struct interim_report {
 	u64_t start_time;
+	/* ms into the session the interval started */
 	u64_t last_report_time;
-	u32_t total_bytes;
+	/* udp_tx_stats.bytes when the interval started */
+	u64_t start_bytes;
 };
 
 struct perf_stats {
 	u8_t client_id;
 	u64_t start_time;
-	u64_t total_bytes;
-	u64_t cnt_datagrams;
+	/* udp_tx_stats at the start of the session */
+	u64_t start_bytes;
+	u64_t start_datagrams;
+	u64_t start_frames;
+	/* event_stats.idle_cycles at the start of the session */
+	u64_t start_idle;
 	struct interim_report i_report;
 };
 
@@ -90,15 +87,184 @@ struct perf_stats {
 #define INTERIM_REPORT_INTERVAL 10
 
 /* Client port to connect */
+#ifndef UDP_CONN_PORT
 #define UDP_CONN_PORT 50000
+#endif
+
+/* Board port taking commands from any host, besides the data PCB that only
+ * hears the server (control.h) */
+#ifndef UDP_CTRL_PORT
+#define UDP_CTRL_PORT 50001
+#endif
+
+/* Port the telemetry datagrams (telem_proto.h) go to, on the host or the
+ * multicast group the stream goes to. They leave from a port of lwIP's
+ * dynamic range, so a host may run the board simulator and the decoder. */
+#ifndef UDP_TELEM_PORT
+#define UDP_TELEM_PORT 50002
+#endif
+
+/* ms between telemetry datagrams, 0 sends none */
+#define UDP_TELEM_INTERVAL 1000
+
+/* Print the interim and final bandwidth reports on the UART. They are only
+ * printed from the main loop while no frame waits to be sent, never from
+ * the send path, but a line at 115200 baud still takes about 5 ms. */
+#ifndef UDP_UART_REPORT
+#define UDP_UART_REPORT DEBUG_ENABLE
+#endif
 
 /* time in mseconds to transmit packets */
 #define UDP_TIME_INTERVAL 100
 
 /* Server to connect with */
+#ifndef UDP_SERVER_IP_ADDRESS
 #define UDP_SERVER_IP_ADDRESS "192.168.1.1"
+#endif
+
+/* Stream to an IP multicast group instead of the server, so any number of
+ * receivers that joined the group share one stream at no extra cost to the
+ * board. Needs LWIP_IGMP and LWIP_MULTICAST_TX_OPTIONS in the lwIP BSP
+ * settings, set to 0 to build without. */
+#ifndef UDP_MCAST
+#define UDP_MCAST 1
+#endif
+
+/* Group streamed to from the start, empty to stream to the server until the
+ * "mcast" command or the control protocol selects a group */
+#ifndef UDP_MCAST_GROUP
+#define UDP_MCAST_GROUP ""
+#endif
+
+/* Hops a multicast datagram may take, 1 keeps it on the local network */
+#define UDP_MCAST_TTL 1
+
+/* Receivers of a multicast stream tracked at once. The stream runs while
+ * any of them asked for it, "finish" only signs off the one sending it. */
+#define UDP_MCAST_CONSUMERS 8
+
+/* Datagrams parked while the EMAC TX ring is full, they are retried from
+ * the main loop instead of blocking it */
+#define UDP_TX_PENDING 4
+
+/* What gives way when UDP_TX_PENDING datagrams are parked already */
+#define UDP_TX_DROP_OLDEST 0	/* discard the oldest parked datagram */
+#define UDP_TX_DROP_NEWEST 1	/* new frames wait in the frame ring */
+
+#define UDP_TX_DROP_POLICY UDP_TX_DROP_OLDEST
+
+/* Counters of the send path, only the main loop updates them */
+struct udp_tx_stats {
+	/* sent, in payload bytes, datagrams and whole frames */
+	u64 bytes;
+	u64 datagrams;
+	u64 frames;
+	/* datagrams refused at least once by the full TX ring and parked */
+	u64 parked;
+	/* sends refused by the full TX ring, every retry counts */
+	u64 retries;
+	/* parked datagrams discarded by the drop policy or at the end */
+	u64 dropped_datagrams;
+	u64 dropped_frames;
+	/* sends failing for another reason than a full TX ring */
+	u64 send_errors;
+};
+
+extern struct udp_tx_stats udp_tx_stats;
+
+/* Send frame buffers by reference instead of copying them into a pbuf,
+ * set to 0 to fall back to the PBUF_POOL copy path */
+#define UDP_TX_ZERO_COPY 1
+
+/* Max frames coalesced into one datagram, 1 sends every frame on its own */
+#define UDP_BATCH_FRAMES 4
+
+/* Link MTU, a batch never grows past one unfragmented datagram */
+#define UDP_BATCH_MTU 1500
+
+/* Time in useconds a partial batch may wait for more frames */
+#define UDP_BATCH_FLUSH_US 1000
+
+/* Send frames as Rice coded temporal residuals (frame_codec.h) */
+#define UDP_TX_CODEC 0
 
-/* MAX UDP send retries */
-#define MAX_SEND_RETRY 10
+/* Frames between key frames, bounds how long a lost frame breaks decoding */
+#define UDP_TX_KEY_INTERVAL 32
+
+/* Significant bits of a pixel, the ADC delivers MEAS_CHANNEL_SIZE (7) bits.
+ * Below 8 the frames the codec leaves raw are bit packed (frame_pack.h).
+ */
+#define UDP_TX_PIXEL_BITS 8
+
+/* Pixels at or below this value are suppressed (frame_sparse.h), frames
+ * the sparse coding does not shrink go out dense. -1 sends every frame
+ * dense, the "sparse" command changes it at run time. */
+#define UDP_TX_SPARSE_THRESHOLD -1
+
+/* Transport settings, they start out with the defaults above and the
+ * command port (control.h) changes them at run time */
+struct udp_tx_config {
+	/* max frames per datagram, 1 to UDP_BATCH_FRAMES */
+	u32 batch_frames;
+	u32 batch_flush_us;
+	/* pixels at or below it are suppressed, -1 sends frames dense */
+	int sparse_threshold;
+	/* ms between interim reports, 0 for none */
+	u32 report_ms;
+	/* ms after which a session ends by itself, 0 for never */
+	u32 session_ms;
+	/* ms between telemetry datagrams, 0 for none */
+	u32 telem_ms;
+};
+
+extern struct udp_tx_config udp_tx_config;
+
+/* Start or stop capturing and streaming frames */
+void udp_stream_start_stop(int start);
+
+/*
+ * Start or stop the stream for the receiver at addr:port. Unicast streams
+ * start and stop right away, a multicast stream runs while any receiver
+ * that started it has not stopped it yet, and every new receiver gets a
+ * key frame. Returns -1 if UDP_MCAST_CONSUMERS receivers are active.
+ */
+int udp_stream_request(const ip_addr_t *addr, u16_t port, int start);
+
+/* Stream to the multicast group with ttl hops, or to the server again when
+ * group is NULL. Returns -1 if group is no multicast address, the ttl is
+ * out of range, or the destination would change while streaming. */
+int udp_stream_set_multicast(const ip_addr_t *group, u32 ttl);
+
+/* Returns 1 and the group and ttl while streaming to a multicast group */
+int udp_stream_multicast(ip_addr_t *group, u32 *ttl);
+
+/* Receivers of a multicast stream that have it started */
+u32 udp_stream_consumers(void);
+
+/* Where the stream goes, the server or the multicast group */
+const ip_addr_t *udp_stream_dest(void);
+
+/* Datagrams parked while the EMAC TX ring is full */
+u32 udp_tx_queued(void);
+
+/* Whether the send path waits for the driver or until *deadline_us (0 for
+ * no deadline), the main loop then sleeps instead of passing again */
+int udp_tx_stalled(u64 *deadline_us);
+
+/* Print the due bandwidth reports on the UART. Called from the main loop
+ * while nothing waits to be sent. */
+void udp_report_poll(void);
+
+/* Streaming is stopped and no frame waits in the ring or is being sent */
+int udp_stream_idle(void);
+
+/*
+ * Size the frames of a sensor of width columns to pixels pixels, carving the
+ * frame buffers and the work buffers of the send path from the frame arena
+ * (frame_arena.h). Frames larger than one datagram go out in fragments
+ * (frame_proto.h). Only while streaming is stopped and every frame is sent,
+ * returns -1 otherwise or if the size does not fit, keeping the last one.
+ */
+int udp_stream_set_frame_size(u32 width, u32 pixels);
 
 #endif /* __UDP_PERF_CLIENT_H_ */